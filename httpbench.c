@@ -0,0 +1,674 @@
+#include "httpserver.h"
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <strings.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+// A load generator for measuring the server. The server is started in the same process on a loopback port,
+// and a number of client threads send requests to it for a while in each scenario. The throughput and the latency
+// percentiles of each scenario are printed, and written to a file as one JSON object per line so the results
+// of two builds can be compared.
+
+#define HTTP_BENCH_BUFFER_SIZE 65536
+#define HTTP_BENCH_PIPELINE_DEPTH 16
+
+// --------------------------------------------------------------------------------
+
+struct http_bench_scenario_t {
+	const char *name;
+	const char *path;
+	bool keep_alive;				// Whether a connection is used for more than one request
+	int pipeline;					// Number of requests sent at once before reading the responses
+};
+
+struct http_bench_settings_t {
+	uint16_t port;
+	int connections;				// Number of client threads, each with a connection of its own
+	int duration;					// Time each scenario runs for in seconds
+	uint16_t worker_threads;		// Number of event loops in the server
+	bool io_uring;
+	const char *only;				// Name of the only scenario to run, NULL to run all of them
+	const char *output;				// File the results are written to, NULL to only print them
+};
+
+// Results of a scenario, counted separately by each client thread.
+struct http_bench_results_t {
+	uint64_t *latencies;			// Time taken by each request in nanoseconds
+	size_t latencies_len;
+	size_t latencies_size;
+	uint64_t bytes;					// Number of response bytes received
+	uint64_t errors;				// Number of failed requests and connections
+};
+
+struct http_bench_client_t {
+	pthread_t thread;
+	const struct http_bench_scenario_t *scenario;
+	struct http_bench_results_t results;
+
+	int socket;
+	char buffer[HTTP_BENCH_BUFFER_SIZE]; // Received data which hasn't been parsed yet
+	size_t buffer_len;
+};
+
+// --------------------------------------------------------------------------------
+
+static const struct http_bench_scenario_t scenarios[] = {
+	{ "keepalive", "/hello", true, 1 },
+	{ "close", "/hello", false, 1 },
+	{ "pipelined", "/hello", true, HTTP_BENCH_PIPELINE_DEPTH },
+	{ "static-1k", "/static/1k.bin", true, 1 },
+	{ "static-1m", "/static/1m.bin", true, 1 },
+	{ "static-100m", "/static/100m.bin", true, 1 },
+};
+
+static const struct {
+	const char *name;
+	size_t size;
+} files[] = {
+	{ "1k.bin", 1024 },
+	{ "1m.bin", 1024 * 1024 },
+	{ "100m.bin", 100 * 1024 * 1024 },
+};
+
+static struct http_bench_settings_t settings = {
+	.port = 8089,
+	.connections = 16,
+	.duration = 3,
+	.worker_threads = 1,
+};
+
+static char directory[] = "/tmp/httpbench.XXXXXX";
+static bool running;				// Cleared when the clients should stop sending requests
+
+// --------------------------------------------------------------------------------
+
+static struct http_response_t http_bench_handle_hello(struct http_request_t *request, void *context);
+static struct http_response_t http_bench_handle_request(struct http_request_t *request, void *context);
+static bool http_bench_parse_arguments(int argc, char *argv[]);
+static bool http_bench_create_files(void);
+static void http_bench_remove_files(void);
+static void *http_bench_serve(void *arg);
+static bool http_bench_run(const struct http_bench_scenario_t *scenario, FILE *output);
+static void *http_bench_client_thread(void *arg);
+static bool http_bench_connect(struct http_bench_client_t *client);
+static void http_bench_disconnect(struct http_bench_client_t *client);
+static bool http_bench_send(struct http_bench_client_t *client, const char *data, size_t length);
+static bool http_bench_read_response(struct http_bench_client_t *client);
+static void http_bench_add_latency(struct http_bench_results_t *results, uint64_t latency);
+static uint64_t http_bench_get_time(void);
+static int http_bench_compare(const void *a, const void *b);
+static double http_bench_percentile(const uint64_t *latencies, size_t count, double percentile);
+
+// --------------------------------------------------------------------------------
+
+int main(int argc, char *argv[])
+{
+	if (!http_bench_parse_arguments(argc, argv)) {
+		printf("Usage: %s [--port N] [--connections N] [--duration seconds] [--worker-threads N] [--io-uring]\n"
+			"       [--scenario name] [--output file]\n", argv[0]);
+		return 1;
+	}
+
+	if (!http_bench_create_files()) {
+		printf("Failed to create the static files!\n");
+		http_bench_remove_files();
+		return 1;
+	}
+
+	struct server_directory_t directories[] = { { "/static/", directory } };
+
+	struct server_settings_t server;
+	memset(&server, 0, sizeof(server));
+
+	server.handler = http_bench_handle_request;
+	server.port = settings.port;
+	server.max_connections = 1024;
+	server.connection_timeout = 60;
+	server.worker_threads = settings.worker_threads;
+	server.io_uring = settings.io_uring;
+	server.directories = directories;
+	server.directories_len = 1;
+	server.cache_size = 16 * 1024 * 1024;
+
+	http_server_add_route("GET", "/hello", http_bench_handle_hello, NULL);
+
+	if (!http_server_initialize(server)) {
+		printf("Failed to start the server!\n");
+		http_bench_remove_files();
+		return 1;
+	}
+
+	pthread_t server_thread;
+
+	if (pthread_create(&server_thread, NULL, http_bench_serve, NULL) != 0) {
+		printf("Failed to start the server thread!\n");
+		http_bench_remove_files();
+		return 1;
+	}
+
+	FILE *output = NULL;
+
+	if (settings.output != NULL) {
+
+		output = fopen(settings.output, "w");
+
+		if (output == NULL) {
+			printf("Failed to open %s!\n", settings.output);
+			http_bench_remove_files();
+			return 1;
+		}
+	}
+
+	printf("%-12s %10s %8s %12s %10s %10s %10s %10s\n", "scenario", "requests", "errors", "requests/s", "MB/s", "p50 us", "p99 us", "p99.9 us");
+
+	bool succeeded = true;
+
+	for (size_t i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); ++i) {
+
+		if (settings.only != NULL && strcmp(settings.only, scenarios[i].name) != 0) {
+			continue;
+		}
+
+		if (!http_bench_run(&scenarios[i], output)) {
+			succeeded = false;
+		}
+	}
+
+	if (output != NULL) {
+		fclose(output);
+	}
+
+	http_server_stop();
+	pthread_join(server_thread, NULL);
+
+	http_server_shutdown();
+	http_bench_remove_files();
+
+	return (succeeded ? 0 : 1);
+}
+
+static struct http_response_t http_bench_handle_hello(struct http_request_t *request, void *context)
+{
+	struct http_response_t response;
+	memset(&response, 0, sizeof(response));
+
+	response.message = HTTP_200_OK;
+	response.content = "Hello, world!\n";
+	response.content_type = "text/plain";
+	response.content_length = strlen(response.content);
+
+	return response;
+}
+
+static struct http_response_t http_bench_handle_request(struct http_request_t *request, void *context)
+{
+	struct http_response_t response;
+	memset(&response, 0, sizeof(response));
+
+	response.message = HTTP_404_NOT_FOUND;
+	response.content = "Not found\n";
+	response.content_type = "text/plain";
+	response.content_length = strlen(response.content);
+
+	return response;
+}
+
+static bool http_bench_parse_arguments(int argc, char *argv[])
+{
+	for (int i = 1; i < argc; ++i) {
+
+		if (strcmp(argv[i], "--port") == 0 && i + 1 < argc) {
+			settings.port = (uint16_t)atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--connections") == 0 && i + 1 < argc) {
+			settings.connections = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--duration") == 0 && i + 1 < argc) {
+			settings.duration = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--worker-threads") == 0 && i + 1 < argc) {
+			settings.worker_threads = (uint16_t)atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--io-uring") == 0) {
+			settings.io_uring = true;
+		}
+		else if (strcmp(argv[i], "--scenario") == 0 && i + 1 < argc) {
+			settings.only = argv[++i];
+		}
+		else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc) {
+			settings.output = argv[++i];
+		}
+		else {
+			return false;
+		}
+	}
+
+	return (settings.port != 0 && settings.connections > 0 && settings.duration > 0);
+}
+
+static bool http_bench_create_files(void)
+{
+	if (mkdtemp(directory) == NULL) {
+		directory[0] = 0;
+		return false;
+	}
+
+	char buffer[HTTP_BENCH_BUFFER_SIZE];
+	memset(buffer, 'x', sizeof(buffer));
+
+	for (size_t i = 0; i < sizeof(files) / sizeof(files[0]); ++i) {
+
+		char path[256];
+		snprintf(path, sizeof(path), "%s/%s", directory, files[i].name);
+
+		int file = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+		if (file < 0) {
+			return false;
+		}
+
+		for (size_t written = 0; written < files[i].size;) {
+
+			size_t length = files[i].size - written;
+
+			if (length > sizeof(buffer)) {
+				length = sizeof(buffer);
+			}
+
+			ssize_t result = write(file, buffer, length);
+
+			if (result <= 0) {
+				close(file);
+				return false;
+			}
+
+			written += (size_t)result;
+		}
+
+		close(file);
+	}
+
+	return true;
+}
+
+static void http_bench_remove_files(void)
+{
+	if (directory[0] == 0) {
+		return;
+	}
+
+	for (size_t i = 0; i < sizeof(files) / sizeof(files[0]); ++i) {
+
+		char path[256];
+		snprintf(path, sizeof(path), "%s/%s", directory, files[i].name);
+
+		unlink(path);
+	}
+
+	rmdir(directory);
+}
+
+static void *http_bench_serve(void *arg)
+{
+	http_server_run();
+	return NULL;
+}
+
+static bool http_bench_run(const struct http_bench_scenario_t *scenario, FILE *output)
+{
+	struct http_bench_client_t *clients = calloc((size_t)settings.connections, sizeof(*clients));
+
+	if (clients == NULL) {
+		return false;
+	}
+
+	__atomic_store_n(&running, true, __ATOMIC_RELAXED);
+
+	int started = 0;
+	uint64_t start = http_bench_get_time();
+
+	for (; started < settings.connections; ++started) {
+
+		clients[started].scenario = scenario;
+		clients[started].socket = -1;
+
+		if (pthread_create(&clients[started].thread, NULL, http_bench_client_thread, &clients[started]) != 0) {
+			break;
+		}
+	}
+
+	// Let the clients send requests for a while. The requests which are in progress when the time is up
+	// are still finished and counted.
+	sleep((unsigned int)settings.duration);
+	__atomic_store_n(&running, false, __ATOMIC_RELAXED);
+
+	for (int i = 0; i < started; ++i) {
+		pthread_join(clients[i].thread, NULL);
+	}
+
+	double elapsed = (double)(http_bench_get_time() - start) / 1e9;
+
+	// Merge the results of the clients.
+	struct http_bench_results_t total;
+	memset(&total, 0, sizeof(total));
+
+	for (int i = 0; i < started; ++i) {
+
+		struct http_bench_results_t *results = &clients[i].results;
+
+		for (size_t j = 0; j < results->latencies_len; ++j) {
+			http_bench_add_latency(&total, results->latencies[j]);
+		}
+
+		total.bytes += results->bytes;
+		total.errors += results->errors;
+
+		free(results->latencies);
+	}
+
+	free(clients);
+
+	qsort(total.latencies, total.latencies_len, sizeof(*total.latencies), http_bench_compare);
+
+	double requests_per_second = (double)total.latencies_len / elapsed;
+	double megabytes_per_second = (double)total.bytes / elapsed / (1024 * 1024);
+	double p50 = http_bench_percentile(total.latencies, total.latencies_len, 0.5);
+	double p99 = http_bench_percentile(total.latencies, total.latencies_len, 0.99);
+	double p999 = http_bench_percentile(total.latencies, total.latencies_len, 0.999);
+
+	printf("%-12s %10zu %8llu %12.0f %10.1f %10.1f %10.1f %10.1f\n", scenario->name, total.latencies_len,
+		(unsigned long long)total.errors, requests_per_second, megabytes_per_second, p50, p99, p999);
+
+	if (output != NULL) {
+
+		fprintf(output, "{\"scenario\":\"%s\",\"connections\":%d,\"worker_threads\":%u,\"io_uring\":%s,\"seconds\":%.3f,"
+			"\"requests\":%zu,\"errors\":%llu,\"requests_per_second\":%.1f,\"megabytes_per_second\":%.2f,"
+			"\"p50_us\":%.1f,\"p99_us\":%.1f,\"p999_us\":%.1f}\n",
+			scenario->name, started, settings.worker_threads, (settings.io_uring ? "true" : "false"), elapsed,
+			total.latencies_len, (unsigned long long)total.errors, requests_per_second, megabytes_per_second,
+			p50, p99, p999);
+
+		fflush(output);
+	}
+
+	free(total.latencies);
+
+	return (started == settings.connections && total.errors == 0 && total.latencies_len > 0);
+}
+
+static void *http_bench_client_thread(void *arg)
+{
+	struct http_bench_client_t *client = arg;
+	const struct http_bench_scenario_t *scenario = client->scenario;
+
+	// Build the requests which are sent at once.
+	char request[256];
+	int request_len = snprintf(request, sizeof(request), "GET %s HTTP/1.1\r\nHost: 127.0.0.1\r\n%s\r\n",
+		scenario->path, (scenario->keep_alive ? "" : "Connection: close\r\n"));
+
+	size_t requests_len = (size_t)request_len * (size_t)scenario->pipeline;
+	char *requests = malloc(requests_len);
+
+	if (requests == NULL) {
+		client->results.errors++;
+		return NULL;
+	}
+
+	for (int i = 0; i < scenario->pipeline; ++i) {
+		memcpy(&requests[i * request_len], request, (size_t)request_len);
+	}
+
+	while (__atomic_load_n(&running, __ATOMIC_RELAXED)) {
+
+		if (client->socket < 0 && !http_bench_connect(client)) {
+			client->results.errors++;
+			continue;
+		}
+
+		uint64_t sent = http_bench_get_time();
+
+		if (!http_bench_send(client, requests, requests_len)) {
+			client->results.errors++;
+			http_bench_disconnect(client);
+			continue;
+		}
+
+		// The latency of a pipelined request includes the time spent waiting for the responses before it.
+		for (int i = 0; i < scenario->pipeline; ++i) {
+
+			if (!http_bench_read_response(client)) {
+				client->results.errors++;
+				http_bench_disconnect(client);
+				break;
+			}
+
+			http_bench_add_latency(&client->results, http_bench_get_time() - sent);
+		}
+
+		if (!scenario->keep_alive) {
+			http_bench_disconnect(client);
+		}
+	}
+
+	http_bench_disconnect(client);
+	free(requests);
+
+	return NULL;
+}
+
+static bool http_bench_connect(struct http_bench_client_t *client)
+{
+	client->socket = socket(AF_INET, SOCK_STREAM, 0);
+	client->buffer_len = 0;
+
+	if (client->socket < 0) {
+		return false;
+	}
+
+	int opt = 1;
+	setsockopt(client->socket, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+
+	struct sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(settings.port);
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	if (connect(client->socket, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+		http_bench_disconnect(client);
+		return false;
+	}
+
+	return true;
+}
+
+static void http_bench_disconnect(struct http_bench_client_t *client)
+{
+	if (client->socket >= 0) {
+		close(client->socket);
+	}
+
+	client->socket = -1;
+	client->buffer_len = 0;
+}
+
+static bool http_bench_send(struct http_bench_client_t *client, const char *data, size_t length)
+{
+	while (length > 0) {
+
+		ssize_t sent = send(client->socket, data, length, MSG_NOSIGNAL);
+
+		if (sent < 0 && errno == EINTR) {
+			continue;
+		}
+
+		if (sent <= 0) {
+			return false;
+		}
+
+		data += sent;
+		length -= (size_t)sent;
+	}
+
+	return true;
+}
+
+static bool http_bench_read_response(struct http_bench_client_t *client)
+{
+	// Receive until the whole header is in the buffer.
+	char *header_end;
+
+	for (;;) {
+
+		client->buffer[client->buffer_len] = 0;
+		header_end = strstr(client->buffer, "\r\n\r\n");
+
+		if (header_end != NULL) {
+			break;
+		}
+
+		if (client->buffer_len >= sizeof(client->buffer) - 1) {
+			return false;
+		}
+
+		ssize_t received = recv(client->socket, &client->buffer[client->buffer_len], sizeof(client->buffer) - 1 - client->buffer_len, 0);
+
+		if (received < 0 && errno == EINTR) {
+			continue;
+		}
+
+		if (received <= 0) {
+			return false;
+		}
+
+		client->buffer_len += (size_t)received;
+	}
+
+	size_t header_len = (size_t)(header_end - client->buffer) + 4;
+
+	if (strncmp(client->buffer, "HTTP/1.1 200 ", 13) != 0) {
+		return false;
+	}
+
+	// Every response the server sends in the scenarios has a known length.
+	const char *length_header = NULL;
+
+	for (const char *line = strstr(client->buffer, "\r\n"); line != NULL && line < header_end; line = strstr(line + 2, "\r\n")) {
+
+		if (strncasecmp(line + 2, "Content-Length:", 15) == 0) {
+			length_header = line + 17;
+			break;
+		}
+	}
+
+	if (length_header == NULL) {
+		return false;
+	}
+
+	uint64_t remaining = strtoull(length_header, NULL, 10);
+
+	client->results.bytes += header_len + remaining;
+
+	// Skip the body, and keep whatever follows it for the next response.
+	size_t buffered = client->buffer_len - header_len;
+
+	if (remaining <= buffered) {
+
+		memmove(client->buffer, &client->buffer[header_len + remaining], buffered - remaining);
+		client->buffer_len = buffered - (size_t)remaining;
+
+		return true;
+	}
+
+	remaining -= buffered;
+	client->buffer_len = 0;
+
+	while (remaining > 0) {
+
+		ssize_t received = recv(client->socket, client->buffer, sizeof(client->buffer) - 1, 0);
+
+		if (received < 0 && errno == EINTR) {
+			continue;
+		}
+
+		if (received <= 0) {
+			return false;
+		}
+
+		if ((uint64_t)received > remaining) {
+
+			memmove(client->buffer, &client->buffer[remaining], (size_t)received - remaining);
+			client->buffer_len = (size_t)received - remaining;
+
+			break;
+		}
+
+		remaining -= (uint64_t)received;
+	}
+
+	return true;
+}
+
+static void http_bench_add_latency(struct http_bench_results_t *results, uint64_t latency)
+{
+	if (results->latencies_len >= results->latencies_size) {
+
+		size_t size = (results->latencies_size != 0 ? results->latencies_size * 2 : 4096);
+		uint64_t *latencies = realloc(results->latencies, size * sizeof(*latencies));
+
+		if (latencies == NULL) {
+			results->errors++;
+			return;
+		}
+
+		results->latencies = latencies;
+		results->latencies_size = size;
+	}
+
+	results->latencies[results->latencies_len++] = latency;
+}
+
+static uint64_t http_bench_get_time(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (uint64_t)now.tv_sec * 1000000000ull + (uint64_t)now.tv_nsec;
+}
+
+static int http_bench_compare(const void *a, const void *b)
+{
+	uint64_t first = *(const uint64_t *)a;
+	uint64_t second = *(const uint64_t *)b;
+
+	return (first > second) - (first < second);
+}
+
+static double http_bench_percentile(const uint64_t *latencies, size_t count, double percentile)
+{
+	if (count == 0) {
+		return 0;
+	}
+
+	// Nearest rank, in microseconds.
+	size_t rank = (size_t)(percentile * (double)count + 0.999999);
+
+	if (rank < 1) {
+		rank = 1;
+	}
+	else if (rank > count) {
+		rank = count;
+	}
+
+	return (double)latencies[rank - 1] / 1000;
+}
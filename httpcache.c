@@ -0,0 +1,272 @@
+#include "httpcache.h"
+#include <string.h>
+#include <stdlib.h>
+
+#define HTTP_CACHE_INITIAL_BUCKETS 64
+
+// --------------------------------------------------------------------------------
+
+static uint32_t http_cache_hash(const char *key);
+static bool http_cache_grow(struct http_cache_t *cache);
+static void http_cache_remove(struct http_cache_t *cache, struct http_cache_entry_t *entry);
+static void http_cache_unlink(struct http_cache_t *cache, struct http_cache_entry_t *entry);
+static void http_cache_link(struct http_cache_t *cache, struct http_cache_entry_t *entry);
+static void http_cache_free(struct http_cache_entry_t *entry);
+
+// --------------------------------------------------------------------------------
+
+bool http_cache_create(struct http_cache_t *cache, size_t max_size)
+{
+	memset(cache, 0, sizeof(*cache));
+
+	cache->buckets = calloc(HTTP_CACHE_INITIAL_BUCKETS, sizeof(*cache->buckets));
+
+	if (cache->buckets == NULL) {
+		return false;
+	}
+
+	cache->buckets_len = HTTP_CACHE_INITIAL_BUCKETS;
+	cache->max_size = max_size;
+
+	return true;
+}
+
+void http_cache_destroy(struct http_cache_t *cache)
+{
+	while (cache->oldest != NULL) {
+		http_cache_remove(cache, cache->oldest);
+	}
+
+	free(cache->buckets);
+	memset(cache, 0, sizeof(*cache));
+}
+
+struct http_cache_entry_t *http_cache_find(struct http_cache_t *cache, const char *key, time_t now)
+{
+	if (cache->buckets == NULL) {
+		return NULL;
+	}
+
+	uint32_t hash = http_cache_hash(key);
+	struct http_cache_entry_t *entry = cache->buckets[hash & (cache->buckets_len - 1)];
+
+	while (entry != NULL && (entry->hash != hash || strcmp(entry->key, key) != 0)) {
+		entry = entry->next_in_bucket;
+	}
+
+	if (entry == NULL) {
+		return NULL;
+	}
+
+	// Make sure the file hasn't been modified or removed since it was cached.
+	if (entry->checked != now) {
+
+		struct stat info;
+
+		if (stat(entry->path, &info) != 0 ||
+			info.st_mtime != entry->modified ||
+			info.st_size != entry->file_size) {
+
+			http_cache_remove(cache, entry);
+			return NULL;
+		}
+
+		entry->checked = now;
+	}
+
+	// Mark the entry as the most recently used one.
+	http_cache_unlink(cache, entry);
+	http_cache_link(cache, entry);
+
+	return entry;
+}
+
+struct http_cache_entry_t *http_cache_insert(struct http_cache_t *cache, const char *key, const char *path,
+	char *header, size_t header_len, char *data, size_t size, const struct stat *info, time_t now)
+{
+	struct http_cache_entry_t *entry = NULL;
+
+	// The file doesn't fit into the cache at all.
+	if (cache->buckets == NULL || size > cache->max_size) {
+		goto failure;
+	}
+
+	if (cache->entries_len >= cache->buckets_len && !http_cache_grow(cache)) {
+		goto failure;
+	}
+
+	entry = calloc(1, sizeof(*entry));
+
+	if (entry == NULL) {
+		goto failure;
+	}
+
+	entry->key = strdup(key);
+	entry->path = strdup(path);
+
+	if (entry->key == NULL || entry->path == NULL) {
+		goto failure;
+	}
+
+	// Evict the least recently used files until there is room for the new one.
+	while (cache->oldest != NULL && cache->size + size > cache->max_size) {
+		http_cache_remove(cache, cache->oldest);
+	}
+
+	entry->hash = http_cache_hash(key);
+	entry->header = header;
+	entry->header_len = header_len;
+	entry->data = data;
+	entry->size = size;
+	entry->modified = info->st_mtime;
+	entry->file_size = info->st_size;
+	entry->checked = now;
+
+	size_t bucket = entry->hash & (cache->buckets_len - 1);
+	entry->next_in_bucket = cache->buckets[bucket];
+	cache->buckets[bucket] = entry;
+
+	cache->entries_len++;
+	cache->size += size;
+
+	http_cache_link(cache, entry);
+
+	return entry;
+
+failure:
+	if (entry != NULL) {
+		free(entry->key);
+		free(entry->path);
+		free(entry);
+	}
+
+	free(header);
+	free(data);
+
+	return NULL;
+}
+
+void http_cache_acquire(struct http_cache_entry_t *entry)
+{
+	entry->references++;
+}
+
+void http_cache_release(struct http_cache_entry_t *entry)
+{
+	// Entries which were evicted while they were in use are freed by the last user.
+	if (--entry->references == 0 && entry->evicted) {
+		http_cache_free(entry);
+	}
+}
+
+static uint32_t http_cache_hash(const char *key)
+{
+	// FNV-1a
+	uint32_t hash = 2166136261u;
+
+	for (const unsigned char *c = (const unsigned char *)key; *c != 0; ++c) {
+		hash ^= *c;
+		hash *= 16777619u;
+	}
+
+	return hash;
+}
+
+static bool http_cache_grow(struct http_cache_t *cache)
+{
+	size_t buckets_len = 2 * cache->buckets_len;
+	struct http_cache_entry_t **buckets = calloc(buckets_len, sizeof(*buckets));
+
+	if (buckets == NULL) {
+		return false;
+	}
+
+	// Move the entries to the new buckets.
+	for (size_t i = 0; i < cache->buckets_len; ++i) {
+
+		for (struct http_cache_entry_t *entry = cache->buckets[i], *next; entry != NULL; entry = next) {
+
+			next = entry->next_in_bucket;
+
+			size_t bucket = entry->hash & (buckets_len - 1);
+			entry->next_in_bucket = buckets[bucket];
+			buckets[bucket] = entry;
+		}
+	}
+
+	free(cache->buckets);
+
+	cache->buckets = buckets;
+	cache->buckets_len = buckets_len;
+
+	return true;
+}
+
+static void http_cache_remove(struct http_cache_t *cache, struct http_cache_entry_t *entry)
+{
+	// Remove the entry from its bucket.
+	struct http_cache_entry_t **link = &cache->buckets[entry->hash & (cache->buckets_len - 1)];
+
+	while (*link != entry) {
+		link = &(*link)->next_in_bucket;
+	}
+
+	*link = entry->next_in_bucket;
+
+	http_cache_unlink(cache, entry);
+
+	cache->entries_len--;
+	cache->size -= entry->size;
+
+	// If the data is still being sent, the entry is freed once it has been.
+	if (entry->references > 0) {
+		entry->evicted = true;
+	}
+	else {
+		http_cache_free(entry);
+	}
+}
+
+static void http_cache_unlink(struct http_cache_t *cache, struct http_cache_entry_t *entry)
+{
+	if (entry->newer != NULL) {
+		entry->newer->older = entry->older;
+	}
+	else {
+		cache->newest = entry->older;
+	}
+
+	if (entry->older != NULL) {
+		entry->older->newer = entry->newer;
+	}
+	else {
+		cache->oldest = entry->newer;
+	}
+
+	entry->newer = NULL;
+	entry->older = NULL;
+}
+
+static void http_cache_link(struct http_cache_t *cache, struct http_cache_entry_t *entry)
+{
+	entry->older = cache->newest;
+	entry->newer = NULL;
+
+	if (cache->newest != NULL) {
+		cache->newest->newer = entry;
+	}
+	else {
+		cache->oldest = entry;
+	}
+
+	cache->newest = entry;
+}
+
+static void http_cache_free(struct http_cache_entry_t *entry)
+{
+	free(entry->key);
+	free(entry->path);
+	free(entry->header);
+	free(entry->data);
+	free(entry);
+}
@@ -0,0 +1,71 @@
+#pragma once
+#ifndef __HTTPCACHE_H
+#define __HTTPCACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+// --------------------------------------------------------------------------------
+
+// A cached static file along with its serialized response header.
+struct http_cache_entry_t {
+	char *key;						// Requested URL path
+	char *path;						// Path of the file in the file system
+	uint32_t hash;
+
+	char *header;					// Response header, excluding the connection specific lines
+	size_t header_len;
+	char *data;						// Contents of the file
+	size_t size;
+	const char *content_type;		// MIME type of the file, set by the user of the cache
+	const char *content_encoding;	// Content coding of the data (e.g. gzip), NULL if uncompressed
+
+	time_t modified;				// Modification time and size of the file when it was cached,
+	off_t file_size;				// used to detect when the entry has gone stale
+	time_t checked;					// Last time the file was checked for modifications
+
+	unsigned int references;		// Number of responses currently sending the data
+	bool evicted;					// The entry has been removed from the cache but is still being sent
+
+	struct http_cache_entry_t *next_in_bucket;
+	struct http_cache_entry_t *newer;
+	struct http_cache_entry_t *older;
+};
+
+// A least recently used cache bounded by the total size of the cached files.
+// The cache is not thread safe, each event loop has its own.
+struct http_cache_t {
+	struct http_cache_entry_t **buckets;
+	size_t buckets_len;
+	size_t entries_len;
+
+	struct http_cache_entry_t *newest;
+	struct http_cache_entry_t *oldest;
+
+	size_t size;					// Total size of the cached data
+	size_t max_size;				// Maximum size of the cached data
+};
+
+// --------------------------------------------------------------------------------
+
+bool http_cache_create(struct http_cache_t *cache, size_t max_size);
+void http_cache_destroy(struct http_cache_t *cache);
+
+// Finds a cached file by the requested URL path. The file is checked for modifications at most once a second,
+// a modified file is removed from the cache.
+struct http_cache_entry_t *http_cache_find(struct http_cache_t *cache, const char *key, time_t now);
+
+// Adds a file to the cache, evicting the least recently used files to make room for it. The cache takes
+// ownership of the header and the data, which are freed if the file can't be cached.
+struct http_cache_entry_t *http_cache_insert(struct http_cache_t *cache, const char *key, const char *path,
+	char *header, size_t header_len, char *data, size_t size, const struct stat *info, time_t now);
+
+// Keeps an entry alive while its data is being sent, even if the entry is evicted meanwhile.
+void http_cache_acquire(struct http_cache_entry_t *entry);
+void http_cache_release(struct http_cache_entry_t *entry);
+
+#endif
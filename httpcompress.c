@@ -0,0 +1,66 @@
+#include "httpcompress.h"
+#include <string.h>
+#include <strings.h>
+#include <stdlib.h>
+#include <zlib.h>
+
+bool http_compress_gzip(const char *data, size_t length, char **output, size_t *output_len)
+{
+	z_stream stream;
+	memset(&stream, 0, sizeof(stream));
+
+	// Window bits of 15 + 16 produce a gzip header and trailer instead of a zlib one.
+	if (deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+		return false;
+	}
+
+	size_t size = deflateBound(&stream, (uLong)length);
+	char *buffer = malloc(size);
+
+	if (buffer == NULL) {
+		deflateEnd(&stream);
+		return false;
+	}
+
+	stream.next_in = (Bytef *)data;
+	stream.avail_in = (uInt)length;
+	stream.next_out = (Bytef *)buffer;
+	stream.avail_out = (uInt)size;
+
+	// The output buffer is large enough for the entire result, so a single call finishes the stream.
+	if (deflate(&stream, Z_FINISH) != Z_STREAM_END) {
+		deflateEnd(&stream);
+		free(buffer);
+		return false;
+	}
+
+	*output = buffer;
+	*output_len = stream.total_out;
+
+	deflateEnd(&stream);
+	return true;
+}
+
+bool http_compress_is_compressible(const char *content_type)
+{
+	if (content_type == NULL) {
+		return false;
+	}
+
+	static const char *types[] = {
+		"text/",
+		"application/javascript",
+		"application/json",
+		"application/xml",
+		"image/svg+xml",
+	};
+
+	for (size_t i = 0; i < sizeof(types) / sizeof(types[0]); ++i) {
+
+		if (strncasecmp(content_type, types[i], strlen(types[i])) == 0) {
+			return true;
+		}
+	}
+
+	return false;
+}
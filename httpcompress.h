@@ -0,0 +1,15 @@
+#pragma once
+#ifndef __HTTPCOMPRESS_H
+#define __HTTPCOMPRESS_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+// Compresses data into the gzip format. On success the compressed data is returned in a buffer
+// allocated with malloc, which the caller has to free.
+bool http_compress_gzip(const char *data, size_t length, char **output, size_t *output_len);
+
+// Checks whether content of the given MIME type is worth compressing (text, scripts, SVG images etc.).
+bool http_compress_is_compressible(const char *content_type);
+
+#endif
@@ -0,0 +1,687 @@
+#include "httpindex.h"
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <unistd.h>
+#endif
+
+#define HTTP_INDEX_PATH_SIZE 4096
+#define HTTP_INDEX_INITIAL_BUCKETS 256
+#define HTTP_INDEX_EVENT_BUFFER_SIZE 4096
+
+#ifdef __linux__
+
+#define HTTP_INDEX_WATCH_MASK (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR)
+
+// --------------------------------------------------------------------------------
+
+static void http_index_scan(struct http_index_t *index, uint32_t directory, const char *relative);
+static void http_index_add_path(struct http_index_t *index, uint32_t directory, const char *relative);
+static void http_index_set_file(struct http_index_t *index, uint32_t directory, const char *relative, bool exists);
+static void http_index_set(struct http_index_t *index, uint32_t directory, const char *path, size_t length, uint32_t variant, bool exists);
+static void http_index_remove_tree(struct http_index_t *index, uint32_t directory, const char *relative);
+static void http_index_handle_event(struct http_index_t *index, const struct inotify_event *event, bool *overflowed);
+static void http_index_rebuild(struct http_index_t *index);
+static void http_index_clear(struct http_index_t *index);
+static bool http_index_grow(struct http_index_t *index);
+static bool http_index_add_watch(struct http_index_t *index, int descriptor, uint32_t directory, const char *relative);
+static struct http_index_watch_t *http_index_find_watch(struct http_index_t *index, int descriptor);
+static void http_index_remove_watch(struct http_index_t *index, struct http_index_watch_t *watch);
+static bool http_index_get_full_path(const struct http_index_t *index, uint32_t directory, const char *relative, char *buffer, size_t size);
+static bool http_index_join(char *buffer, size_t size, const char *parent, const char *name);
+static size_t http_index_normalize(const char *path, char *buffer, size_t size);
+static uint64_t http_index_hash(uint32_t directory, const char *path, size_t length);
+
+// --------------------------------------------------------------------------------
+
+bool http_index_create(struct http_index_t *index)
+{
+	memset(index, 0, sizeof(*index));
+
+	index->buckets = calloc(HTTP_INDEX_INITIAL_BUCKETS, sizeof(*index->buckets));
+
+	if (index->buckets == NULL) {
+		index->fd = -1;
+		return false;
+	}
+
+	index->buckets_len = HTTP_INDEX_INITIAL_BUCKETS;
+
+	// Without inotify the index couldn't be kept up to date, so nothing is indexed.
+	index->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+
+	return true;
+}
+
+void http_index_destroy(struct http_index_t *index)
+{
+	http_index_clear(index);
+
+	for (size_t i = 0; i < index->directories_len; ++i) {
+		free(index->directories[i].root);
+	}
+
+	if (index->fd >= 0) {
+		close(index->fd);
+	}
+
+	free(index->buckets);
+	free(index->watches);
+	free(index->directories);
+
+	memset(index, 0, sizeof(*index));
+	index->fd = -1;
+}
+
+void http_index_add_directory(struct http_index_t *index, uint32_t directory, const char *root)
+{
+	// An empty root would make the paths absolute, so such a directory isn't indexed.
+	if (index->fd < 0 || *root == 0) {
+		return;
+	}
+
+	if (directory >= index->directories_len) {
+
+		struct http_index_directory_t *directories = realloc(index->directories, (directory + 1) * sizeof(*directories));
+
+		if (directories == NULL) {
+			return;
+		}
+
+		memset(&directories[index->directories_len], 0, (directory + 1 - index->directories_len) * sizeof(*directories));
+
+		index->directories = directories;
+		index->directories_len = directory + 1;
+	}
+
+	struct http_index_directory_t *dir = &index->directories[directory];
+
+	dir->root = malloc(strlen(root) + 1);
+
+	if (dir->root == NULL) {
+		return;
+	}
+
+	strcpy(dir->root, root);
+	dir->complete = true;
+
+	http_index_scan(index, directory, "");
+}
+
+int http_index_get_fd(const struct http_index_t *index)
+{
+	return index->fd;
+}
+
+void http_index_update(struct http_index_t *index)
+{
+	if (index->fd < 0) {
+		return;
+	}
+
+	char buffer[HTTP_INDEX_EVENT_BUFFER_SIZE] __attribute__((aligned(__alignof__(struct inotify_event))));
+	bool overflowed = false;
+
+	// Read until there are no more events, the descriptor is only reported again once new events arrive.
+	for (;;) {
+
+		ssize_t length = read(index->fd, buffer, sizeof(buffer));
+
+		if (length <= 0) {
+			break;
+		}
+
+		for (char *position = buffer; position < &buffer[length]; ) {
+
+			const struct inotify_event *event = (const struct inotify_event *)position;
+			http_index_handle_event(index, event, &overflowed);
+
+			position += sizeof(*event) + event->len;
+		}
+	}
+
+	// Some of the changes were lost, so the directories have to be scanned again.
+	if (overflowed) {
+		http_index_rebuild(index);
+	}
+}
+
+uint32_t http_index_find(const struct http_index_t *index, uint32_t directory, const char *path)
+{
+	if (directory >= index->directories_len || !index->directories[directory].complete) {
+		return HTTP_INDEX_ALL;
+	}
+
+	char buffer[HTTP_INDEX_PATH_SIZE];
+	size_t length = http_index_normalize(path, buffer, sizeof(buffer));
+
+	if (length == SIZE_MAX) {
+		return HTTP_INDEX_ALL;
+	}
+
+	uint64_t hash = http_index_hash(directory, buffer, length);
+
+	for (const struct http_index_entry_t *entry = index->buckets[hash & (index->buckets_len - 1)]; entry != NULL; entry = entry->next) {
+
+		if (entry->hash == hash && entry->directory == directory && strcmp(entry->path, buffer) == 0) {
+			return entry->variants;
+		}
+	}
+
+	return 0;
+}
+
+static void http_index_scan(struct http_index_t *index, uint32_t directory, const char *relative)
+{
+	struct http_index_directory_t *dir = &index->directories[directory];
+
+	char path[HTTP_INDEX_PATH_SIZE];
+
+	if (!http_index_get_full_path(index, directory, relative, path, sizeof(path))) {
+		dir->complete = false;
+		return;
+	}
+
+	// Watch the directory before reading it, so the files created in between aren't missed.
+	int descriptor = inotify_add_watch(index->fd, path, HTTP_INDEX_WATCH_MASK);
+
+	if (descriptor < 0 || !http_index_add_watch(index, descriptor, directory, relative)) {
+		dir->complete = false;
+		return;
+	}
+
+	DIR *handle = opendir(path);
+
+	if (handle == NULL) {
+		dir->complete = false;
+		return;
+	}
+
+	for (struct dirent *entry; dir->complete && (entry = readdir(handle)) != NULL; ) {
+
+		if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+			continue;
+		}
+
+		char child[HTTP_INDEX_PATH_SIZE];
+
+		if (!http_index_join(child, sizeof(child), relative, entry->d_name)) {
+			dir->complete = false;
+			break;
+		}
+
+		if (entry->d_type == DT_DIR) {
+			http_index_scan(index, directory, child);
+		}
+		else {
+			http_index_add_path(index, directory, child);
+		}
+	}
+
+	closedir(handle);
+}
+
+static void http_index_add_path(struct http_index_t *index, uint32_t directory, const char *relative)
+{
+	struct http_index_directory_t *dir = &index->directories[directory];
+
+	char path[HTTP_INDEX_PATH_SIZE];
+	struct stat info;
+
+	// The file may already be gone again.
+	if (!http_index_get_full_path(index, directory, relative, path, sizeof(path)) || stat(path, &info) != 0) {
+		return;
+	}
+
+	// Links are followed when the files are served, so a link to a file is indexed like the file.
+	if (S_ISREG(info.st_mode)) {
+		http_index_set_file(index, directory, relative, true);
+		return;
+	}
+
+	if (!S_ISDIR(info.st_mode)) {
+		return;
+	}
+
+	// Links to directories aren't followed, as the changes behind them couldn't be watched.
+	if (lstat(path, &info) == 0 && S_ISDIR(info.st_mode)) {
+		http_index_scan(index, directory, relative);
+	}
+	else {
+		dir->complete = false;
+	}
+}
+
+static void http_index_set_file(struct http_index_t *index, uint32_t directory, const char *relative, bool exists)
+{
+	size_t length = strlen(relative);
+
+	http_index_set(index, directory, relative, length, HTTP_INDEX_PLAIN, exists);
+
+	// A precompressed file is also a variant of the file without the suffix.
+	if (length > 3 && strcmp(&relative[length - 3], ".gz") == 0) {
+		http_index_set(index, directory, relative, length - 3, HTTP_INDEX_GZIP, exists);
+	}
+	else if (length > 3 && strcmp(&relative[length - 3], ".br") == 0) {
+		http_index_set(index, directory, relative, length - 3, HTTP_INDEX_BROTLI, exists);
+	}
+}
+
+static void http_index_set(struct http_index_t *index, uint32_t directory, const char *path, size_t length, uint32_t variant, bool exists)
+{
+	uint64_t hash = http_index_hash(directory, path, length);
+
+	struct http_index_entry_t **link = &index->buckets[hash & (index->buckets_len - 1)];
+
+	for (; *link != NULL; link = &(*link)->next) {
+
+		struct http_index_entry_t *entry = *link;
+
+		if (entry->hash != hash || entry->directory != directory || strncmp(entry->path, path, length) != 0 || entry->path[length] != 0) {
+			continue;
+		}
+
+		if (exists) {
+			entry->variants |= variant;
+			return;
+		}
+
+		entry->variants &= ~variant;
+
+		// Remove the entry once none of its variants exist.
+		if (entry->variants == 0) {
+
+			*link = entry->next;
+			free(entry);
+
+			index->entries_len--;
+		}
+
+		return;
+	}
+
+	if (!exists) {
+		return;
+	}
+
+	// The directory is left out of the index rather than letting the index grow without bounds.
+	if (index->entries_len >= HTTP_INDEX_MAX_FILES) {
+		index->directories[directory].complete = false;
+		return;
+	}
+
+	struct http_index_entry_t *entry = malloc(sizeof(*entry) + length + 1);
+
+	if (entry == NULL) {
+		index->directories[directory].complete = false;
+		return;
+	}
+
+	entry->hash = hash;
+	entry->directory = directory;
+	entry->variants = variant;
+
+	memcpy(entry->path, path, length);
+	entry->path[length] = 0;
+
+	entry->next = *link;
+	*link = entry;
+
+	index->entries_len++;
+
+	if (index->entries_len > index->buckets_len && !http_index_grow(index)) {
+		index->directories[directory].complete = false;
+	}
+}
+
+static void http_index_remove_tree(struct http_index_t *index, uint32_t directory, const char *relative)
+{
+	size_t length = strlen(relative);
+
+	// Directories are rarely removed, so every entry is checked.
+	for (size_t i = 0; i < index->buckets_len; ++i) {
+
+		for (struct http_index_entry_t **link = &index->buckets[i]; *link != NULL; ) {
+
+			struct http_index_entry_t *entry = *link;
+
+			if (entry->directory == directory && strncmp(entry->path, relative, length) == 0 && entry->path[length] == '/') {
+
+				*link = entry->next;
+				free(entry);
+
+				index->entries_len--;
+				continue;
+			}
+
+			link = &entry->next;
+		}
+	}
+
+	// Stop watching the directory and the ones inside it. A directory moved elsewhere would still be watched.
+	for (size_t i = 0; i < index->watches_len; ) {
+
+		struct http_index_watch_t *watch = &index->watches[i];
+
+		if (watch->directory == directory && strncmp(watch->path, relative, length) == 0 &&
+			(watch->path[length] == 0 || watch->path[length] == '/')) {
+
+			inotify_rm_watch(index->fd, watch->descriptor);
+			http_index_remove_watch(index, watch);
+
+			continue;
+		}
+
+		++i;
+	}
+}
+
+static void http_index_handle_event(struct http_index_t *index, const struct inotify_event *event, bool *overflowed)
+{
+	if (event->mask & IN_Q_OVERFLOW) {
+		*overflowed = true;
+		return;
+	}
+
+	struct http_index_watch_t *watch = http_index_find_watch(index, event->wd);
+
+	if (watch == NULL) {
+		return;
+	}
+
+	uint32_t directory = watch->directory;
+	bool root = (*watch->path == 0);
+
+	// The watch is gone. If the indexed directory itself was removed, its files are looked for on the filesystem.
+	if (event->mask & IN_IGNORED) {
+
+		http_index_remove_watch(index, watch);
+
+		if (root) {
+			index->directories[directory].complete = false;
+		}
+
+		return;
+	}
+
+	if (event->mask & (IN_DELETE_SELF | IN_MOVE_SELF)) {
+
+		if (root) {
+			index->directories[directory].complete = false;
+		}
+
+		return;
+	}
+
+	if (event->len == 0) {
+		return;
+	}
+
+	char relative[HTTP_INDEX_PATH_SIZE];
+
+	if (!http_index_join(relative, sizeof(relative), watch->path, event->name)) {
+		index->directories[directory].complete = false;
+		return;
+	}
+
+	bool created = ((event->mask & (IN_CREATE | IN_MOVED_TO)) != 0);
+	bool removed = ((event->mask & (IN_DELETE | IN_MOVED_FROM)) != 0);
+
+	if (event->mask & IN_ISDIR) {
+
+		if (created) {
+			http_index_scan(index, directory, relative);
+		}
+		else if (removed) {
+			http_index_remove_tree(index, directory, relative);
+		}
+	}
+	else {
+
+		if (created) {
+			http_index_add_path(index, directory, relative);
+		}
+		else if (removed) {
+			http_index_set_file(index, directory, relative, false);
+		}
+	}
+}
+
+static void http_index_rebuild(struct http_index_t *index)
+{
+	http_index_clear(index);
+
+	for (uint32_t i = 0; i < index->directories_len; ++i) {
+
+		if (index->directories[i].root != NULL) {
+
+			index->directories[i].complete = true;
+			http_index_scan(index, i, "");
+		}
+	}
+}
+
+static void http_index_clear(struct http_index_t *index)
+{
+	for (size_t i = 0; i < index->buckets_len; ++i) {
+
+		for (struct http_index_entry_t *entry = index->buckets[i], *next; entry != NULL; entry = next) {
+			next = entry->next;
+			free(entry);
+		}
+
+		index->buckets[i] = NULL;
+	}
+
+	index->entries_len = 0;
+
+	for (size_t i = 0; i < index->watches_len; ++i) {
+
+		inotify_rm_watch(index->fd, index->watches[i].descriptor);
+		free(index->watches[i].path);
+	}
+
+	index->watches_len = 0;
+}
+
+static bool http_index_grow(struct http_index_t *index)
+{
+	size_t buckets_len = 2 * index->buckets_len;
+	struct http_index_entry_t **buckets = calloc(buckets_len, sizeof(*buckets));
+
+	if (buckets == NULL) {
+		return false;
+	}
+
+	for (size_t i = 0; i < index->buckets_len; ++i) {
+
+		for (struct http_index_entry_t *entry = index->buckets[i], *next; entry != NULL; entry = next) {
+
+			next = entry->next;
+
+			struct http_index_entry_t **bucket = &buckets[entry->hash & (buckets_len - 1)];
+			entry->next = *bucket;
+			*bucket = entry;
+		}
+	}
+
+	free(index->buckets);
+
+	index->buckets = buckets;
+	index->buckets_len = buckets_len;
+
+	return true;
+}
+
+static bool http_index_add_watch(struct http_index_t *index, int descriptor, uint32_t directory, const char *relative)
+{
+	// Watching the same directory again returns the same descriptor, e.g. when a directory is moved within the tree.
+	struct http_index_watch_t *watch = http_index_find_watch(index, descriptor);
+
+	if (watch == NULL) {
+
+		if (index->watches_len == index->watches_size) {
+
+			size_t size = (index->watches_size != 0 ? 2 * index->watches_size : 16);
+			struct http_index_watch_t *watches = realloc(index->watches, size * sizeof(*watches));
+
+			if (watches == NULL) {
+				return false;
+			}
+
+			index->watches = watches;
+			index->watches_size = size;
+		}
+
+		watch = &index->watches[index->watches_len++];
+		watch->descriptor = descriptor;
+		watch->path = NULL;
+	}
+
+	char *path = malloc(strlen(relative) + 1);
+
+	if (path == NULL) {
+		http_index_remove_watch(index, watch);
+		return false;
+	}
+
+	strcpy(path, relative);
+
+	free(watch->path);
+	watch->path = path;
+	watch->directory = directory;
+
+	return true;
+}
+
+static struct http_index_watch_t *http_index_find_watch(struct http_index_t *index, int descriptor)
+{
+	for (size_t i = 0; i < index->watches_len; ++i) {
+
+		if (index->watches[i].descriptor == descriptor) {
+			return &index->watches[i];
+		}
+	}
+
+	return NULL;
+}
+
+static void http_index_remove_watch(struct http_index_t *index, struct http_index_watch_t *watch)
+{
+	free(watch->path);
+
+	// Order of the watches doesn't matter, so move the last watch in place of the removed one.
+	*watch = index->watches[--index->watches_len];
+}
+
+static bool http_index_get_full_path(const struct http_index_t *index, uint32_t directory, const char *relative, char *buffer, size_t size)
+{
+	// The same path the server opens the files with.
+	int length = snprintf(buffer, size, "%s/%s", index->directories[directory].root, relative);
+	return (length >= 0 && (size_t)length < size);
+}
+
+static bool http_index_join(char *buffer, size_t size, const char *parent, const char *name)
+{
+	int length = (*parent != 0 ? snprintf(buffer, size, "%s/%s", parent, name) : snprintf(buffer, size, "%s", name));
+	return (length >= 0 && (size_t)length < size);
+}
+
+static size_t http_index_normalize(const char *path, char *buffer, size_t size)
+{
+	size_t length = 0;
+
+	for (;;) {
+
+		while (*path == '/') {
+			++path;
+		}
+
+		if (*path == 0) {
+			break;
+		}
+
+		const char *end = path;
+
+		while (*end != 0 && *end != '/') {
+			++end;
+		}
+
+		size_t segment = (size_t)(end - path);
+
+		// Skip the segments which refer to the same directory. Parent directories have been refused by the parser.
+		if (segment != 1 || *path != '.') {
+
+			if (length + segment + 1 >= size) {
+				return SIZE_MAX;
+			}
+
+			if (length != 0) {
+				buffer[length++] = '/';
+			}
+
+			memcpy(&buffer[length], path, segment);
+			length += segment;
+		}
+
+		path = end;
+	}
+
+	buffer[length] = 0;
+	return length;
+}
+
+static uint64_t http_index_hash(uint32_t directory, const char *path, size_t length)
+{
+	// FNV-1a, starting from the number of the directory.
+	uint64_t hash = 14695981039346656037ULL ^ directory;
+
+	for (size_t i = 0; i < length; ++i) {
+		hash ^= (unsigned char)path[i];
+		hash *= 1099511628211ULL;
+	}
+
+	return hash;
+}
+
+#else
+
+// --------------------------------------------------------------------------------
+
+bool http_index_create(struct http_index_t *index)
+{
+	memset(index, 0, sizeof(*index));
+	index->fd = -1;
+
+	return true;
+}
+
+void http_index_destroy(struct http_index_t *index)
+{
+}
+
+void http_index_add_directory(struct http_index_t *index, uint32_t directory, const char *root)
+{
+}
+
+int http_index_get_fd(const struct http_index_t *index)
+{
+	return -1;
+}
+
+void http_index_update(struct http_index_t *index)
+{
+}
+
+uint32_t http_index_find(const struct http_index_t *index, uint32_t directory, const char *path)
+{
+	// Without inotify every file has to be looked for on the filesystem.
+	return HTTP_INDEX_ALL;
+}
+
+#endif
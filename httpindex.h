@@ -0,0 +1,80 @@
+#pragma once
+#ifndef __HTTPINDEX_H
+#define __HTTPINDEX_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#define HTTP_INDEX_MAX_FILES 100000		// Files an index holds before the directories which don't fit are left unindexed
+
+// --------------------------------------------------------------------------------
+
+// Variants of a file which exist in a directory.
+enum http_index_variant_t {
+	HTTP_INDEX_PLAIN = 0x1,			// The file itself
+	HTTP_INDEX_GZIP = 0x2,			// A precompressed variant with the .gz suffix
+	HTTP_INDEX_BROTLI = 0x4,		// A precompressed variant with the .br suffix
+	HTTP_INDEX_ALL = 0x7,			// Returned when the index can't tell, so every variant has to be looked for
+};
+
+// A file in the index, by its path relative to the directory.
+struct http_index_entry_t {
+	uint64_t hash;
+	uint32_t directory;
+	uint32_t variants;				// Combination of http_index_variant_t values
+	struct http_index_entry_t *next;
+	char path[];
+};
+
+// A directory watched for changes.
+struct http_index_watch_t {
+	int descriptor;					// inotify watch descriptor
+	uint32_t directory;
+	char *path;						// Path relative to the indexed directory, empty for the directory itself
+};
+
+// An indexed directory.
+struct http_index_directory_t {
+	char *root;						// NULL if the number isn't in use
+	bool complete;					// Whether every file in the directory is in the index
+};
+
+// An in-memory index of the regular files in the static directories, so requests for files which don't exist
+// can be refused without touching the filesystem. The index is kept up to date with inotify, and only says
+// which files exist, so the files are still opened and checked when they're served. A directory which
+// can't be fully indexed, e.g. because it links to other directories or has too many files, is left out
+// and its files are looked for on the filesystem instead. Only supported on Linux. Not thread safe.
+struct http_index_t {
+	int fd;							// inotify instance, -1 if the index isn't supported
+	struct http_index_entry_t **buckets;
+	size_t buckets_len;
+	size_t entries_len;
+	struct http_index_watch_t *watches;
+	size_t watches_len;
+	size_t watches_size;
+	struct http_index_directory_t *directories;
+	size_t directories_len;
+};
+
+// --------------------------------------------------------------------------------
+
+bool http_index_create(struct http_index_t *index);
+void http_index_destroy(struct http_index_t *index);
+
+// Scans a directory into the index and starts watching it for changes. The number identifies the directory
+// in lookups. A directory which can't be indexed is looked for on the filesystem as before.
+void http_index_add_directory(struct http_index_t *index, uint32_t directory, const char *root);
+
+// Returns a descriptor which becomes readable when there are changes to apply with http_index_update.
+// -1 if the index isn't supported.
+int http_index_get_fd(const struct http_index_t *index);
+
+// Applies the changes made to the directories since the last update.
+void http_index_update(struct http_index_t *index);
+
+// Returns the variants of a file which exist, 0 if none do, or HTTP_INDEX_ALL if the directory isn't indexed.
+// The path is relative to the directory. Empty and "." segments in it are ignored, like the filesystem does.
+uint32_t http_index_find(const struct http_index_t *index, uint32_t directory, const char *path);
+
+#endif
@@ -0,0 +1,356 @@
+#include "httplog.h"
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#define HTTP_LOG_BUFFER_SIZE 65536
+#define HTTP_LOG_MAX_LINE 2048			// Longest formatted record, with every byte of the text escaped
+#define HTTP_LOG_MIN_INTERVAL 10		// Milliseconds the thread sleeps when there's nothing to write
+#define HTTP_LOG_MAX_INTERVAL 1000		// Longest sleep, reached when there has been nothing to write for a while
+
+// --------------------------------------------------------------------------------
+
+static void *http_log_thread(void *arg);
+static size_t http_log_write_records(struct http_log_t *log);
+static void http_log_sleep(struct http_log_t *log, long interval);
+static void http_log_format(struct http_log_t *log, const struct http_log_record_t *record);
+static void http_log_append(struct http_log_t *log, const char *text, size_t length);
+static void http_log_append_quoted(struct http_log_t *log, const char *text, size_t length);
+static void http_log_flush(struct http_log_t *log);
+static size_t http_log_copy(char *destination, size_t room, const char *text);
+
+// --------------------------------------------------------------------------------
+
+bool http_log_start(struct http_log_t *log, const char *path, size_t rings_len)
+{
+	memset(log, 0, sizeof(*log));
+
+	if (strcmp(path, "-") == 0) {
+		log->file = STDOUT_FILENO;
+	}
+	else {
+		log->file = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+		log->close_file = true;
+	}
+
+	if (log->file < 0) {
+		return false;
+	}
+
+	log->rings = calloc(rings_len, sizeof(*log->rings));
+	log->rings_len = rings_len;
+	log->buffer = malloc(HTTP_LOG_BUFFER_SIZE);
+
+	pthread_mutex_init(&log->lock, NULL);
+	pthread_cond_init(&log->stopped, NULL);
+
+	bool created = (log->rings != NULL && log->buffer != NULL);
+
+	for (size_t i = 0; created && i < rings_len; ++i) {
+
+		log->rings[i].records = malloc(HTTP_LOG_RING_SIZE * sizeof(struct http_log_record_t));
+		created = (log->rings[i].records != NULL);
+	}
+
+	if (!created || pthread_create(&log->thread, NULL, http_log_thread, log) != 0) {
+
+		for (size_t i = 0; log->rings != NULL && i < rings_len; ++i) {
+			free(log->rings[i].records);
+		}
+
+		if (log->close_file) {
+			close(log->file);
+		}
+
+		free(log->rings);
+		free(log->buffer);
+
+		pthread_cond_destroy(&log->stopped);
+		pthread_mutex_destroy(&log->lock);
+
+		return false;
+	}
+
+	return true;
+}
+
+void http_log_stop(struct http_log_t *log)
+{
+	pthread_mutex_lock(&log->lock);
+	__atomic_store_n(&log->stopping, true, __ATOMIC_RELEASE);
+	pthread_cond_signal(&log->stopped);
+	pthread_mutex_unlock(&log->lock);
+
+	pthread_join(log->thread, NULL);
+
+	for (size_t i = 0; i < log->rings_len; ++i) {
+		free(log->rings[i].records);
+	}
+
+	if (log->close_file) {
+		close(log->file);
+	}
+
+	free(log->rings);
+	free(log->buffer);
+
+	pthread_cond_destroy(&log->stopped);
+	pthread_mutex_destroy(&log->lock);
+
+	memset(log, 0, sizeof(*log));
+}
+
+struct http_log_record_t *http_log_reserve(struct http_log_ring_t *ring)
+{
+	// The acquire pairs with the log thread's release, so the record is no longer being read when it's overwritten.
+	uint64_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+
+	if (ring->head - tail >= HTTP_LOG_RING_SIZE) {
+		return NULL;
+	}
+
+	return &ring->records[ring->head & (HTTP_LOG_RING_SIZE - 1)];
+}
+
+void http_log_push(struct http_log_ring_t *ring)
+{
+	__atomic_store_n(&ring->head, ring->head + 1, __ATOMIC_RELEASE);
+}
+
+void http_log_set_request(struct http_log_record_t *record, const char *method, const char *path, const char *query,
+	const char *protocol, const char *referer, const char *user_agent)
+{
+	char *text = record->text;
+	size_t room = HTTP_LOG_MAX_REQUEST_LINE, length = 0;
+
+	// A request whose request line couldn't be parsed is logged without it.
+	if (method != NULL && path != NULL && protocol != NULL) {
+
+		length += http_log_copy(&text[length], room - length, method);
+		length += http_log_copy(&text[length], room - length, " ");
+		length += http_log_copy(&text[length], room - length, path);
+
+		if (query != NULL) {
+			length += http_log_copy(&text[length], room - length, "?");
+			length += http_log_copy(&text[length], room - length, query);
+		}
+
+		length += http_log_copy(&text[length], room - length, " ");
+		length += http_log_copy(&text[length], room - length, protocol);
+	}
+
+	record->request_line_len = (uint16_t)length;
+	text += length;
+
+	// The user agent gets whatever the referer leaves over.
+	record->referer_len = (uint16_t)http_log_copy(text, HTTP_LOG_MAX_REFERER, referer);
+	text += record->referer_len;
+
+	record->user_agent_len = (uint16_t)http_log_copy(text, (size_t)(&record->text[HTTP_LOG_TEXT_SIZE] - text), user_agent);
+}
+
+static void *http_log_thread(void *arg)
+{
+	struct http_log_t *log = arg;
+	long interval = HTTP_LOG_MIN_INTERVAL;
+
+	for (;;) {
+
+		// Every record pushed before the log was stopped is written before the thread exits.
+		bool stopping = __atomic_load_n(&log->stopping, __ATOMIC_ACQUIRE);
+
+		if (http_log_write_records(log) != 0) {
+			interval = HTTP_LOG_MIN_INTERVAL;
+			continue;
+		}
+
+		if (stopping) {
+			break;
+		}
+
+		// Sleep a while when the rings are empty. The records arriving in the meantime are written in one batch.
+		// The sleeps get longer while the server is idle, so an idle server isn't woken up 100 times a second.
+		http_log_sleep(log, interval);
+
+		interval = (2 * interval < HTTP_LOG_MAX_INTERVAL ? 2 * interval : HTTP_LOG_MAX_INTERVAL);
+	}
+
+	return NULL;
+}
+
+static void http_log_sleep(struct http_log_t *log, long interval)
+{
+	struct timespec until;
+	clock_gettime(CLOCK_REALTIME, &until);
+
+	until.tv_sec += interval / 1000;
+	until.tv_nsec += (interval % 1000) * 1000000L;
+
+	if (until.tv_nsec >= 1000000000L) {
+		until.tv_sec++;
+		until.tv_nsec -= 1000000000L;
+	}
+
+	pthread_mutex_lock(&log->lock);
+
+	if (!log->stopping) {
+		pthread_cond_timedwait(&log->stopped, &log->lock, &until);
+	}
+
+	pthread_mutex_unlock(&log->lock);
+}
+
+static size_t http_log_write_records(struct http_log_t *log)
+{
+	size_t written = 0;
+
+	for (size_t i = 0; i < log->rings_len; ++i) {
+
+		struct http_log_ring_t *ring = &log->rings[i];
+
+		uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+		uint64_t tail = ring->tail;
+
+		if (tail == head) {
+			continue;
+		}
+
+		written += (size_t)(head - tail);
+
+		for (; tail < head; ++tail) {
+			http_log_format(log, &ring->records[tail & (HTTP_LOG_RING_SIZE - 1)]);
+		}
+
+		// The records have been copied to the buffer, so the loop can reuse their slots.
+		__atomic_store_n(&ring->tail, tail, __ATOMIC_RELEASE);
+	}
+
+	http_log_flush(log);
+	return written;
+}
+
+static void http_log_format(struct http_log_t *log, const struct http_log_record_t *record)
+{
+	if (log->buffer_len + HTTP_LOG_MAX_LINE > HTTP_LOG_BUFFER_SIZE) {
+		http_log_flush(log);
+	}
+
+	// Consecutive records are mostly from the same second, so the time is only formatted when it changes.
+	if (record->time != log->time || log->time_text[0] == 0) {
+
+		time_t time = (time_t)record->time;
+		struct tm local;
+
+		localtime_r(&time, &local);
+		strftime(log->time_text, sizeof(log->time_text), "%d/%b/%Y:%H:%M:%S %z", &local);
+
+		log->time = record->time;
+	}
+
+	char line[128];
+	int length = snprintf(line, sizeof(line), "%s - - [%s] ", record->address, log->time_text);
+
+	http_log_append(log, line, (size_t)length);
+	http_log_append_quoted(log, record->text, record->request_line_len);
+
+	// No body is logged as a dash, like in the Common Log Format.
+	if (record->bytes == 0 || record->bytes == HTTP_LOG_UNKNOWN_LENGTH) {
+		length = snprintf(line, sizeof(line), " %u - ", record->status);
+	}
+	else {
+		length = snprintf(line, sizeof(line), " %u %llu ", record->status, (unsigned long long)record->bytes);
+	}
+
+	http_log_append(log, line, (size_t)length);
+	http_log_append_quoted(log, &record->text[record->request_line_len], record->referer_len);
+	http_log_append(log, " ", 1);
+	http_log_append_quoted(log, &record->text[record->request_line_len + record->referer_len], record->user_agent_len);
+
+	length = snprintf(line, sizeof(line), " %llu\n", (unsigned long long)(record->duration / 1000));
+	http_log_append(log, line, (size_t)length);
+}
+
+static void http_log_append(struct http_log_t *log, const char *text, size_t length)
+{
+	memcpy(&log->buffer[log->buffer_len], text, length);
+	log->buffer_len += length;
+}
+
+static void http_log_append_quoted(struct http_log_t *log, const char *text, size_t length)
+{
+	static const char digits[] = "0123456789abcdef";
+
+	char *output = &log->buffer[log->buffer_len];
+	*output++ = '"';
+
+	if (length == 0) {
+		*output++ = '-';
+	}
+
+	// Quotes, backslashes and unprintable bytes are escaped like Apache does, so a client can't forge log lines.
+	for (size_t i = 0; i < length; ++i) {
+
+		unsigned char c = (unsigned char)text[i];
+
+		if (c == '"' || c == '\\') {
+			*output++ = '\\';
+			*output++ = (char)c;
+		}
+		else if (c < 0x20 || c >= 0x7F) {
+			*output++ = '\\';
+			*output++ = 'x';
+			*output++ = digits[c >> 4];
+			*output++ = digits[c & 15];
+		}
+		else {
+			*output++ = (char)c;
+		}
+	}
+
+	*output++ = '"';
+	log->buffer_len = (size_t)(output - log->buffer);
+}
+
+static void http_log_flush(struct http_log_t *log)
+{
+	size_t offset = 0;
+
+	while (offset < log->buffer_len) {
+
+		ssize_t written = write(log->file, &log->buffer[offset], log->buffer_len - offset);
+
+		if (written < 0) {
+
+			if (errno == EINTR) {
+				continue;
+			}
+
+			// The batch is lost if the file can't be written to, there's nobody to report it to.
+			break;
+		}
+
+		offset += (size_t)written;
+	}
+
+	log->buffer_len = 0;
+}
+
+static size_t http_log_copy(char *destination, size_t room, const char *text)
+{
+	if (text == NULL) {
+		return 0;
+	}
+
+	size_t length = strlen(text);
+
+	if (length > room) {
+		length = room;
+	}
+
+	memcpy(destination, text, length);
+	return length;
+}
@@ -0,0 +1,79 @@
+#pragma once
+#ifndef __HTTPLOG_H
+#define __HTTPLOG_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+#define HTTP_LOG_CACHE_LINE 64
+#define HTTP_LOG_RING_SIZE 4096			// Records in the ring of each loop, a power of two
+#define HTTP_LOG_TEXT_SIZE 448
+#define HTTP_LOG_MAX_REQUEST_LINE 256
+#define HTTP_LOG_MAX_REFERER 96
+#define HTTP_LOG_ADDRESS_SIZE 16
+#define HTTP_LOG_UNKNOWN_LENGTH UINT64_MAX
+
+// --------------------------------------------------------------------------------
+
+// A request as it's pushed by a loop. The strings are copied as they are and formatted by the log thread.
+struct http_log_record_t {
+	int64_t time;					// Time the response was started, in seconds since the epoch
+	uint64_t duration;				// Time from the first byte of the request until the response was started, in nanoseconds
+	uint64_t bytes;					// Length of the response body, HTTP_LOG_UNKNOWN_LENGTH if it isn't known beforehand
+	uint16_t status;
+	uint16_t request_line_len;		// Lengths of the strings in the text, which follow each other without terminators
+	uint16_t referer_len;
+	uint16_t user_agent_len;
+	char address[HTTP_LOG_ADDRESS_SIZE];
+	char text[HTTP_LOG_TEXT_SIZE];	// The request line, the Referer header and the User-Agent header, truncated to fit
+};
+
+// A single producer, single consumer ring of records. The loop which owns the ring pushes records into it
+// and the log thread takes them out. The counters are on separate cache lines, so the threads only share
+// the line of the other's counter when they need it.
+struct http_log_ring_t {
+	struct http_log_record_t *records;
+	uint64_t head;					// Number of records ever pushed. Only written by the loop
+	char head_padding[HTTP_LOG_CACHE_LINE - sizeof(uint64_t)];
+	uint64_t tail;					// Number of records ever written out. Only written by the log thread
+	char tail_padding[HTTP_LOG_CACHE_LINE - sizeof(uint64_t)];
+};
+
+// An access log in the Combined Log Format, followed by the time taken in microseconds like Apache's %D.
+// A thread of its own formats the records of all the rings and writes them to the file in batches,
+// so the loops never wait for the file.
+struct http_log_t {
+	int file;
+	bool close_file;				// Whether the file was opened by the log, as opposed to the standard output
+	struct http_log_ring_t *rings;
+	size_t rings_len;
+	char *buffer;					// Formatted records waiting to be written
+	size_t buffer_len;
+	int64_t time;					// Time of the latest formatted record, which is usually the time of the next one too
+	char time_text[32];
+	bool stopping;
+	pthread_t thread;
+	pthread_mutex_t lock;			// Protects the stopping flag while the thread is sleeping
+	pthread_cond_t stopped;			// Signalled when the log is stopped, so the thread doesn't sleep through it
+};
+
+// --------------------------------------------------------------------------------
+
+// Opens the file, "-" for the standard output, and starts the log thread with a ring for each loop.
+bool http_log_start(struct http_log_t *log, const char *path, size_t rings_len);
+
+// Writes the records which are still in the rings and stops the thread. The loops must not push any more records.
+void http_log_stop(struct http_log_t *log);
+
+// Returns the next free record of a ring, or NULL if the log thread has fallen behind and the ring is full.
+// The record is passed on to the log thread with http_log_push. Only called by the loop which owns the ring.
+struct http_log_record_t *http_log_reserve(struct http_log_ring_t *ring);
+void http_log_push(struct http_log_ring_t *ring);
+
+// Copies the request line and the headers to a record, truncating them to fit. Any of the strings may be NULL.
+void http_log_set_request(struct http_log_record_t *record, const char *method, const char *path, const char *query,
+	const char *protocol, const char *referer, const char *user_agent);
+
+#endif
@@ -0,0 +1,344 @@
+#include "httpmetrics.h"
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <time.h>
+
+#ifdef _WIN32
+#include <malloc.h>
+#include <Windows.h>
+#endif
+
+// --------------------------------------------------------------------------------
+
+// Text being formatted. Once appending fails, the rest of the text is dropped.
+struct http_metrics_text_t {
+	char *data;
+	size_t len;
+	size_t size;
+	bool failed;
+};
+
+static const struct {
+	const char *name;
+	const char *help;
+} histograms[HTTP_HISTOGRAMS] = {
+	{ "http_request_parse_seconds", "Time from the first byte of a request until it has been received and parsed." },
+	{ "http_handler_seconds", "Time spent in the request handlers." },
+	{ "http_response_write_seconds", "Time from starting a response until all of it has been passed to the kernel." },
+};
+
+// --------------------------------------------------------------------------------
+
+static uint64_t http_metrics_load(const uint64_t *counter);
+static size_t http_metrics_get_bucket(uint64_t time);
+static double http_metrics_get_bucket_bound(size_t bucket);
+static void http_metrics_append(struct http_metrics_text_t *text, const char *format, ...);
+static void http_metrics_append_label(struct http_metrics_text_t *text, const char *value);
+static void http_metrics_append_counter(struct http_metrics_text_t *text, const char *name, const char *type, const char *help, uint64_t value);
+static void http_metrics_append_route(struct http_metrics_text_t *text, const char *method, const char *route, uint64_t value);
+
+// --------------------------------------------------------------------------------
+
+struct http_metrics_t *http_metrics_create(size_t routes_len)
+{
+	// Round the size up to whole cache lines, so the next allocation can't share the last one.
+	size_t size = sizeof(struct http_metrics_t) + (routes_len + 2) * sizeof(uint64_t);
+	size = (size + HTTP_METRICS_CACHE_LINE - 1) & ~(size_t)(HTTP_METRICS_CACHE_LINE - 1);
+
+	struct http_metrics_t *metrics;
+
+#ifdef _WIN32
+	metrics = _aligned_malloc(size, HTTP_METRICS_CACHE_LINE);
+#else
+	void *memory;
+	metrics = (posix_memalign(&memory, HTTP_METRICS_CACHE_LINE, size) == 0 ? memory : NULL);
+#endif
+
+	if (metrics == NULL) {
+		return NULL;
+	}
+
+	memset(metrics, 0, size);
+	metrics->routes_len = routes_len;
+
+	return metrics;
+}
+
+void http_metrics_destroy(struct http_metrics_t *metrics)
+{
+#ifdef _WIN32
+	_aligned_free(metrics);
+#else
+	free(metrics);
+#endif
+}
+
+void http_metrics_add(uint64_t *counter, uint64_t value)
+{
+	// The owner is the only writer, so a plain load and store is enough. Both are atomic so a reader never sees a torn value.
+	__atomic_store_n(counter, __atomic_load_n(counter, __ATOMIC_RELAXED) + value, __ATOMIC_RELAXED);
+}
+
+void http_metrics_subtract(uint64_t *counter, uint64_t value)
+{
+	__atomic_store_n(counter, __atomic_load_n(counter, __ATOMIC_RELAXED) - value, __ATOMIC_RELAXED);
+}
+
+void http_metrics_count_response(struct http_metrics_t *metrics, unsigned int status)
+{
+	if (status < HTTP_METRICS_MAX_STATUS) {
+		http_metrics_add(&metrics->responses[status], 1);
+	}
+}
+
+void http_metrics_count_route(struct http_metrics_t *metrics, size_t index)
+{
+	if (index < metrics->routes_len) {
+		http_metrics_add(&metrics->routes[index], 1);
+	}
+}
+
+void http_metrics_count_static(struct http_metrics_t *metrics)
+{
+	http_metrics_add(&metrics->routes[metrics->routes_len], 1);
+}
+
+void http_metrics_count_default(struct http_metrics_t *metrics)
+{
+	http_metrics_add(&metrics->routes[metrics->routes_len + 1], 1);
+}
+
+void http_metrics_observe(struct http_metrics_t *metrics, enum http_histogram_type_t type, uint64_t time)
+{
+	struct http_histogram_t *histogram = &metrics->histograms[type];
+
+	http_metrics_add(&histogram->buckets[http_metrics_get_bucket(time)], 1);
+	http_metrics_add(&histogram->sum, time);
+}
+
+uint64_t http_metrics_get_time(void)
+{
+#ifdef _WIN32
+	LARGE_INTEGER counter, frequency;
+
+	QueryPerformanceCounter(&counter);
+	QueryPerformanceFrequency(&frequency);
+
+	return (uint64_t)((double)counter.QuadPart * 1e9 / (double)frequency.QuadPart);
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+char *http_metrics_format(struct http_metrics_t *const *metrics, size_t metrics_len,
+	struct http_route_t *const *routes, size_t routes_len, size_t *length)
+{
+	struct http_metrics_text_t text;
+	memset(&text, 0, sizeof(text));
+
+	// The counters keep changing while they're read, so the sums are not from one exact moment.
+	uint64_t accepted = 0, active = 0, timed_out = 0, received = 0, sent = 0, dropped = 0;
+
+	for (size_t i = 0; i < metrics_len; ++i) {
+
+		accepted += http_metrics_load(&metrics[i]->connections_accepted);
+		active += http_metrics_load(&metrics[i]->connections_active);
+		timed_out += http_metrics_load(&metrics[i]->connections_timed_out);
+		received += http_metrics_load(&metrics[i]->bytes_received);
+		sent += http_metrics_load(&metrics[i]->bytes_sent);
+		dropped += http_metrics_load(&metrics[i]->access_log_dropped);
+	}
+
+	http_metrics_append_counter(&text, "http_connections_accepted_total", "counter", "Connections accepted.", accepted);
+	http_metrics_append_counter(&text, "http_connections_active", "gauge", "Connections currently open.", active);
+	http_metrics_append_counter(&text, "http_connections_timed_out_total", "counter", "Connections closed because a phase of a request took too long.", timed_out);
+	http_metrics_append_counter(&text, "http_received_bytes_total", "counter", "Bytes received from the clients.", received);
+	http_metrics_append_counter(&text, "http_sent_bytes_total", "counter", "Bytes sent to the clients.", sent);
+	http_metrics_append_counter(&text, "http_access_log_dropped_total", "counter", "Requests left out of the access log because it was full.", dropped);
+
+	// Responses by status code. Only the codes which have been sent are listed.
+	http_metrics_append(&text, "# HELP http_responses_total Responses sent, by status code.\n# TYPE http_responses_total counter\n");
+
+	for (unsigned int status = 0; status < HTTP_METRICS_MAX_STATUS; ++status) {
+
+		uint64_t count = 0;
+
+		for (size_t i = 0; i < metrics_len; ++i) {
+			count += http_metrics_load(&metrics[i]->responses[status]);
+		}
+
+		if (count != 0) {
+			http_metrics_append(&text, "http_responses_total{code=\"%u\"} %llu\n", status, (unsigned long long)count);
+		}
+	}
+
+	// Requests by route. Static files and the default handler are listed under names which can't be route patterns.
+	http_metrics_append(&text, "# HELP http_requests_total Requests handled, by route.\n# TYPE http_requests_total counter\n");
+
+	for (size_t route = 0; route < routes_len; ++route) {
+
+		uint64_t count = 0;
+
+		for (size_t i = 0; i < metrics_len; ++i) {
+
+			if (route < metrics[i]->routes_len) {
+				count += http_metrics_load(&metrics[i]->routes[route]);
+			}
+		}
+
+		http_metrics_append_route(&text, routes[route]->method, routes[route]->pattern, count);
+	}
+
+	uint64_t static_files = 0, default_handler = 0;
+
+	for (size_t i = 0; i < metrics_len; ++i) {
+
+		static_files += http_metrics_load(&metrics[i]->routes[metrics[i]->routes_len]);
+		default_handler += http_metrics_load(&metrics[i]->routes[metrics[i]->routes_len + 1]);
+	}
+
+	http_metrics_append_route(&text, NULL, "static", static_files);
+	http_metrics_append_route(&text, NULL, "default", default_handler);
+
+	// The histograms, in seconds with cumulative buckets.
+	for (int type = 0; type < HTTP_HISTOGRAMS; ++type) {
+
+		const char *name = histograms[type].name;
+		http_metrics_append(&text, "# HELP %s %s\n# TYPE %s histogram\n", name, histograms[type].help, name);
+
+		uint64_t count = 0, sum = 0;
+
+		for (size_t bucket = 0; bucket <= HTTP_HISTOGRAM_BUCKETS; ++bucket) {
+
+			for (size_t i = 0; i < metrics_len; ++i) {
+				count += http_metrics_load(&metrics[i]->histograms[type].buckets[bucket]);
+			}
+
+			if (bucket < HTTP_HISTOGRAM_BUCKETS) {
+				http_metrics_append(&text, "%s_bucket{le=\"%.9g\"} %llu\n", name, http_metrics_get_bucket_bound(bucket) / 1e6, (unsigned long long)count);
+			}
+		}
+
+		for (size_t i = 0; i < metrics_len; ++i) {
+			sum += http_metrics_load(&metrics[i]->histograms[type].sum);
+		}
+
+		http_metrics_append(&text, "%s_bucket{le=\"+Inf\"} %llu\n%s_sum %.9f\n%s_count %llu\n",
+			name, (unsigned long long)count, name, (double)sum / 1e9, name, (unsigned long long)count);
+	}
+
+	if (text.failed) {
+		free(text.data);
+		return NULL;
+	}
+
+	*length = text.len;
+	return text.data;
+}
+
+static uint64_t http_metrics_load(const uint64_t *counter)
+{
+	return __atomic_load_n(counter, __ATOMIC_RELAXED);
+}
+
+static size_t http_metrics_get_bucket(uint64_t time)
+{
+	// Round up to whole microseconds, so a time on the upper bound of a bucket is counted in it.
+	uint64_t microseconds = (time + 999) / 1000;
+
+	if (microseconds <= 1) {
+		return 0;
+	}
+
+	// Each power of two k covers the values from 2^k + 1 to 2^(k + 1), split in half at 1.5 * 2^k.
+	uint64_t value = microseconds - 1;
+	size_t power = (size_t)(63 - __builtin_clzll(value));
+	size_t bucket = (power == 0 ? 2 : 2 * power + 1 + (size_t)((value >> (power - 1)) & 1));
+
+	return (bucket < HTTP_HISTOGRAM_BUCKETS ? bucket : HTTP_HISTOGRAM_BUCKETS);
+}
+
+static double http_metrics_get_bucket_bound(size_t bucket)
+{
+	// The upper bound of the bucket in microseconds.
+	double power = (double)((uint64_t)1 << (bucket / 2));
+	return ((bucket & 1) != 0 ? 1.5 * power : power);
+}
+
+static void http_metrics_append(struct http_metrics_text_t *text, const char *format, ...)
+{
+	if (text->failed) {
+		return;
+	}
+
+	for (;;) {
+
+		size_t room = text->size - text->len;
+
+		va_list args;
+		va_start(args, format);
+		int written = vsnprintf(text->data != NULL ? &text->data[text->len] : NULL, room, format, args);
+		va_end(args);
+
+		if (written < 0) {
+			text->failed = true;
+			return;
+		}
+
+		if ((size_t)written < room) {
+			text->len += (size_t)written;
+			return;
+		}
+
+		// Grow the buffer and try again.
+		size_t size = (text->size != 0 ? text->size * 2 : 4096);
+
+		while (size - text->len <= (size_t)written) {
+			size *= 2;
+		}
+
+		char *data = realloc(text->data, size);
+
+		if (data == NULL) {
+			text->failed = true;
+			return;
+		}
+
+		text->data = data;
+		text->size = size;
+	}
+}
+
+static void http_metrics_append_label(struct http_metrics_text_t *text, const char *value)
+{
+	// Backslashes, quotes and line feeds have to be escaped in label values.
+	for (const char *c = value; *c != 0; ++c) {
+
+		switch (*c) {
+		case '\\': http_metrics_append(text, "\\\\"); break;
+		case '"': http_metrics_append(text, "\\\""); break;
+		case '\n': http_metrics_append(text, "\\n"); break;
+		default: http_metrics_append(text, "%c", *c); break;
+		}
+	}
+}
+
+static void http_metrics_append_counter(struct http_metrics_text_t *text, const char *name, const char *type, const char *help, uint64_t value)
+{
+	http_metrics_append(text, "# HELP %s %s\n# TYPE %s %s\n%s %llu\n", name, help, name, type, name, (unsigned long long)value);
+}
+
+static void http_metrics_append_route(struct http_metrics_text_t *text, const char *method, const char *route, uint64_t value)
+{
+	// Routes for any method are labelled with an asterisk.
+	http_metrics_append(text, "http_requests_total{method=\"");
+	http_metrics_append_label(text, method != NULL ? method : "*");
+	http_metrics_append(text, "\",route=\"");
+	http_metrics_append_label(text, route);
+	http_metrics_append(text, "\"} %llu\n", (unsigned long long)value);
+}
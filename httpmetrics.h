@@ -0,0 +1,73 @@
+#pragma once
+#ifndef __HTTPMETRICS_H
+#define __HTTPMETRICS_H
+
+#include "httprouter.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#define HTTP_METRICS_CACHE_LINE 64
+#define HTTP_METRICS_MAX_STATUS 600
+#define HTTP_HISTOGRAM_BUCKETS 48
+
+// --------------------------------------------------------------------------------
+
+enum http_histogram_type_t {
+	HTTP_HISTOGRAM_PARSE,			// From the first byte of a request until the whole request has been received and parsed
+	HTTP_HISTOGRAM_HANDLER,			// Time spent in the route handler or the default handler
+	HTTP_HISTOGRAM_WRITE,			// From starting a response until all of it has been passed to the kernel
+	HTTP_HISTOGRAMS
+};
+
+// A latency histogram with two buckets for each power of two, like a coarse HDR histogram. The upper bounds
+// of the buckets are 1, 1.5, 2, 3, 4, 6, 8... microseconds, up to about 12.6 seconds. Longer times go to the last bucket.
+struct http_histogram_t {
+	uint64_t buckets[HTTP_HISTOGRAM_BUCKETS + 1];
+	uint64_t sum;					// Sum of the recorded times in nanoseconds
+};
+
+// The counters of an event loop. Only the loop's thread updates them, so no atomic read-modify-write operations
+// are needed, and any thread can read them at any time. The counters of each loop are allocated on cache lines
+// of their own, so the loops don't slow each other down.
+struct http_metrics_t {
+	uint64_t connections_accepted;
+	uint64_t connections_active;
+	uint64_t connections_timed_out;
+	uint64_t bytes_received;
+	uint64_t bytes_sent;
+	uint64_t access_log_dropped;	// Requests left out of the access log because its thread had fallen behind
+	uint64_t responses[HTTP_METRICS_MAX_STATUS]; // Responses by status code
+	struct http_histogram_t histograms[HTTP_HISTOGRAMS];
+	size_t routes_len;
+	uint64_t routes[];				// Requests by route index, followed by the static files and the default handler
+};
+
+// --------------------------------------------------------------------------------
+
+// Creates the counters of a loop for the given number of routes. Requests to routes which are added later
+// are only counted by their status.
+struct http_metrics_t *http_metrics_create(size_t routes_len);
+void http_metrics_destroy(struct http_metrics_t *metrics);
+
+// Updates a counter. Only called by the thread which owns the counters.
+void http_metrics_add(uint64_t *counter, uint64_t value);
+void http_metrics_subtract(uint64_t *counter, uint64_t value);
+
+void http_metrics_count_response(struct http_metrics_t *metrics, unsigned int status);
+void http_metrics_count_route(struct http_metrics_t *metrics, size_t index);
+void http_metrics_count_static(struct http_metrics_t *metrics);
+void http_metrics_count_default(struct http_metrics_t *metrics);
+
+// Records a time in nanoseconds. Only called by the thread which owns the counters.
+void http_metrics_observe(struct http_metrics_t *metrics, enum http_histogram_type_t type, uint64_t time);
+
+// Current value of a monotonic clock in nanoseconds.
+uint64_t http_metrics_get_time(void);
+
+// Sums up the counters of all loops and formats them in the Prometheus text format. Returns a null terminated
+// string allocated with malloc, or NULL if out of memory.
+char *http_metrics_format(struct http_metrics_t *const *metrics, size_t metrics_len,
+	struct http_route_t *const *routes, size_t routes_len, size_t *length);
+
+#endif
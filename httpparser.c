@@ -0,0 +1,623 @@
+#include "httpparser.h"
+#include "httputils.h"
+#include <string.h>
+#include <strings.h>
+#include <stdint.h>
+
+// Delimiters are searched for 32 or 16 bytes at a time when the compiler targets AVX2 or SSE2.
+// SSE2 is always available on x86-64, AVX2 has to be enabled with -mavx2.
+#if defined(__AVX2__)
+	#include <immintrin.h>
+#elif defined(__SSE2__)
+	#include <emmintrin.h>
+#endif
+
+// --------------------------------------------------------------------------------
+
+static char *http_parser_find_header_end(struct http_parser_t *parser, char *data, size_t length);
+static bool http_parser_parse_headers(struct http_parser_t *parser, char *data);
+static bool http_parser_parse_request_line(struct http_parser_t *parser, char *line, char *end);
+static bool http_parser_parse_header(struct http_parser_t *parser, char *line, char *end);
+static enum http_parser_result_t http_parser_parse_body(struct http_parser_t *parser, char *data, size_t length);
+static bool http_parser_parse_chunk_size(struct http_parser_t *parser, const char *line, const char *end);
+static char *http_parser_find(const char *data, const char *end, char first, char second);
+static char *http_parser_skip_white_space(char *data, char *end);
+static bool http_parser_parse_length(const char *value, size_t *length);
+
+// --------------------------------------------------------------------------------
+
+void http_parser_reset(struct http_parser_t *parser)
+{
+	parser->state = HTTP_PARSER_HEADERS;
+	parser->base = NULL;
+	parser->scanned = 0;
+	parser->header_length = 0;
+	parser->content_length = 0;
+
+	parser->position = 0;
+	parser->remaining = 0;
+	parser->body_length = 0;
+	parser->body_received = 0;
+
+	parser->method = NULL;
+	parser->path = NULL;
+	parser->query = NULL;
+	parser->protocol = NULL;
+	parser->content = NULL;
+
+	parser->headers_len = 0;
+	parser->keep_alive = false;
+	parser->has_content_length = false;
+	parser->chunked = false;
+	parser->unsupported = false;
+}
+
+enum http_parser_result_t http_parser_execute(struct http_parser_t *parser, char *data, size_t length)
+{
+	if (parser->state == HTTP_PARSER_HEADERS) {
+
+		// Find the empty line which terminates the headers. Until then there's nothing to parse.
+		char *end = http_parser_find_header_end(parser, data, length);
+
+		if (end == NULL) {
+			return HTTP_PARSER_INCOMPLETE;
+		}
+
+		parser->base = data;
+		parser->header_length = (size_t)(end - data);
+
+		if (!http_parser_parse_headers(parser, data)) {
+			return (parser->unsupported ? HTTP_PARSER_UNSUPPORTED : HTTP_PARSER_ERROR);
+		}
+
+		parser->content = &data[parser->header_length];
+		parser->position = parser->header_length;
+
+		// A chunked body ends with an empty chunk. Requests which also have a Content-Length header have been refused.
+		if (parser->chunked) {
+			parser->state = HTTP_PARSER_CHUNK_SIZE;
+		}
+		else {
+			parser->state = HTTP_PARSER_BODY;
+			parser->remaining = parser->content_length;
+		}
+
+		return HTTP_PARSER_HEADERS_COMPLETE;
+	}
+
+	return http_parser_parse_body(parser, data, length);
+}
+
+size_t http_parser_discard_body(struct http_parser_t *parser, size_t length)
+{
+	size_t removed = parser->position - parser->header_length;
+
+	if (removed != 0) {
+		memmove(parser->content, &parser->base[parser->position], length - parser->position);
+	}
+
+	parser->position = parser->header_length;
+	parser->body_length = 0;
+
+	return removed;
+}
+
+void http_parser_relocate(struct http_parser_t *parser, char *data)
+{
+	// Nothing points to the data before the headers have been parsed.
+	if (parser->state == HTTP_PARSER_HEADERS) {
+		return;
+	}
+
+	#define RELOCATE(ptr) (ptr) = data + ((ptr) - parser->base)
+
+	RELOCATE(parser->method);
+	RELOCATE(parser->path);
+	RELOCATE(parser->protocol);
+
+	if (parser->query != NULL) {
+		RELOCATE(parser->query);
+	}
+	RELOCATE(parser->content);
+
+	for (size_t i = 0; i < parser->headers_len; ++i) {
+		RELOCATE(parser->headers[i].name);
+		RELOCATE(parser->headers[i].value);
+	}
+
+	#undef RELOCATE
+
+	parser->base = data;
+}
+
+size_t http_parser_get_request_length(const struct http_parser_t *parser)
+{
+	return parser->position;
+}
+
+const char *http_parser_get_header(const struct http_parser_t *parser, const char *name)
+{
+	return http_parser_find_header(parser->headers, parser->headers_len, name);
+}
+
+const char *http_parser_find_header(const struct http_request_header_t *headers, size_t headers_len, const char *name)
+{
+	size_t name_len = strlen(name);
+
+	// Most headers can be skipped by their length without comparing the names.
+	for (size_t i = 0; i < headers_len; ++i) {
+
+		if (headers[i].name_len == name_len && strcasecmp(headers[i].name, name) == 0) {
+			return headers[i].value;
+		}
+	}
+
+	return NULL;
+}
+
+static char *http_parser_find_header_end(struct http_parser_t *parser, char *data, size_t length)
+{
+	// Continue from where the previous call left off. A line break may have been the last
+	// character scanned, so step back enough to see the whole terminator.
+	size_t offset = (parser->scanned > 3 ? parser->scanned - 3 : 0);
+
+	for (;;) {
+
+		char *line_break = http_parser_find(&data[offset], &data[length], '\n', '\n');
+
+		if (line_break == NULL) {
+			break;
+		}
+
+		offset = (size_t)(line_break - data) + 1;
+
+		// Accept both CRLF CRLF and a bare LF LF as the terminator.
+		if (offset < length && data[offset] == '\n') {
+			parser->scanned = offset + 1;
+			return &data[offset + 1];
+		}
+
+		if (offset + 1 < length && data[offset] == '\r' && data[offset + 1] == '\n') {
+			parser->scanned = offset + 2;
+			return &data[offset + 2];
+		}
+	}
+
+	parser->scanned = length;
+	return NULL;
+}
+
+static bool http_parser_parse_headers(struct http_parser_t *parser, char *data)
+{
+	char *end = &data[parser->header_length];
+
+	// Skip empty lines preceding the request line (RFC 7230, section 3.5).
+	while (data < end && (*data == '\r' || *data == '\n')) {
+		++data;
+	}
+
+	// Every line is parsed in place. The line breaks are replaced with null terminators.
+	char *line_end = http_parser_find(data, end, '\n', '\n');
+
+	if (line_end == NULL || !http_parser_parse_request_line(parser, data, line_end)) {
+		return false;
+	}
+
+	// Parse the headers, one line at a time, until the empty line which terminates them.
+	for (char *line = line_end + 1; line < end; line = line_end + 1) {
+
+		line_end = http_parser_find(line, end, '\n', '\n');
+
+		if (line_end == NULL) {
+			return false;
+		}
+
+		// The empty line is the last line of the headers.
+		if (line == line_end || (line[0] == '\r' && &line[1] == line_end)) {
+			break;
+		}
+
+		if (!http_parser_parse_header(parser, line, line_end)) {
+			return false;
+		}
+	}
+
+	// A request with both a length and a chunked body could be framed differently by a proxy in front of the server,
+	// so it's refused rather than trusting either (RFC 9112, section 6.1).
+	if (parser->chunked && parser->has_content_length) {
+		return false;
+	}
+
+	return true;
+}
+
+static bool http_parser_parse_request_line(struct http_parser_t *parser, char *line, char *end)
+{
+	// Remove the optional carriage return before the line feed.
+	if (end > line && end[-1] == '\r') {
+		--end;
+	}
+
+	*end = 0;
+
+	// The request line consists of the method, the requested resource and the protocol, separated by white space.
+	char *method_end = http_parser_find(line, end, ' ', '\t');
+
+	if (method_end == NULL || method_end == line) {
+		return false;
+	}
+
+	char *path = http_parser_skip_white_space(method_end, end);
+	char *path_end = http_parser_find(path, end, ' ', '\t');
+
+	if (path_end == NULL || path_end == path) {
+		return false;
+	}
+
+	char *protocol = http_parser_skip_white_space(path_end, end);
+	char *protocol_end = http_parser_find(protocol, end, ' ', '\t');
+
+	if (protocol == end) {
+		return false;
+	}
+
+	*method_end = 0;
+	*path_end = 0;
+
+	if (protocol_end != NULL) {
+
+		// Nothing but white space may follow the protocol.
+		if (http_parser_skip_white_space(protocol_end, end) != end) {
+			return false;
+		}
+
+		*protocol_end = 0;
+	}
+
+	parser->method = line;
+	parser->protocol = protocol;
+
+	// Separate the query string from the path.
+	char *query = http_parser_find(path, path_end, '?', '?');
+
+	if (query != NULL) {
+		*query = 0;
+		parser->query = query + 1;
+	}
+
+	// Decode the path in place. It only gets shorter, so the query string stays where it is.
+	if (!string_decode_url_path(path)) {
+		return false;
+	}
+
+	parser->path = path;
+
+	// HTTP/1.1 connections are persistent by default, older versions have to ask for it.
+	parser->keep_alive = (strcmp(parser->protocol, "HTTP/1.1") == 0);
+
+	return true;
+}
+
+static bool http_parser_parse_header(struct http_parser_t *parser, char *line, char *end)
+{
+	char *colon = http_parser_find(line, end, ':', ':');
+
+	// There must be a header name and no white space between it and the colon.
+	if (colon == NULL || colon == line || colon[-1] == ' ' || colon[-1] == '\t') {
+		return false;
+	}
+
+	if (parser->headers_len >= HTTP_PARSER_MAX_HEADERS) {
+		return false;
+	}
+
+	// Trim the white space around the value.
+	char *value = http_parser_skip_white_space(colon + 1, end);
+
+	while (end > value && (end[-1] == ' ' || end[-1] == '\t' || end[-1] == '\r')) {
+		--end;
+	}
+
+	*colon = 0;
+	*end = 0;
+
+	struct http_request_header_t *header = &parser->headers[parser->headers_len++];
+
+	header->name = line;
+	header->name_len = (size_t)(colon - line);
+	header->value = value;
+	header->value_len = (size_t)(end - value);
+
+	// Interpret the headers which affect the framing of the request and the connection.
+	if (header->name_len == 14 && strcasecmp(line, "Content-Length") == 0) {
+
+		size_t content_length;
+
+		if (!http_parser_parse_length(value, &content_length)) {
+			return false;
+		}
+
+		// Conflicting lengths could be framed differently by a proxy in front of the server, so they're refused
+		// (RFC 9112, section 6.3). Repeating the same length is allowed.
+		if (parser->has_content_length && content_length != parser->content_length) {
+			return false;
+		}
+
+		parser->content_length = content_length;
+		parser->has_content_length = true;
+	}
+	else if (header->name_len == 17 && strcasecmp(line, "Transfer-Encoding") == 0) {
+
+		// Chunked may only be applied once, so a second Transfer-Encoding header can't be valid after it.
+		if (parser->chunked) {
+			return false;
+		}
+
+		// Only the chunked coding is implemented. Other codings would have to be decoded before the body
+		// is passed on, so they're refused rather than handing the coded data to the handler (RFC 9112, section 6.1).
+		if (strcasecmp(value, "chunked") != 0) {
+			parser->unsupported = true;
+			return false;
+		}
+
+		parser->chunked = true;
+	}
+	else if (header->name_len == 10 && strcasecmp(line, "Connection") == 0) {
+
+		if (string_contains_token(value, "close")) {
+			parser->keep_alive = false;
+		}
+		else if (string_contains_token(value, "keep-alive")) {
+			parser->keep_alive = true;
+		}
+	}
+
+	return true;
+}
+
+static enum http_parser_result_t http_parser_parse_body(struct http_parser_t *parser, char *data, size_t length)
+{
+	for (;;) {
+
+		char *line_end;
+		size_t count;
+
+		switch (parser->state) {
+
+		case HTTP_PARSER_BODY:
+
+			// The body follows the headers as is. Nothing is moved, so the data is already where the decoded body goes.
+			count = length - parser->position;
+
+			if (count > parser->remaining) {
+				count = parser->remaining;
+			}
+
+			parser->position += count;
+			parser->remaining -= count;
+			parser->body_length += count;
+			parser->body_received += count;
+
+			if (parser->remaining != 0) {
+				return HTTP_PARSER_INCOMPLETE;
+			}
+
+			parser->state = HTTP_PARSER_COMPLETE;
+			break;
+
+		case HTTP_PARSER_CHUNK_SIZE:
+
+			line_end = http_parser_find(&data[parser->position], &data[length], '\n', '\n');
+
+			if (line_end == NULL) {
+				return (length - parser->position > HTTP_PARSER_MAX_CHUNK_LINE ? HTTP_PARSER_ERROR : HTTP_PARSER_INCOMPLETE);
+			}
+
+			if (!http_parser_parse_chunk_size(parser, &data[parser->position], line_end)) {
+				return HTTP_PARSER_ERROR;
+			}
+
+			parser->position = (size_t)(line_end - data) + 1;
+
+			// The last chunk is empty. It may be followed by trailer fields.
+			parser->state = (parser->remaining != 0 ? HTTP_PARSER_CHUNK_DATA : HTTP_PARSER_TRAILERS);
+			break;
+
+		case HTTP_PARSER_CHUNK_DATA:
+
+			count = length - parser->position;
+
+			if (count > parser->remaining) {
+				count = parser->remaining;
+			}
+
+			if (count == 0) {
+				return HTTP_PARSER_INCOMPLETE;
+			}
+
+			// Move the data of the chunk to the end of the decoded body, over the chunk sizes before it.
+			memmove(&parser->content[parser->body_length], &data[parser->position], count);
+
+			parser->position += count;
+			parser->remaining -= count;
+			parser->body_length += count;
+			parser->body_received += count;
+
+			if (parser->remaining == 0) {
+				parser->state = HTTP_PARSER_CHUNK_END;
+			}
+			break;
+
+		case HTTP_PARSER_CHUNK_END:
+
+			// The data of a chunk is followed by a line break, with or without the carriage return.
+			if (parser->position >= length) {
+				return HTTP_PARSER_INCOMPLETE;
+			}
+
+			if (data[parser->position] == '\r') {
+
+				if (parser->position + 1 >= length) {
+					return HTTP_PARSER_INCOMPLETE;
+				}
+
+				parser->position++;
+			}
+
+			if (data[parser->position] != '\n') {
+				return HTTP_PARSER_ERROR;
+			}
+
+			parser->position++;
+			parser->state = HTTP_PARSER_CHUNK_SIZE;
+			break;
+
+		case HTTP_PARSER_TRAILERS:
+
+			// Trailer fields are not used, skip them until the empty line which ends the request.
+			line_end = http_parser_find(&data[parser->position], &data[length], '\n', '\n');
+
+			if (line_end == NULL) {
+				return (length - parser->position > HTTP_PARSER_MAX_CHUNK_LINE ? HTTP_PARSER_ERROR : HTTP_PARSER_INCOMPLETE);
+			}
+
+			if (line_end == &data[parser->position] ||
+				(line_end == &data[parser->position + 1] && data[parser->position] == '\r')) {
+
+				parser->state = HTTP_PARSER_COMPLETE;
+			}
+
+			parser->position = (size_t)(line_end - data) + 1;
+			break;
+
+		case HTTP_PARSER_COMPLETE:
+			return HTTP_PARSER_DONE;
+
+		default:
+			return HTTP_PARSER_ERROR;
+		}
+	}
+}
+
+static bool http_parser_parse_chunk_size(struct http_parser_t *parser, const char *line, const char *end)
+{
+	size_t size = 0;
+	const char *c = line;
+
+	// The size is in hexadecimal. It may be followed by chunk extensions, which are ignored.
+	for (; c < end; ++c) {
+
+		int digit;
+
+		if (*c >= '0' && *c <= '9') {
+			digit = *c - '0';
+		}
+		else if (*c >= 'a' && *c <= 'f') {
+			digit = *c - 'a' + 10;
+		}
+		else if (*c >= 'A' && *c <= 'F') {
+			digit = *c - 'A' + 10;
+		}
+		else {
+			break;
+		}
+
+		// Refuse sizes which would overflow.
+		if (size > (SIZE_MAX >> 4)) {
+			return false;
+		}
+
+		size = (size << 4) | (size_t)digit;
+	}
+
+	if (c == line || (c < end && *c != ';' && *c != ' ' && *c != '\t' && *c != '\r')) {
+		return false;
+	}
+
+	parser->remaining = size;
+	return true;
+}
+
+static char *http_parser_find(const char *data, const char *end, char first, char second)
+{
+	// Compare a whole vector of bytes against both characters at once. The mask of the matching bytes
+	// gives the position of the first match.
+#if defined(__AVX2__)
+	const __m256i first32 = _mm256_set1_epi8(first);
+	const __m256i second32 = _mm256_set1_epi8(second);
+
+	for (; end - data >= 32; data += 32) {
+
+		__m256i bytes = _mm256_loadu_si256((const __m256i *)data);
+		__m256i matches = _mm256_or_si256(_mm256_cmpeq_epi8(bytes, first32), _mm256_cmpeq_epi8(bytes, second32));
+
+		uint32_t mask = (uint32_t)_mm256_movemask_epi8(matches);
+
+		if (mask != 0) {
+			return (char *)&data[__builtin_ctz(mask)];
+		}
+	}
+#endif
+
+#if defined(__SSE2__)
+	const __m128i first16 = _mm_set1_epi8(first);
+	const __m128i second16 = _mm_set1_epi8(second);
+
+	for (; end - data >= 16; data += 16) {
+
+		__m128i bytes = _mm_loadu_si128((const __m128i *)data);
+		__m128i matches = _mm_or_si128(_mm_cmpeq_epi8(bytes, first16), _mm_cmpeq_epi8(bytes, second16));
+
+		uint32_t mask = (uint32_t)_mm_movemask_epi8(matches);
+
+		if (mask != 0) {
+			return (char *)&data[__builtin_ctz(mask)];
+		}
+	}
+#endif
+
+	// The rest of the data, or all of it when vector instructions are not available.
+	for (; data < end; ++data) {
+
+		if (*data == first || *data == second) {
+			return (char *)data;
+		}
+	}
+
+	return NULL;
+}
+
+static char *http_parser_skip_white_space(char *data, char *end)
+{
+	while (data < end && (*data == ' ' || *data == '\t')) {
+		++data;
+	}
+
+	return data;
+}
+
+static bool http_parser_parse_length(const char *value, size_t *length)
+{
+	if (*value == 0) {
+		return false;
+	}
+
+	size_t result = 0;
+
+	for (const char *c = value; *c != 0; ++c) {
+
+		if (*c < '0' || *c > '9') {
+			return false;
+		}
+
+		// Refuse values which would overflow.
+		if (result > (SIZE_MAX - 9) / 10) {
+			return false;
+		}
+
+		result = 10 * result + (size_t)(*c - '0');
+	}
+
+	*length = result;
+	return true;
+}
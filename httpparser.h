@@ -0,0 +1,88 @@
+#pragma once
+#ifndef __HTTPPARSER_H
+#define __HTTPPARSER_H
+
+#include "httpserver.h"
+#include <stddef.h>
+#include <stdbool.h>
+
+#define HTTP_PARSER_MAX_HEADERS 64
+#define HTTP_PARSER_MAX_CHUNK_LINE 1024
+
+// --------------------------------------------------------------------------------
+
+enum http_parser_state_t {
+	HTTP_PARSER_HEADERS,			// Waiting for the request line and headers to be complete
+	HTTP_PARSER_BODY,				// Headers have been parsed, waiting for the rest of a body with a known length
+	HTTP_PARSER_CHUNK_SIZE,			// Waiting for the line which starts a chunk of a chunked body
+	HTTP_PARSER_CHUNK_DATA,			// Waiting for the rest of a chunk
+	HTTP_PARSER_CHUNK_END,			// Waiting for the line break after a chunk
+	HTTP_PARSER_TRAILERS,			// Waiting for the trailer fields after the last chunk
+	HTTP_PARSER_COMPLETE,			// The entire request has been parsed
+};
+
+enum http_parser_result_t {
+	HTTP_PARSER_INCOMPLETE,			// More data is required to complete the request
+	HTTP_PARSER_HEADERS_COMPLETE,	// The request line and headers have just been parsed, the body follows
+	HTTP_PARSER_DONE,				// A complete request is available
+	HTTP_PARSER_ERROR,				// The request is malformed
+	HTTP_PARSER_UNSUPPORTED,		// The request uses a transfer coding which isn't supported
+};
+
+// A resumable parser for a single request. The request is parsed in place, i.e. the strings point
+// to the input buffer and the delimiters in the buffer are replaced with null terminators.
+// A chunked body is decoded in place as well, the data of the chunks is moved together right after the headers.
+struct http_parser_t {
+	enum http_parser_state_t state;
+	char *base;						// Start of the request in the input buffer
+
+	size_t scanned;					// Number of bytes already searched for the end of the headers
+	size_t header_length;			// Length of the request line and headers, including the empty line after them
+	size_t content_length;			// Length of the request body from the Content-Length header
+
+	size_t position;				// Offset of the first byte of the body which hasn't been parsed yet
+	size_t remaining;				// Bytes left in the body or in the current chunk
+	size_t body_length;				// Length of the decoded body data following the headers
+	size_t body_received;			// Length of all of the body decoded so far, including the data which has been discarded
+
+	char *method;
+	char *path;						// Path of the requested resource, percent-decoded
+	char *query;					// Query string without the question mark, NULL if the request has none
+	char *protocol;
+	char *content;
+
+	struct http_request_header_t headers[HTTP_PARSER_MAX_HEADERS];
+	size_t headers_len;
+
+	bool keep_alive;				// Whether the connection should be kept open after the response
+	bool has_content_length;		// Whether the request has a Content-Length header
+	bool chunked;					// Body uses chunked transfer encoding
+	bool unsupported;				// Body uses a transfer coding other than chunked
+};
+
+// --------------------------------------------------------------------------------
+
+void http_parser_reset(struct http_parser_t *parser);
+
+// Parses the data available for the current request. The data must start at the beginning of the request
+// and can contain more than one request. Each call can be given more data than the previous one, already
+// parsed data is not parsed again. Once the headers have been parsed, HTTP_PARSER_HEADERS_COMPLETE is returned
+// before any of the body is parsed, and the next call continues with the body.
+enum http_parser_result_t http_parser_execute(struct http_parser_t *parser, char *data, size_t length);
+
+// Removes the decoded body data from the request, so the input buffer doesn't have to hold the entire body.
+// The unparsed data after it is moved to its place. The length is the length of the data given to the parser,
+// and the number of bytes removed is returned.
+size_t http_parser_discard_body(struct http_parser_t *parser, size_t length);
+
+// Moves the parsed strings to a new location of the request data, after the data has been copied or moved.
+void http_parser_relocate(struct http_parser_t *parser, char *data);
+
+// Total length of a completely parsed request as it is in the input buffer, i.e. the offset of the next pipelined request.
+size_t http_parser_get_request_length(const struct http_parser_t *parser);
+
+// Finds a header with the given name (case insensitive). Returns NULL if the request has no such header.
+const char *http_parser_get_header(const struct http_parser_t *parser, const char *name);
+const char *http_parser_find_header(const struct http_request_header_t *headers, size_t headers_len, const char *name);
+
+#endif
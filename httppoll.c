@@ -0,0 +1,422 @@
+#include "httppoll.h"
+#include "httpring.h"
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+
+#ifdef __linux__
+#include <sys/eventfd.h>
+#endif
+
+#ifdef HTTP_POLL_EPOLL
+#include <sys/epoll.h>
+
+// --------------------------------------------------------------------------------
+
+static uint32_t http_poll_to_epoll(uint32_t events)
+{
+	uint32_t flags = EPOLLET | EPOLLRDHUP;
+
+	if (events & HTTP_POLL_READ) {
+		flags |= EPOLLIN;
+	}
+	if (events & HTTP_POLL_WRITE) {
+		flags |= EPOLLOUT;
+	}
+
+	return flags;
+}
+
+bool http_poll_create(struct http_poll_t *poll)
+{
+#ifdef HTTP_POLL_URING
+	poll->ring = NULL;
+#endif
+
+	poll->fd = epoll_create1(EPOLL_CLOEXEC);
+	return (poll->fd >= 0);
+}
+
+bool http_poll_create_ring(struct http_poll_t *poll)
+{
+#ifdef HTTP_POLL_URING
+	poll->fd = -1;
+	poll->ring = http_ring_create();
+
+	return (poll->ring != NULL);
+#else
+	return false;
+#endif
+}
+
+bool http_poll_is_ring(const struct http_poll_t *poll)
+{
+#ifdef HTTP_POLL_URING
+	return (poll->ring != NULL);
+#else
+	return false;
+#endif
+}
+
+int http_poll_get_fd(const struct http_poll_t *poll)
+{
+#ifdef HTTP_POLL_URING
+	if (poll->ring != NULL) {
+		return http_ring_get_fd(poll->ring);
+	}
+#endif
+
+	// An epoll instance is readable when any of its sockets is ready.
+	return poll->fd;
+}
+
+void http_poll_destroy(struct http_poll_t *poll)
+{
+#ifdef HTTP_POLL_URING
+	http_ring_destroy(poll->ring);
+	poll->ring = NULL;
+#endif
+
+	if (poll->fd >= 0) {
+		close(poll->fd);
+		poll->fd = -1;
+	}
+}
+
+bool http_poll_add(struct http_poll_t *poll, socket_t sock, uint32_t events, void *data)
+{
+#ifdef HTTP_POLL_URING
+	if (poll->ring != NULL) {
+		return http_ring_add(poll->ring, sock, events, data);
+	}
+#endif
+
+	struct epoll_event event;
+	event.events = http_poll_to_epoll(events);
+	event.data.ptr = data;
+
+	return (epoll_ctl(poll->fd, EPOLL_CTL_ADD, sock, &event) == 0);
+}
+
+bool http_poll_modify(struct http_poll_t *poll, socket_t sock, uint32_t events, void *data)
+{
+#ifdef HTTP_POLL_URING
+	if (poll->ring != NULL) {
+		return http_ring_modify(poll->ring, sock, events, data);
+	}
+#endif
+
+	struct epoll_event event;
+	event.events = http_poll_to_epoll(events);
+	event.data.ptr = data;
+
+	return (epoll_ctl(poll->fd, EPOLL_CTL_MOD, sock, &event) == 0);
+}
+
+void http_poll_remove(struct http_poll_t *poll, socket_t sock)
+{
+#ifdef HTTP_POLL_URING
+	if (poll->ring != NULL) {
+		http_ring_remove(poll->ring, sock);
+		return;
+	}
+#endif
+
+	// Kernels older than 2.6.9 require a non-NULL event even though it is ignored.
+	struct epoll_event event;
+	memset(&event, 0, sizeof(event));
+
+	epoll_ctl(poll->fd, EPOLL_CTL_DEL, sock, &event);
+}
+
+bool http_poll_receive(struct http_poll_t *poll, socket_t sock, size_t length)
+{
+#ifdef HTTP_POLL_URING
+	if (poll->ring != NULL) {
+		return http_ring_receive(poll->ring, sock, length);
+	}
+#endif
+
+	// epoll only reports readiness, the data is received by the caller.
+	return false;
+}
+
+void http_poll_submit(struct http_poll_t *poll)
+{
+#ifdef HTTP_POLL_URING
+	if (poll->ring != NULL) {
+		http_ring_submit(poll->ring);
+	}
+#endif
+}
+
+int http_poll_wait(struct http_poll_t *poll, struct http_poll_event_t *events, int max_events, uint32_t timeout)
+{
+#ifdef HTTP_POLL_URING
+	if (poll->ring != NULL) {
+		return http_ring_wait(poll->ring, events, max_events, timeout);
+	}
+#endif
+
+	struct epoll_event ready[256];
+
+	if (max_events > (int)(sizeof(ready) / sizeof(ready[0]))) {
+		max_events = (int)(sizeof(ready) / sizeof(ready[0]));
+	}
+
+	int count = epoll_wait(poll->fd, ready, max_events, timeout != HTTP_POLL_INFINITE ? (int)timeout : -1);
+
+	if (count < 0) {
+		return (errno == EINTR ? 0 : -1);
+	}
+
+	for (int i = 0; i < count; ++i) {
+
+		events[i].data = ready[i].data.ptr;
+		events[i].events = 0;
+
+		if (ready[i].events & EPOLLIN) {
+			events[i].events |= HTTP_POLL_READ;
+		}
+		if (ready[i].events & EPOLLOUT) {
+			events[i].events |= HTTP_POLL_WRITE;
+		}
+		if (ready[i].events & (EPOLLERR | EPOLLHUP | EPOLLRDHUP)) {
+			events[i].events |= HTTP_POLL_ERROR;
+		}
+	}
+
+	return count;
+}
+
+#else
+
+// --------------------------------------------------------------------------------
+
+bool http_poll_create(struct http_poll_t *poll)
+{
+	memset(poll, 0, sizeof(*poll));
+	return true;
+}
+
+bool http_poll_create_ring(struct http_poll_t *poll)
+{
+	return false;
+}
+
+bool http_poll_is_ring(const struct http_poll_t *poll)
+{
+	return false;
+}
+
+int http_poll_get_fd(const struct http_poll_t *poll)
+{
+	return -1;
+}
+
+void http_poll_destroy(struct http_poll_t *poll)
+{
+	free(poll->entries);
+	memset(poll, 0, sizeof(*poll));
+}
+
+static struct http_poll_entry_t *http_poll_find(struct http_poll_t *poll, socket_t sock)
+{
+	for (size_t i = 0; i < poll->entries_len; ++i) {
+		if (poll->entries[i].socket == sock) {
+			return &poll->entries[i];
+		}
+	}
+
+	return NULL;
+}
+
+bool http_poll_add(struct http_poll_t *poll, socket_t sock, uint32_t events, void *data)
+{
+	// select() can't handle more sockets than the size of an fd_set.
+	if (poll->entries_len >= FD_SETSIZE) {
+		return false;
+	}
+
+#ifndef _WIN32
+	// On POSIX systems the descriptor value itself must fit into the set as well.
+	if (sock >= FD_SETSIZE) {
+		return false;
+	}
+#endif
+
+	if (poll->entries_len == poll->entries_size) {
+
+		size_t size = (poll->entries_size != 0 ? 2 * poll->entries_size : 16);
+		struct http_poll_entry_t *entries = realloc(poll->entries, size * sizeof(*entries));
+
+		if (entries == NULL) {
+			return false;
+		}
+
+		poll->entries = entries;
+		poll->entries_size = size;
+	}
+
+	struct http_poll_entry_t *entry = &poll->entries[poll->entries_len++];
+	entry->socket = sock;
+	entry->events = events;
+	entry->data = data;
+
+	return true;
+}
+
+bool http_poll_modify(struct http_poll_t *poll, socket_t sock, uint32_t events, void *data)
+{
+	struct http_poll_entry_t *entry = http_poll_find(poll, sock);
+
+	if (entry == NULL) {
+		return false;
+	}
+
+	entry->events = events;
+	entry->data = data;
+
+	return true;
+}
+
+void http_poll_remove(struct http_poll_t *poll, socket_t sock)
+{
+	struct http_poll_entry_t *entry = http_poll_find(poll, sock);
+
+	if (entry == NULL) {
+		return;
+	}
+
+	// Order of the entries doesn't matter, so move the last entry in place of the removed one.
+	*entry = poll->entries[--poll->entries_len];
+}
+
+bool http_poll_receive(struct http_poll_t *poll, socket_t sock, size_t length)
+{
+	return false;
+}
+
+void http_poll_submit(struct http_poll_t *poll)
+{
+}
+
+int http_poll_wait(struct http_poll_t *poll, struct http_poll_event_t *events, int max_events, uint32_t timeout)
+{
+	fd_set read_set, write_set;
+	FD_ZERO(&read_set);
+	FD_ZERO(&write_set);
+
+	socket_t highest = 0;
+
+	for (size_t i = 0; i < poll->entries_len; ++i) {
+
+		struct http_poll_entry_t *entry = &poll->entries[i];
+
+		if (entry->events & HTTP_POLL_READ) {
+			FD_SET(entry->socket, &read_set);
+		}
+		if (entry->events & HTTP_POLL_WRITE) {
+			FD_SET(entry->socket, &write_set);
+		}
+		if (entry->socket > highest) {
+			highest = entry->socket;
+		}
+	}
+
+	struct timeval tv;
+	tv.tv_sec = (long)(timeout / 1000);
+	tv.tv_usec = 1000L * (long)(timeout % 1000);
+
+	int ready = select((int)(highest + 1), &read_set, &write_set, NULL, timeout != HTTP_POLL_INFINITE ? &tv : NULL);
+
+	if (ready <= 0) {
+		return (ready < 0 && errno != EINTR ? -1 : 0);
+	}
+
+	int count = 0;
+
+	for (size_t i = 0; i < poll->entries_len && count < max_events; ++i) {
+
+		struct http_poll_entry_t *entry = &poll->entries[i];
+		uint32_t flags = 0;
+
+		if (FD_ISSET(entry->socket, &read_set)) {
+			flags |= HTTP_POLL_READ;
+		}
+		if (FD_ISSET(entry->socket, &write_set)) {
+			flags |= HTTP_POLL_WRITE;
+		}
+
+		if (flags != 0) {
+			events[count].data = entry->data;
+			events[count].events = flags;
+			++count;
+		}
+	}
+
+	return count;
+}
+
+#endif
+
+// --------------------------------------------------------------------------------
+
+bool http_poll_wakeup_create(struct http_poll_wakeup_t *wakeup)
+{
+#ifdef __linux__
+	wakeup->read_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	wakeup->write_fd = wakeup->read_fd;
+
+	return (wakeup->read_fd >= 0);
+#else
+	int fds[2];
+
+	if (pipe(fds) != 0) {
+		return false;
+	}
+
+	// Neither end may block, a full pipe already means the reader has been signalled.
+	fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL, 0) | O_NONBLOCK);
+	fcntl(fds[1], F_SETFL, fcntl(fds[1], F_GETFL, 0) | O_NONBLOCK);
+
+	wakeup->read_fd = fds[0];
+	wakeup->write_fd = fds[1];
+
+	return true;
+#endif
+}
+
+void http_poll_wakeup_destroy(struct http_poll_wakeup_t *wakeup)
+{
+	if (wakeup->write_fd != wakeup->read_fd) {
+		close(wakeup->write_fd);
+	}
+
+	close(wakeup->read_fd);
+
+	wakeup->read_fd = -1;
+	wakeup->write_fd = -1;
+}
+
+void http_poll_wakeup_signal(struct http_poll_wakeup_t *wakeup)
+{
+#ifdef __linux__
+	uint64_t value = 1;
+	ssize_t written = write(wakeup->write_fd, &value, sizeof(value));
+#else
+	char value = 1;
+	ssize_t written = write(wakeup->write_fd, &value, sizeof(value));
+#endif
+
+	// The descriptor is already readable if the counter or the pipe is full.
+	(void)written;
+}
+
+void http_poll_wakeup_clear(struct http_poll_wakeup_t *wakeup)
+{
+	char buffer[64];
+
+	while (read(wakeup->read_fd, buffer, sizeof(buffer)) > 0) {
+	}
+}
@@ -0,0 +1,117 @@
+#pragma once
+#ifndef __HTTPPOLL_H
+#define __HTTPPOLL_H
+
+#include "httpsocket.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+// Use epoll on Linux unless the portable select() backend is explicitly requested with -DHTTP_POLL_SELECT.
+#if defined(__linux__) && !defined(HTTP_POLL_SELECT)
+	#define HTTP_POLL_EPOLL
+#endif
+
+// The io_uring backend can be chosen at runtime instead of epoll when the kernel headers define the interface
+// (Linux 5.19 or newer, for multishot accept).
+#if defined(HTTP_POLL_EPOLL) && defined(__has_include)
+	#if __has_include(<linux/io_uring.h>)
+		#include <linux/io_uring.h>
+		#ifdef IORING_ACCEPT_MULTISHOT
+			#define HTTP_POLL_URING
+		#endif
+	#endif
+#endif
+
+#define HTTP_POLL_INFINITE UINT32_MAX	// Timeout which waits until there are events
+
+// --------------------------------------------------------------------------------
+
+enum http_poll_flags_t {
+	HTTP_POLL_READ = 0x1,			// Socket has data to read (or a connection to accept)
+	HTTP_POLL_WRITE = 0x2,			// Socket can be written to
+	HTTP_POLL_ERROR = 0x4,			// Socket has been closed or an error occurred (reported only)
+	HTTP_POLL_ACCEPT = 0x8,			// io_uring only. The backend accepts the connections of a listening socket and reports each new socket
+	HTTP_POLL_RECEIVED = 0x10,		// io_uring only. The backend received data requested with http_poll_receive (reported only)
+};
+
+struct http_poll_event_t {
+	void *data;						// User data given when the socket was registered
+	uint32_t events;				// Combination of http_poll_flags_t values
+	socket_t socket;				// Socket accepted by the backend (HTTP_POLL_ACCEPT)
+	const char *buffer;				// Data received by the backend (HTTP_POLL_RECEIVED), valid until the next wait
+	size_t length;					// Length of the received data. 0 if the connection was closed or failed
+};
+
+struct http_poll_t {
+#ifdef HTTP_POLL_EPOLL
+	int fd;							// epoll instance
+#ifdef HTTP_POLL_URING
+	struct http_ring_t *ring;		// io_uring instance used instead of epoll, NULL when using epoll
+#endif
+#else
+	struct http_poll_entry_t {		// List of registered sockets
+		socket_t socket;
+		uint32_t events;
+		void *data;
+	} *entries;
+
+	size_t entries_len;				// Number of registered sockets
+	size_t entries_size;			// Allocated size of the list
+#endif
+};
+
+// A descriptor which can be signalled from any thread to wake up a thread waiting for events.
+// Uses an eventfd on Linux and a pipe elsewhere.
+struct http_poll_wakeup_t {
+	int read_fd;					// Registered to the event backend, becomes readable when signalled
+	int write_fd;					// Same as read_fd for an eventfd
+};
+
+// --------------------------------------------------------------------------------
+
+// The epoll backend is edge-triggered: after a readiness event the socket must be read or written
+// until it would block, otherwise no further events are delivered for it. The select() backend is
+// level-triggered, so draining sockets is correct for both.
+
+bool http_poll_create(struct http_poll_t *poll);
+void http_poll_destroy(struct http_poll_t *poll);
+
+// Creates a backend which uses io_uring. Registrations and receive requests are queued into the submission ring and
+// submitted together when waiting for events, so the whole batch costs a single system call. Returns false if
+// the kernel doesn't support the features needed (Linux 5.19), in which case http_poll_create can be used instead.
+bool http_poll_create_ring(struct http_poll_t *poll);
+
+// Returns true if the backend was created with http_poll_create_ring.
+bool http_poll_is_ring(const struct http_poll_t *poll);
+
+// Returns a descriptor which becomes readable when the backend has events to report, so the backend can be watched
+// by another event loop. Returns -1 if the backend has no such descriptor (select()).
+int http_poll_get_fd(const struct http_poll_t *poll);
+
+bool http_poll_add(struct http_poll_t *poll, socket_t sock, uint32_t events, void *data);
+bool http_poll_modify(struct http_poll_t *poll, socket_t sock, uint32_t events, void *data);
+void http_poll_remove(struct http_poll_t *poll, socket_t sock);
+
+// io_uring only. Asks the backend to receive up to length bytes from a registered socket into one of its buffers.
+// The data is reported once with an HTTP_POLL_RECEIVED event. Asking again before that has no effect.
+bool http_poll_receive(struct http_poll_t *poll, socket_t sock, size_t length);
+
+// io_uring only. Submits the queued requests without waiting. They are otherwise submitted when waiting for events,
+// so this is needed when the backend is watched through its descriptor instead.
+void http_poll_submit(struct http_poll_t *poll);
+
+// Waits until at least one registered socket is ready or the timeout (in milliseconds, or HTTP_POLL_INFINITE) expires.
+// Returns the number of events stored in the list, or -1 on failure.
+int http_poll_wait(struct http_poll_t *poll, struct http_poll_event_t *events, int max_events, uint32_t timeout);
+
+bool http_poll_wakeup_create(struct http_poll_wakeup_t *wakeup);
+void http_poll_wakeup_destroy(struct http_poll_wakeup_t *wakeup);
+
+// Makes the wakeup descriptor readable. Can be called from any thread.
+void http_poll_wakeup_signal(struct http_poll_wakeup_t *wakeup);
+
+// Resets the descriptor after it has been signalled. Call this before handling whatever the signal was about,
+// so a signal arriving during the handling isn't lost.
+void http_poll_wakeup_clear(struct http_poll_wakeup_t *wakeup);
+
+#endif
@@ -0,0 +1,93 @@
+#include "httppool.h"
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+// Objects are aligned like malloc would align them on common 64-bit platforms.
+#define HTTP_POOL_ALIGNMENT 16
+
+// --------------------------------------------------------------------------------
+
+struct http_pool_slab_t {
+	struct http_pool_slab_t *next;
+};
+
+// --------------------------------------------------------------------------------
+
+static bool http_pool_grow(struct http_pool_t *pool, size_t objects);
+
+// --------------------------------------------------------------------------------
+
+bool http_pool_create(struct http_pool_t *pool, size_t object_size, size_t preallocate, size_t slab_len)
+{
+	memset(pool, 0, sizeof(*pool));
+
+	// Every object must be able to hold the free list link.
+	if (object_size < sizeof(void *)) {
+		object_size = sizeof(void *);
+	}
+
+	pool->object_size = (object_size + HTTP_POOL_ALIGNMENT - 1) & ~(size_t)(HTTP_POOL_ALIGNMENT - 1);
+	pool->slab_len = (slab_len != 0 ? slab_len : 1);
+
+	return (preallocate == 0 || http_pool_grow(pool, preallocate));
+}
+
+void http_pool_destroy(struct http_pool_t *pool)
+{
+	while (pool->slabs != NULL) {
+
+		struct http_pool_slab_t *slab = pool->slabs;
+		pool->slabs = slab->next;
+
+		free(slab);
+	}
+
+	memset(pool, 0, sizeof(*pool));
+}
+
+void *http_pool_alloc(struct http_pool_t *pool)
+{
+	if (pool->free_objects == NULL && !http_pool_grow(pool, pool->slab_len)) {
+		return NULL;
+	}
+
+	void *object = pool->free_objects;
+	pool->free_objects = *(void **)object;
+
+	return object;
+}
+
+void http_pool_free(struct http_pool_t *pool, void *object)
+{
+	*(void **)object = pool->free_objects;
+	pool->free_objects = object;
+}
+
+static bool http_pool_grow(struct http_pool_t *pool, size_t objects)
+{
+	// The slab header is padded so the objects after it stay aligned.
+	size_t header_size = (sizeof(struct http_pool_slab_t) + HTTP_POOL_ALIGNMENT - 1) & ~(size_t)(HTTP_POOL_ALIGNMENT - 1);
+
+	if (objects > (SIZE_MAX - header_size) / pool->object_size) {
+		return false;
+	}
+
+	struct http_pool_slab_t *slab = malloc(header_size + objects * pool->object_size);
+
+	if (slab == NULL) {
+		return false;
+	}
+
+	slab->next = pool->slabs;
+	pool->slabs = slab;
+
+	// Add the new objects to the free list, in order so the first allocations are next to each other in memory.
+	char *first = (char *)slab + header_size;
+
+	for (size_t i = objects; i > 0; --i) {
+		http_pool_free(pool, &first[(i - 1) * pool->object_size]);
+	}
+
+	return true;
+}
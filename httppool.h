@@ -0,0 +1,34 @@
+#pragma once
+#ifndef __HTTPPOOL_H
+#define __HTTPPOOL_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+// --------------------------------------------------------------------------------
+
+// A pool of fixed size objects. Objects are allocated from larger slabs and freed objects are kept
+// on a free list for reuse, so allocating and freeing an object doesn't go through malloc. The slabs
+// are only released when the pool is destroyed.
+// The pool is not thread safe, each event loop has its own.
+struct http_pool_t {
+	size_t object_size;				// Size of a single object
+	size_t slab_len;				// Number of objects allocated at once when the pool runs out
+	void *free_objects;				// Objects which are available for allocation, linked through their first bytes
+	struct http_pool_slab_t *slabs;	// All memory allocated by the pool
+};
+
+// --------------------------------------------------------------------------------
+
+// Creates a pool with room for the given number of objects up front. More objects are allocated in slabs
+// of slab_len objects when needed.
+bool http_pool_create(struct http_pool_t *pool, size_t object_size, size_t preallocate, size_t slab_len);
+void http_pool_destroy(struct http_pool_t *pool);
+
+// Allocates an object from the pool. The contents of the object are undefined. Returns NULL if out of memory.
+void *http_pool_alloc(struct http_pool_t *pool);
+
+// Returns an object to the pool.
+void http_pool_free(struct http_pool_t *pool, void *object);
+
+#endif
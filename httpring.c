@@ -0,0 +1,701 @@
+#include "httpring.h"
+
+#ifdef HTTP_POLL_URING
+
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <poll.h>
+#include <signal.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <unistd.h>
+
+#define HTTP_RING_BUFFER_GROUP 0
+#define HTTP_RING_GENERATION_MASK 0xffffff
+
+// The type of a request, the generation of the socket's registration and the socket are packed into
+// the user data of the request, so a completion can be matched to the registration it belongs to.
+#define HTTP_RING_USER_DATA(op, generation, sock) \
+	(((uint64_t)(op) << 56) | ((uint64_t)((generation) & HTTP_RING_GENERATION_MASK) << 32) | (uint64_t)(uint32_t)(sock))
+
+// --------------------------------------------------------------------------------
+
+enum http_ring_op_t {
+	HTTP_RING_POLL = 1,				// Multishot poll of a socket registered for reading or writing
+	HTTP_RING_ACCEPT,				// Multishot accept of a listening socket
+	HTTP_RING_RECEIVE,				// Receive into a provided buffer
+	HTTP_RING_CANCEL,				// Cancellation or update of another request, the result is not needed
+};
+
+// A registered socket, indexed by the descriptor.
+struct http_ring_entry_t {
+	void *data;
+	uint32_t events;				// Registered http_poll_flags_t
+	uint32_t generation;			// Incremented when the socket is removed, so the late completions of its requests are ignored
+	bool registered;
+	bool polling;					// Whether the multishot poll is active
+	bool accepting;					// Whether the multishot accept is active
+	bool receiving;					// Whether a receive is in flight
+	uint32_t receive_length;		// Number of bytes the receive asks for
+};
+
+struct http_ring_t {
+	int fd;
+
+	// Submission queue, shared with the kernel.
+	void *sq_map;
+	size_t sq_map_size;
+	uint32_t *sq_head;
+	uint32_t *sq_tail;
+	uint32_t *sq_array;
+	uint32_t sq_mask;
+	uint32_t sq_entries;
+	struct io_uring_sqe *sqes;
+	size_t sqes_size;
+
+	// Completion queue. Shares the mapping of the submission queue.
+	uint32_t *cq_head;
+	uint32_t *cq_tail;
+	uint32_t cq_mask;
+	struct io_uring_cqe *cqes;
+
+	// Buffers the kernel receives data into.
+	struct io_uring_buf_ring *buffer_ring;
+	size_t buffer_ring_size;
+	uint16_t buffer_tail;
+	char *buffers;
+	uint16_t delivered[HTTP_RING_BUFFERS]; // Buffers whose data has been reported, given back to the kernel on the next wait
+	size_t delivered_len;
+
+	struct http_ring_entry_t *entries;
+	size_t entries_len;
+};
+
+// --------------------------------------------------------------------------------
+
+static int http_ring_enter(int fd, uint32_t to_submit, uint32_t min_complete, uint32_t flags, void *arg, size_t arg_size);
+static struct http_ring_entry_t *http_ring_get_entry(struct http_ring_t *ring, socket_t sock, bool create);
+static struct io_uring_sqe *http_ring_get_sqe(struct http_ring_t *ring);
+static bool http_ring_queue_poll(struct http_ring_t *ring, socket_t sock, struct http_ring_entry_t *entry);
+static bool http_ring_queue_accept(struct http_ring_t *ring, socket_t sock, struct http_ring_entry_t *entry);
+static bool http_ring_queue_cancel(struct http_ring_t *ring, uint8_t opcode, uint64_t target);
+static uint32_t http_ring_to_poll(uint32_t events);
+static void http_ring_provide_buffer(struct http_ring_t *ring, uint16_t id);
+static bool http_ring_complete(struct http_ring_t *ring, const struct io_uring_cqe *cqe, struct http_poll_event_t *event);
+
+// --------------------------------------------------------------------------------
+
+struct http_ring_t *http_ring_create(void)
+{
+	struct http_ring_t *ring = calloc(1, sizeof(*ring));
+
+	if (ring == NULL) {
+		return NULL;
+	}
+
+	// Multishot requests complete any number of times per submission, so the completion queue is made larger.
+	// Completions are only processed when waiting for them, so the kernel doesn't need to interrupt the loop.
+	struct io_uring_params params;
+	memset(&params, 0, sizeof(params));
+
+	params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_COOP_TASKRUN;
+	params.cq_entries = 4 * HTTP_RING_ENTRIES;
+
+	ring->fd = (int)syscall(__NR_io_uring_setup, HTTP_RING_ENTRIES, &params);
+
+	uint32_t features = IORING_FEAT_SINGLE_MMAP | IORING_FEAT_NODROP | IORING_FEAT_EXT_ARG;
+
+	if (ring->fd < 0 || (params.features & features) != features) {
+		http_ring_destroy(ring);
+		return NULL;
+	}
+
+	// Both queues are in the same mapping.
+	size_t sq_size = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+	size_t cq_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+
+	ring->sq_map_size = (sq_size > cq_size ? sq_size : cq_size);
+	ring->sq_map = mmap(NULL, ring->sq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+
+	if (ring->sq_map == MAP_FAILED) {
+		ring->sq_map = NULL;
+		http_ring_destroy(ring);
+		return NULL;
+	}
+
+	ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+	ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+
+	if (ring->sqes == MAP_FAILED) {
+		ring->sqes = NULL;
+		http_ring_destroy(ring);
+		return NULL;
+	}
+
+	char *map = ring->sq_map;
+
+	ring->sq_head = (uint32_t *)(map + params.sq_off.head);
+	ring->sq_tail = (uint32_t *)(map + params.sq_off.tail);
+	ring->sq_array = (uint32_t *)(map + params.sq_off.array);
+	ring->sq_mask = *(uint32_t *)(map + params.sq_off.ring_mask);
+	ring->sq_entries = params.sq_entries;
+
+	ring->cq_head = (uint32_t *)(map + params.cq_off.head);
+	ring->cq_tail = (uint32_t *)(map + params.cq_off.tail);
+	ring->cq_mask = *(uint32_t *)(map + params.cq_off.ring_mask);
+	ring->cqes = (struct io_uring_cqe *)(map + params.cq_off.cqes);
+
+	// Register the ring of receive buffers (Linux 5.19). The ring has to be page aligned.
+	ring->buffer_ring_size = HTTP_RING_BUFFERS * sizeof(struct io_uring_buf);
+	ring->buffer_ring = mmap(NULL, ring->buffer_ring_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+	if (ring->buffer_ring == MAP_FAILED) {
+		ring->buffer_ring = NULL;
+		http_ring_destroy(ring);
+		return NULL;
+	}
+
+	ring->buffers = malloc((size_t)HTTP_RING_BUFFERS * HTTP_RING_BUFFER_SIZE);
+
+	struct io_uring_buf_reg registration;
+	memset(&registration, 0, sizeof(registration));
+
+	registration.ring_addr = (uint64_t)(uintptr_t)ring->buffer_ring;
+	registration.ring_entries = HTTP_RING_BUFFERS;
+	registration.bgid = HTTP_RING_BUFFER_GROUP;
+
+	if (ring->buffers == NULL ||
+		syscall(__NR_io_uring_register, ring->fd, IORING_REGISTER_PBUF_RING, &registration, 1) != 0) {
+
+		http_ring_destroy(ring);
+		return NULL;
+	}
+
+	for (uint16_t i = 0; i < HTTP_RING_BUFFERS; ++i) {
+		http_ring_provide_buffer(ring, i);
+	}
+
+	return ring;
+}
+
+void http_ring_destroy(struct http_ring_t *ring)
+{
+	if (ring == NULL) {
+		return;
+	}
+
+	// Close the connections which were accepted but never reported.
+	if (ring->cqes != NULL) {
+
+		uint32_t tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+
+		for (uint32_t head = *ring->cq_head; head != tail; ++head) {
+
+			const struct io_uring_cqe *cqe = &ring->cqes[head & ring->cq_mask];
+
+			if ((cqe->user_data >> 56) == HTTP_RING_ACCEPT && cqe->res >= 0) {
+				close(cqe->res);
+			}
+		}
+	}
+
+	// Closing the ring cancels every request still in flight.
+	if (ring->fd >= 0) {
+		close(ring->fd);
+	}
+
+	if (ring->sq_map != NULL) {
+		munmap(ring->sq_map, ring->sq_map_size);
+	}
+
+	if (ring->sqes != NULL) {
+		munmap(ring->sqes, ring->sqes_size);
+	}
+
+	if (ring->buffer_ring != NULL) {
+		munmap(ring->buffer_ring, ring->buffer_ring_size);
+	}
+
+	free(ring->buffers);
+	free(ring->entries);
+	free(ring);
+}
+
+bool http_ring_add(struct http_ring_t *ring, socket_t sock, uint32_t events, void *data)
+{
+	struct http_ring_entry_t *entry = http_ring_get_entry(ring, sock, true);
+
+	if (entry == NULL || entry->registered) {
+		return false;
+	}
+
+	entry->registered = true;
+	entry->data = data;
+	entry->events = events;
+
+	bool queued = true;
+
+	if (events & HTTP_POLL_ACCEPT) {
+		queued = http_ring_queue_accept(ring, sock, entry);
+	}
+	else if (events & (HTTP_POLL_READ | HTTP_POLL_WRITE)) {
+		queued = http_ring_queue_poll(ring, sock, entry);
+	}
+
+	if (!queued) {
+		entry->registered = false;
+	}
+
+	return queued;
+}
+
+bool http_ring_modify(struct http_ring_t *ring, socket_t sock, uint32_t events, void *data)
+{
+	struct http_ring_entry_t *entry = http_ring_get_entry(ring, sock, false);
+
+	if (entry == NULL || !entry->registered) {
+		return false;
+	}
+
+	uint32_t previous = (entry->events & (HTTP_POLL_READ | HTTP_POLL_WRITE));
+	uint32_t current = (events & (HTTP_POLL_READ | HTTP_POLL_WRITE));
+
+	entry->data = data;
+	entry->events = (entry->events & HTTP_POLL_ACCEPT) | current;
+
+	if (current == previous) {
+		return true;
+	}
+
+	if (!entry->polling) {
+		return (current == 0 || http_ring_queue_poll(ring, sock, entry));
+	}
+
+	uint64_t user_data = HTTP_RING_USER_DATA(HTTP_RING_POLL, entry->generation, sock);
+
+	if (current == 0) {
+		return http_ring_queue_cancel(ring, IORING_OP_POLL_REMOVE, user_data);
+	}
+
+	// Change the events of the active poll. If the poll ends before the update reaches it,
+	// it's started again with the new events once its last completion arrives.
+	struct io_uring_sqe *sqe = http_ring_get_sqe(ring);
+
+	if (sqe == NULL) {
+		return false;
+	}
+
+	sqe->opcode = IORING_OP_POLL_REMOVE;
+	sqe->fd = -1;
+	sqe->addr = user_data;
+	sqe->len = IORING_POLL_UPDATE_EVENTS | IORING_POLL_ADD_MULTI;
+	sqe->poll32_events = http_ring_to_poll(current);
+	sqe->user_data = HTTP_RING_USER_DATA(HTTP_RING_CANCEL, 0, 0);
+
+	return true;
+}
+
+void http_ring_remove(struct http_ring_t *ring, socket_t sock)
+{
+	struct http_ring_entry_t *entry = http_ring_get_entry(ring, sock, false);
+
+	if (entry == NULL || !entry->registered) {
+		return;
+	}
+
+	// Cancel the requests which are still active. Whatever they complete with is ignored from now on.
+	uint32_t generation = entry->generation;
+
+	if (entry->polling) {
+		http_ring_queue_cancel(ring, IORING_OP_POLL_REMOVE, HTTP_RING_USER_DATA(HTTP_RING_POLL, generation, sock));
+	}
+	if (entry->accepting) {
+		http_ring_queue_cancel(ring, IORING_OP_ASYNC_CANCEL, HTTP_RING_USER_DATA(HTTP_RING_ACCEPT, generation, sock));
+	}
+	if (entry->receiving) {
+		http_ring_queue_cancel(ring, IORING_OP_ASYNC_CANCEL, HTTP_RING_USER_DATA(HTTP_RING_RECEIVE, generation, sock));
+	}
+
+	memset(entry, 0, sizeof(*entry));
+	entry->generation = generation + 1;
+}
+
+bool http_ring_receive(struct http_ring_t *ring, socket_t sock, size_t length)
+{
+	struct http_ring_entry_t *entry = http_ring_get_entry(ring, sock, false);
+
+	if (entry == NULL || !entry->registered) {
+		return false;
+	}
+
+	if (entry->receiving) {
+		return true;
+	}
+
+	struct io_uring_sqe *sqe = http_ring_get_sqe(ring);
+
+	if (sqe == NULL) {
+		return false;
+	}
+
+	// The kernel picks a buffer once there is data, so a connection holds no buffer while waiting.
+	// The length can be smaller than a buffer to leave the rest of the data in the socket.
+	entry->receive_length = (uint32_t)(length < HTTP_RING_BUFFER_SIZE ? length : HTTP_RING_BUFFER_SIZE);
+
+	sqe->opcode = IORING_OP_RECV;
+	sqe->fd = sock;
+	sqe->len = entry->receive_length;
+	sqe->flags = IOSQE_BUFFER_SELECT;
+	sqe->buf_group = HTTP_RING_BUFFER_GROUP;
+	sqe->user_data = HTTP_RING_USER_DATA(HTTP_RING_RECEIVE, entry->generation, sock);
+
+	entry->receiving = true;
+	return true;
+}
+
+int http_ring_get_fd(const struct http_ring_t *ring)
+{
+	return ring->fd;
+}
+
+bool http_ring_submit(struct http_ring_t *ring)
+{
+	uint32_t pending = *ring->sq_tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+
+	if (pending == 0) {
+		return true;
+	}
+
+	while (http_ring_enter(ring->fd, pending, 0, 0, NULL, 0) < 0) {
+
+		if (errno != EINTR) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+int http_ring_wait(struct http_ring_t *ring, struct http_poll_event_t *events, int max_events, uint32_t timeout)
+{
+	// The data of the previous events has been handled by now.
+	for (size_t i = 0; i < ring->delivered_len; ++i) {
+		http_ring_provide_buffer(ring, ring->delivered[i]);
+	}
+
+	ring->delivered_len = 0;
+
+	// Submit the queued requests and wait for completions in the same call. If there are completions
+	// left over from the previous call, only submit.
+	struct __kernel_timespec ts;
+	ts.tv_sec = timeout / 1000;
+	ts.tv_nsec = 1000000LL * (timeout % 1000);
+
+	struct io_uring_getevents_arg arg;
+	memset(&arg, 0, sizeof(arg));
+
+	arg.sigmask_sz = _NSIG / 8;
+	arg.ts = (timeout != HTTP_POLL_INFINITE ? (uint64_t)(uintptr_t)&ts : 0);
+
+	uint32_t pending = *ring->sq_tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+	bool completed = (__atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE) != *ring->cq_head);
+
+	if (http_ring_enter(ring->fd, pending, completed ? 0 : 1, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg)) < 0 &&
+		errno != ETIME && errno != EINTR && errno != EBUSY && errno != EAGAIN) {
+
+		return -1;
+	}
+
+	// Each completion becomes at most one event. Completions which don't fit are left for the next call.
+	int count = 0;
+
+	uint32_t head = *ring->cq_head;
+	uint32_t tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+
+	for (; head != tail && count < max_events; ++head) {
+
+		if (http_ring_complete(ring, &ring->cqes[head & ring->cq_mask], &events[count])) {
+			++count;
+		}
+	}
+
+	__atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+
+	return count;
+}
+
+static int http_ring_enter(int fd, uint32_t to_submit, uint32_t min_complete, uint32_t flags, void *arg, size_t arg_size)
+{
+	return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, arg, arg_size);
+}
+
+static struct http_ring_entry_t *http_ring_get_entry(struct http_ring_t *ring, socket_t sock, bool create)
+{
+	if (sock < 0) {
+		return NULL;
+	}
+
+	if ((size_t)sock >= ring->entries_len) {
+
+		if (!create) {
+			return NULL;
+		}
+
+		size_t length = (ring->entries_len != 0 ? 2 * ring->entries_len : 64);
+
+		while (length <= (size_t)sock) {
+			length *= 2;
+		}
+
+		struct http_ring_entry_t *entries = realloc(ring->entries, length * sizeof(*entries));
+
+		if (entries == NULL) {
+			return NULL;
+		}
+
+		memset(&entries[ring->entries_len], 0, (length - ring->entries_len) * sizeof(*entries));
+
+		ring->entries = entries;
+		ring->entries_len = length;
+	}
+
+	return &ring->entries[sock];
+}
+
+static struct io_uring_sqe *http_ring_get_sqe(struct http_ring_t *ring)
+{
+	uint32_t tail = *ring->sq_tail;
+
+	// Submit the queue to make room when it's full.
+	if (tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE) >= ring->sq_entries &&
+		(!http_ring_submit(ring) || tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE) >= ring->sq_entries)) {
+
+		return NULL;
+	}
+
+	uint32_t index = (tail & ring->sq_mask);
+
+	struct io_uring_sqe *sqe = &ring->sqes[index];
+	memset(sqe, 0, sizeof(*sqe));
+
+	// The kernel only reads the queue during io_uring_enter, so the entry can be published before it's filled in.
+	ring->sq_array[index] = index;
+	__atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+	return sqe;
+}
+
+static bool http_ring_queue_poll(struct http_ring_t *ring, socket_t sock, struct http_ring_entry_t *entry)
+{
+	struct io_uring_sqe *sqe = http_ring_get_sqe(ring);
+
+	if (sqe == NULL) {
+		return false;
+	}
+
+	// A multishot poll completes every time the socket becomes ready, like an edge-triggered epoll registration.
+	sqe->opcode = IORING_OP_POLL_ADD;
+	sqe->fd = sock;
+	sqe->len = IORING_POLL_ADD_MULTI;
+	sqe->poll32_events = http_ring_to_poll(entry->events);
+	sqe->user_data = HTTP_RING_USER_DATA(HTTP_RING_POLL, entry->generation, sock);
+
+	entry->polling = true;
+	return true;
+}
+
+static bool http_ring_queue_accept(struct http_ring_t *ring, socket_t sock, struct http_ring_entry_t *entry)
+{
+	struct io_uring_sqe *sqe = http_ring_get_sqe(ring);
+
+	if (sqe == NULL) {
+		return false;
+	}
+
+	// Accepted sockets are made non-blocking by the kernel.
+	sqe->opcode = IORING_OP_ACCEPT;
+	sqe->fd = sock;
+	sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+	sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+	sqe->user_data = HTTP_RING_USER_DATA(HTTP_RING_ACCEPT, entry->generation, sock);
+
+	entry->accepting = true;
+	return true;
+}
+
+static bool http_ring_queue_cancel(struct http_ring_t *ring, uint8_t opcode, uint64_t target)
+{
+	struct io_uring_sqe *sqe = http_ring_get_sqe(ring);
+
+	if (sqe == NULL) {
+		return false;
+	}
+
+	sqe->opcode = opcode;
+	sqe->fd = -1;
+	sqe->addr = target;
+	sqe->user_data = HTTP_RING_USER_DATA(HTTP_RING_CANCEL, 0, 0);
+
+	return true;
+}
+
+static uint32_t http_ring_to_poll(uint32_t events)
+{
+	uint32_t mask = 0;
+
+	if (events & HTTP_POLL_READ) {
+		mask |= POLLIN;
+	}
+	if (events & HTTP_POLL_WRITE) {
+		mask |= POLLOUT;
+	}
+
+	// The kernel reads the mask as two 16-bit halves.
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	mask = (mask << 16) | (mask >> 16);
+#endif
+
+	return mask;
+}
+
+static void http_ring_provide_buffer(struct http_ring_t *ring, uint16_t id)
+{
+	struct io_uring_buf *buffer = &ring->buffer_ring->bufs[ring->buffer_tail & (HTTP_RING_BUFFERS - 1)];
+
+	buffer->addr = (uint64_t)(uintptr_t)&ring->buffers[(size_t)id * HTTP_RING_BUFFER_SIZE];
+	buffer->len = HTTP_RING_BUFFER_SIZE;
+	buffer->bid = id;
+
+	__atomic_store_n(&ring->buffer_ring->tail, ++ring->buffer_tail, __ATOMIC_RELEASE);
+}
+
+static bool http_ring_complete(struct http_ring_t *ring, const struct io_uring_cqe *cqe, struct http_poll_event_t *event)
+{
+	enum http_ring_op_t op = (enum http_ring_op_t)(cqe->user_data >> 56);
+	uint32_t generation = (uint32_t)(cqe->user_data >> 32) & HTTP_RING_GENERATION_MASK;
+	socket_t sock = (socket_t)(uint32_t)cqe->user_data;
+
+	bool more = ((cqe->flags & IORING_CQE_F_MORE) != 0);
+
+	// Completions for a registration which has been removed since are dropped.
+	struct http_ring_entry_t *entry = (op != HTTP_RING_CANCEL ? http_ring_get_entry(ring, sock, false) : NULL);
+
+	if (entry != NULL && (!entry->registered || (entry->generation & HTTP_RING_GENERATION_MASK) != generation)) {
+		entry = NULL;
+	}
+
+	memset(event, 0, sizeof(*event));
+	event->socket = -1;
+
+	switch (op) {
+
+	case HTTP_RING_RECEIVE: {
+
+		bool has_buffer = ((cqe->flags & IORING_CQE_F_BUFFER) != 0);
+		uint16_t id = (uint16_t)(cqe->flags >> IORING_CQE_BUFFER_SHIFT);
+
+		if (entry == NULL || cqe->res <= 0) {
+
+			if (has_buffer) {
+				http_ring_provide_buffer(ring, id);
+			}
+
+			if (entry == NULL) {
+				return false;
+			}
+		}
+
+		entry->receiving = false;
+
+		// All of the buffers are in use, try again once the data of this batch has been handled.
+		if (cqe->res == -ENOBUFS) {
+			http_ring_receive(ring, sock, entry->receive_length);
+			return false;
+		}
+
+		event->data = entry->data;
+		event->events = HTTP_POLL_RECEIVED;
+
+		if (cqe->res > 0 && has_buffer) {
+
+			event->buffer = &ring->buffers[(size_t)id * HTTP_RING_BUFFER_SIZE];
+			event->length = (size_t)cqe->res;
+
+			ring->delivered[ring->delivered_len++] = id;
+		}
+		else {
+			event->events |= HTTP_POLL_ERROR;
+		}
+
+		return true;
+	}
+
+	case HTTP_RING_ACCEPT:
+
+		if (entry == NULL) {
+
+			if (cqe->res >= 0) {
+				close(cqe->res);
+			}
+
+			return false;
+		}
+
+		// The accept stops after an error, start it again.
+		if (!more) {
+			entry->accepting = false;
+			http_ring_queue_accept(ring, sock, entry);
+		}
+
+		if (cqe->res < 0) {
+			return false;
+		}
+
+		event->data = entry->data;
+		event->events = HTTP_POLL_ACCEPT;
+		event->socket = cqe->res;
+
+		return true;
+
+	case HTTP_RING_POLL:
+
+		if (entry == NULL) {
+			return false;
+		}
+
+		// A poll may stop, e.g. when it has been cancelled or the completion queue overflows. Start it again
+		// if the socket is still supposed to be polled.
+		if (!more) {
+
+			entry->polling = false;
+
+			if (entry->events & (HTTP_POLL_READ | HTTP_POLL_WRITE)) {
+				http_ring_queue_poll(ring, sock, entry);
+			}
+		}
+
+		if (cqe->res < 0) {
+			return false;
+		}
+
+		event->data = entry->data;
+
+		if (cqe->res & POLLIN) {
+			event->events |= HTTP_POLL_READ;
+		}
+		if (cqe->res & POLLOUT) {
+			event->events |= HTTP_POLL_WRITE;
+		}
+		if (cqe->res & (POLLERR | POLLHUP)) {
+			event->events |= HTTP_POLL_ERROR;
+		}
+
+		return true;
+
+	default:
+		return false;
+	}
+}
+
+#endif
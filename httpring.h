@@ -0,0 +1,46 @@
+#pragma once
+#ifndef __HTTPRING_H
+#define __HTTPRING_H
+
+#include "httppoll.h"
+
+#ifdef HTTP_POLL_URING
+
+#define HTTP_RING_ENTRIES 256
+#define HTTP_RING_BUFFERS 256
+#define HTTP_RING_BUFFER_SIZE 4096
+
+// --------------------------------------------------------------------------------
+
+// The io_uring event backend, used through httppoll. Sockets registered for reading or writing are watched
+// with multishot polls, listening sockets with a multishot accept, and data is received into a ring of buffers
+// provided to the kernel up front, so idle connections don't need buffers of their own. Everything is submitted
+// in batches when waiting for events. The interface is used through raw system calls, so the only requirement
+// is a kernel which supports it.
+struct http_ring_t;
+
+// --------------------------------------------------------------------------------
+
+// Creates the rings. Returns NULL if io_uring is not supported or is missing a feature the backend relies on.
+struct http_ring_t *http_ring_create(void);
+void http_ring_destroy(struct http_ring_t *ring);
+
+bool http_ring_add(struct http_ring_t *ring, socket_t sock, uint32_t events, void *data);
+bool http_ring_modify(struct http_ring_t *ring, socket_t sock, uint32_t events, void *data);
+void http_ring_remove(struct http_ring_t *ring, socket_t sock);
+
+bool http_ring_receive(struct http_ring_t *ring, socket_t sock, size_t length);
+
+// The ring's descriptor, which is readable when there are completions to reap.
+int http_ring_get_fd(const struct http_ring_t *ring);
+
+// Submits the queued requests without waiting for completions. Returns false if the kernel refused them.
+bool http_ring_submit(struct http_ring_t *ring);
+
+// Submits the queued requests and waits for completions. The buffers of the received data are given back
+// to the kernel on the next call.
+int http_ring_wait(struct http_ring_t *ring, struct http_poll_event_t *events, int max_events, uint32_t timeout);
+
+#endif
+
+#endif
@@ -0,0 +1,461 @@
+#include "httprouter.h"
+#include <string.h>
+#include <stdlib.h>
+
+// --------------------------------------------------------------------------------
+
+static struct http_route_node_t *http_router_insert(struct http_router_t *router, const char *pattern, bool literal);
+static struct http_route_node_t *http_router_create_node(const char *label, size_t label_len);
+static bool http_router_add_child(struct http_route_node_t *node, struct http_route_node_t *child);
+static bool http_router_split_node(struct http_route_node_t *node, size_t at);
+static struct http_route_node_t *http_router_get_child(const struct http_route_node_t *node, char c);
+static const struct http_route_t *http_router_match(const struct http_route_node_t *node, const char *method, const char *path, const char *end,
+	struct http_router_param_t *params, size_t *params_len);
+static const struct http_route_t *http_router_get_route(const struct http_route_node_t *node, const char *method);
+static void http_router_free_node(struct http_route_node_t *node);
+
+// --------------------------------------------------------------------------------
+
+void http_router_create(struct http_router_t *router)
+{
+	router->root = NULL;
+	router->routes = NULL;
+	router->routes_len = 0;
+}
+
+void http_router_destroy(struct http_router_t *router)
+{
+	if (router->root != NULL) {
+		http_router_free_node(router->root);
+		router->root = NULL;
+	}
+
+	free(router->routes);
+
+	router->routes = NULL;
+	router->routes_len = 0;
+}
+
+bool http_router_add_route(struct http_router_t *router, const char *method, const char *pattern,
+	handle_request_t handler, handle_body_t body_handler, void *context)
+{
+	if (pattern == NULL || *pattern != '/' || handler == NULL) {
+		return false;
+	}
+
+	struct http_route_node_t *node = http_router_insert(router, pattern, false);
+
+	if (node == NULL) {
+		return false;
+	}
+
+	// Only one handler per method and pattern.
+	for (struct http_route_t *route = node->routes; route != NULL; route = route->next) {
+
+		if ((route->method == NULL && method == NULL) ||
+			(route->method != NULL && method != NULL && strcmp(route->method, method) == 0)) {
+			return false;
+		}
+	}
+
+	struct http_route_t *route = malloc(sizeof(*route));
+	struct http_route_t **routes = realloc(router->routes, (router->routes_len + 1) * sizeof(*routes));
+
+	if (routes != NULL) {
+		router->routes = routes;
+	}
+
+	if (route == NULL || routes == NULL) {
+		free(route);
+		return false;
+	}
+
+	route->method = NULL;
+	route->pattern = strdup(pattern);
+
+	if (route->pattern == NULL || (method != NULL && (route->method = strdup(method)) == NULL)) {
+		free(route->pattern);
+		free(route);
+		return false;
+	}
+
+	route->index = router->routes_len;
+	router->routes[router->routes_len++] = route;
+
+	route->handler = handler;
+	route->body_handler = body_handler;
+	route->context = context;
+	route->next = node->routes;
+
+	node->routes = route;
+
+	return true;
+}
+
+bool http_router_add_directory(struct http_router_t *router, const char *path, void *directory)
+{
+	if (path == NULL || directory == NULL) {
+		return false;
+	}
+
+	// Directory paths are matched as plain prefixes, they can't have parameters.
+	struct http_route_node_t *node = http_router_insert(router, path, true);
+
+	if (node == NULL || node->directory != NULL) {
+		return false;
+	}
+
+	node->directory = directory;
+	return true;
+}
+
+const struct http_route_t *http_router_find(const struct http_router_t *router, const char *method, const char *path, size_t length,
+	struct http_router_param_t *params, size_t *params_len)
+{
+	*params_len = 0;
+
+	if (router->root == NULL) {
+		return NULL;
+	}
+
+	return http_router_match(router->root, method, path, &path[length], params, params_len);
+}
+
+void *http_router_find_directory(const struct http_router_t *router, const char *path, size_t length)
+{
+	const struct http_route_node_t *node = router->root;
+	const char *end = &path[length];
+
+	if (node == NULL) {
+		return NULL;
+	}
+
+	void *directory = node->directory;
+
+	// Follow the static labels as far as they match the path. The deepest directory on the way has the longest path.
+	while (path < end) {
+
+		node = http_router_get_child(node, *path);
+
+		if (node == NULL ||
+			(size_t)(end - path) < node->label_len ||
+			memcmp(path, node->label, node->label_len) != 0) {
+			break;
+		}
+
+		path += node->label_len;
+
+		if (node->directory != NULL) {
+			directory = node->directory;
+		}
+	}
+
+	return directory;
+}
+
+static struct http_route_node_t *http_router_insert(struct http_router_t *router, const char *pattern, bool literal)
+{
+	if (router->root == NULL && (router->root = http_router_create_node("", 0)) == NULL) {
+		return NULL;
+	}
+
+	struct http_route_node_t *node = router->root;
+	const char *c = pattern;
+
+	#define IS_PARAMETER(p) (!literal && (*(p) == ':' || *(p) == '*') && (p) > pattern && (p)[-1] == '/')
+
+	while (*c != 0) {
+
+		// A parameter or a wildcard, which lasts until the end of the segment.
+		if (IS_PARAMETER(c)) {
+
+			bool wildcard = (*c == '*');
+			size_t name_len = strcspn(c + 1, "/");
+
+			// Parameters must be named, and a wildcard has to be the last segment.
+			if (name_len == 0 || (wildcard && c[1 + name_len] != 0)) {
+				return NULL;
+			}
+
+			struct http_route_node_t **child = (wildcard ? &node->wildcard : &node->param);
+
+			if (*child == NULL) {
+
+				if ((*child = http_router_create_node("", 0)) == NULL ||
+					((*child)->name = strndup(c + 1, name_len)) == NULL) {
+					return NULL;
+				}
+			}
+
+			// All routes must use the same name for a parameter in the same position.
+			else if (strlen((*child)->name) != name_len || strncmp((*child)->name, c + 1, name_len) != 0) {
+				return NULL;
+			}
+
+			node = *child;
+			c += 1 + name_len;
+
+			continue;
+		}
+
+		// Static text until the next parameter.
+		size_t length = 1;
+
+		while (c[length] != 0 && !IS_PARAMETER(&c[length])) {
+			++length;
+		}
+
+		struct http_route_node_t *child = http_router_get_child(node, *c);
+
+		if (child == NULL) {
+
+			if ((child = http_router_create_node(c, length)) == NULL) {
+				return NULL;
+			}
+
+			if (!http_router_add_child(node, child)) {
+				http_router_free_node(child);
+				return NULL;
+			}
+
+			node = child;
+			c += length;
+
+			continue;
+		}
+
+		// The child shares the beginning of the text. If only a part of the child's label matches,
+		// split the child so the common part becomes a node of its own.
+		size_t common = 1;
+
+		while (common < length && common < child->label_len && c[common] == child->label[common]) {
+			++common;
+		}
+
+		if (common < child->label_len && !http_router_split_node(child, common)) {
+			return NULL;
+		}
+
+		node = child;
+		c += common;
+	}
+
+	#undef IS_PARAMETER
+
+	return node;
+}
+
+static struct http_route_node_t *http_router_create_node(const char *label, size_t label_len)
+{
+	struct http_route_node_t *node = calloc(1, sizeof(*node));
+
+	if (node == NULL) {
+		return NULL;
+	}
+
+	node->label = strndup(label, label_len);
+	node->label_len = label_len;
+
+	if (node->label == NULL) {
+		free(node);
+		return NULL;
+	}
+
+	return node;
+}
+
+static bool http_router_add_child(struct http_route_node_t *node, struct http_route_node_t *child)
+{
+	size_t len = node->children_len + 1;
+
+	struct http_route_node_t **children = realloc(node->children, len * sizeof(*children));
+
+	if (children == NULL) {
+		return false;
+	}
+
+	node->children = children;
+
+	char *indices = realloc(node->indices, len);
+
+	if (indices == NULL) {
+		return false;
+	}
+
+	node->indices = indices;
+
+	node->children[node->children_len] = child;
+	node->indices[node->children_len] = child->label[0];
+	node->children_len = len;
+
+	return true;
+}
+
+static bool http_router_split_node(struct http_route_node_t *node, size_t at)
+{
+	// The end of the label moves to a new node, which takes over everything below the original node.
+	struct http_route_node_t *rest = http_router_create_node(&node->label[at], node->label_len - at);
+
+	if (rest == NULL) {
+		return false;
+	}
+
+	rest->children = node->children;
+	rest->indices = node->indices;
+	rest->children_len = node->children_len;
+	rest->param = node->param;
+	rest->wildcard = node->wildcard;
+	rest->routes = node->routes;
+	rest->directory = node->directory;
+
+	node->children = NULL;
+	node->indices = NULL;
+	node->children_len = 0;
+	node->param = NULL;
+	node->wildcard = NULL;
+	node->routes = NULL;
+	node->directory = NULL;
+
+	node->label[at] = 0;
+	node->label_len = at;
+
+	if (!http_router_add_child(node, rest)) {
+
+		// Undo the split.
+		node->label[at] = rest->label[0];
+		node->label_len += rest->label_len;
+
+		node->children = rest->children;
+		node->indices = rest->indices;
+		node->children_len = rest->children_len;
+		node->param = rest->param;
+		node->wildcard = rest->wildcard;
+		node->routes = rest->routes;
+		node->directory = rest->directory;
+
+		free(rest->label);
+		free(rest);
+
+		return false;
+	}
+
+	return true;
+}
+
+static struct http_route_node_t *http_router_get_child(const struct http_route_node_t *node, char c)
+{
+	// Every static child starts with a different character.
+	const char *index = (node->children_len != 0 ? memchr(node->indices, c, node->children_len) : NULL);
+	return (index != NULL ? node->children[index - node->indices] : NULL);
+}
+
+static const struct http_route_t *http_router_match(const struct http_route_node_t *node, const char *method, const char *path, const char *end,
+	struct http_router_param_t *params, size_t *params_len)
+{
+	const struct http_route_t *route;
+
+	if (path == end) {
+
+		if ((route = http_router_get_route(node, method)) != NULL) {
+			return route;
+		}
+	}
+
+	// Prefer the static child. If the rest of the path doesn't match anything under it, try the parameter and the wildcard.
+	else {
+
+		const struct http_route_node_t *child = http_router_get_child(node, *path);
+
+		if (child != NULL &&
+			(size_t)(end - path) >= child->label_len &&
+			memcmp(path, child->label, child->label_len) == 0 &&
+			(route = http_router_match(child, method, path + child->label_len, end, params, params_len)) != NULL) {
+
+			return route;
+		}
+
+		if (node->param != NULL && *path != '/' && *params_len < HTTP_ROUTER_MAX_PARAMS) {
+
+			const char *segment_end = memchr(path, '/', (size_t)(end - path));
+
+			if (segment_end == NULL) {
+				segment_end = end;
+			}
+
+			struct http_router_param_t *param = &params[(*params_len)++];
+
+			param->name = node->param->name;
+			param->value = path;
+			param->length = (size_t)(segment_end - path);
+
+			if ((route = http_router_match(node->param, method, segment_end, end, params, params_len)) != NULL) {
+				return route;
+			}
+
+			(*params_len)--;
+		}
+	}
+
+	// The wildcard matches the rest of the path, even if it's empty.
+	if (node->wildcard != NULL && *params_len < HTTP_ROUTER_MAX_PARAMS &&
+		(route = http_router_get_route(node->wildcard, method)) != NULL) {
+
+		struct http_router_param_t *param = &params[(*params_len)++];
+
+		param->name = node->wildcard->name;
+		param->value = path;
+		param->length = (size_t)(end - path);
+
+		return route;
+	}
+
+	return NULL;
+}
+
+static const struct http_route_t *http_router_get_route(const struct http_route_node_t *node, const char *method)
+{
+	const struct http_route_t *any = NULL;
+
+	// A route for the exact method takes precedence over a route for all methods.
+	for (const struct http_route_t *route = node->routes; route != NULL; route = route->next) {
+
+		if (route->method == NULL) {
+			any = route;
+		}
+		else if (strcmp(route->method, method) == 0) {
+			return route;
+		}
+	}
+
+	return any;
+}
+
+static void http_router_free_node(struct http_route_node_t *node)
+{
+	for (size_t i = 0; i < node->children_len; ++i) {
+		http_router_free_node(node->children[i]);
+	}
+
+	if (node->param != NULL) {
+		http_router_free_node(node->param);
+	}
+
+	if (node->wildcard != NULL) {
+		http_router_free_node(node->wildcard);
+	}
+
+	for (struct http_route_t *route = node->routes, *next; route != NULL; route = next) {
+
+		next = route->next;
+
+		free(route->method);
+		free(route->pattern);
+		free(route);
+	}
+
+	free(node->children);
+	free(node->indices);
+	free(node->label);
+	free(node->name);
+	free(node);
+}
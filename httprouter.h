@@ -0,0 +1,78 @@
+#pragma once
+#ifndef __HTTPROUTER_H
+#define __HTTPROUTER_H
+
+#include "httpserver.h"
+#include <stddef.h>
+#include <stdbool.h>
+
+#define HTTP_ROUTER_MAX_PARAMS 16
+
+// --------------------------------------------------------------------------------
+
+// A handler registered for a method and a path pattern.
+struct http_route_t {
+	char *method;					// Method the route applies to, NULL for any method
+	char *pattern;					// Path pattern the route was added with
+	size_t index;					// Position of the route in the order the routes were added
+	handle_request_t handler;
+	handle_body_t body_handler;		// Receives the request body as it arrives, NULL to keep the body in memory for the handler
+	void *context;
+	struct http_route_t *next;		// Next route with the same pattern
+};
+
+// A node of the radix tree. Each node has a static label, and the children of a node either continue
+// the label with more static text, or match a parameter or a wildcard.
+struct http_route_node_t {
+	char *label;					// Static part of the path matched by this node
+	size_t label_len;
+
+	struct http_route_node_t **children; // Children with a static label, one per first character
+	char *indices;					// First characters of the static children's labels
+	size_t children_len;
+
+	struct http_route_node_t *param; // Child which matches a single path segment (e.g. /users/:id)
+	struct http_route_node_t *wildcard; // Child which matches the rest of the path (e.g. /files/*path)
+	char *name;						// Name of the parameter or wildcard matched by this node
+
+	struct http_route_t *routes;	// Handlers of the routes which end at this node
+	void *directory;				// Static file directory whose path ends at this node
+};
+
+struct http_router_t {
+	struct http_route_node_t *root;
+	struct http_route_t **routes;	// Every route, in the order they were added
+	size_t routes_len;
+};
+
+// A parameter or a wildcard captured from the requested path. The value is not null terminated.
+struct http_router_param_t {
+	const char *name;
+	const char *value;
+	size_t length;
+};
+
+// --------------------------------------------------------------------------------
+
+void http_router_create(struct http_router_t *router);
+void http_router_destroy(struct http_router_t *router);
+
+// Adds a route for a path pattern. A segment starting with a colon (/users/:id) matches any single segment,
+// and a trailing segment starting with an asterisk (/files/*path) matches the rest of the path.
+// The method can be NULL to match every method. Returns false if the pattern is invalid or conflicts
+// with an existing route.
+bool http_router_add_route(struct http_router_t *router, const char *method, const char *pattern,
+	handle_request_t handler, handle_body_t body_handler, void *context);
+
+// Adds a static file directory. Requests for paths starting with the given path are served from the directory.
+bool http_router_add_directory(struct http_router_t *router, const char *path, void *directory);
+
+// Finds the route which matches the method and the path. Static segments take precedence over parameters,
+// which take precedence over wildcards. The time taken depends on the length of the path, not on the number of routes.
+const struct http_route_t *http_router_find(const struct http_router_t *router, const char *method, const char *path, size_t length,
+	struct http_router_param_t *params, size_t *params_len);
+
+// Finds the static file directory with the longest path which is a prefix of the requested path.
+void *http_router_find_directory(const struct http_router_t *router, const char *path, size_t length);
+
+#endif
@@ -1,21 +1,146 @@
 #include "httpserver.h"
 #include "httpsocket.h"
 #include "httputils.h"
+#include "httppoll.h"
+#include "httpparser.h"
+#include "httpcache.h"
+#include "httpcompress.h"
+#include "httptimer.h"
+#include "httppool.h"
+#include "httprouter.h"
+#include "httpmetrics.h"
+#include "httptrace.h"
+#include "httpindex.h"
 #include <string.h>
+#include <strings.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <malloc.h>
 #include <time.h>
 #include <signal.h>
+#include <errno.h>
+
+// Worker threads require a platform where several sockets can be bound to the same port.
+#if !defined(_WIN32) && defined(SO_REUSEPORT)
+	#define HTTP_WORKER_THREADS
+	#include <pthread.h>
+#endif
+
+// Handler threads only require pthreads.
+#ifndef _WIN32
+	#define HTTP_HANDLER_THREADS
+	#include "httptasks.h"
+#endif
+
+// The access log is written by a thread of its own.
+#ifndef _WIN32
+	#define HTTP_ACCESS_LOG
+	#include "httplog.h"
+#endif
+
+#define HTTP_INPUT_BUFFER_SIZE 4096
+#define HTTP_POOL_SLAB_LENGTH 32
+#define HTTP_MAX_HEADER_SIZE 65536
+#define HTTP_DEFAULT_MAX_BODY_SIZE 1000000
+#define HTTP_HEADER_BUFFER_SIZE 4096
+#define HTTP_CACHE_HEADER_SIZE 512
+#define HTTP_CACHE_KEY_SIZE 600
+#define HTTP_CACHE_MAX_FILE_FRACTION 8
+#define HTTP_ETAG_SIZE 48
+#define HTTP_MAX_RANGES 16
+#define HTTP_CHUNK_BUFFER_SIZE 16384
+#define HTTP_CHUNK_SIZE_LENGTH 18
+#define HTTP_CHUNK_SLAB_LENGTH 4
+#define HTTP_HANDLER_QUEUE_SIZE 4096
+
+// Corking the header until the content follows it is only supported on Linux.
+#ifndef MSG_MORE
+#define MSG_MORE 0
+#endif
+
+// --------------------------------------------------------------------------------
+
+// Response data waiting to be sent to a client.
+struct http_output_t {
+	int file;						// File to send the data from, or -1 if the data is in memory
+	const char *data;				// Data to send when not sending from a file
+	off_t offset;					// Offset of the unsent data
+	size_t length;					// Length of the unsent data
+	struct http_cache_entry_t *entry; // Cached file the data belongs to, released once sent
+	struct http_pool_t *pool;		// Pool the segment was allocated from, NULL if allocated with malloc
+	generate_content_t generator;	// Produces the next chunk of the data once the previous one has been sent. NULL when there's nothing more to generate
+	release_content_t release;		// Called with the context once the data or the generator is no longer needed
+	void *context;
+	struct http_output_t *next;
+};
+
+// A part of a file requested with the Range header.
+struct http_range_t {
+	off_t start;
+	off_t length;
+};
+
+// A request which matched a route. The parameters captured from the path are copied after the structure,
+// so they remain valid while the body of the request is being received.
+struct http_route_state_t {
+	const struct http_route_t *route;
+	struct http_param_t params[HTTP_ROUTER_MAX_PARAMS];
+	size_t params_len;
+	void *user_data;				// Data attached to the request by the route's body handler
+	size_t size;					// Size of the allocation. States which fit into an input buffer are pooled
+};
+
+// The phase of a connection, each of which has its own timeout.
+enum http_client_phase_t {
+	HTTP_PHASE_IDLE,				// Waiting for the next request on a persistent connection
+	HTTP_PHASE_HEADERS,				// Receiving the request line and headers
+	HTTP_PHASE_BODY,				// Receiving the request body
+	HTTP_PHASE_WRITING,				// Waiting for the client to read the response
+	HTTP_PHASE_DEFERRED,			// Waiting for the application to complete a deferred response
+};
+
+// A deferred response. Created by the loop when a handler defers a request or the request is passed to a handler thread,
+// and freed by the loop after the response has been completed, so the connection may be closed in between without invalidating it.
+struct http_deferred_t {
+	struct client_t *client;		// Connection waiting for the response, NULL if it has been closed. Only accessed by the loop
+	struct http_loop_t *loop;
+	char content_next;				// Byte after the request body, replaced by the null terminator until the response is completed
+	handle_request_t handler;		// Handler to call on a handler thread, NULL if the handler deferred the response itself
+	void *context;
+	struct http_request_t request;	// Request given to the handler on a handler thread
+	struct http_response_t response; // The completed response
+	char *copy;						// Copies of the response's strings and content
+	uint64_t handler_start;			// Time the handler was called on a handler thread, in nanoseconds
+	uint64_t handler_time;			// Time taken by the handler on a handler thread
+	uint32_t handler_thread;		// Index of the handler thread
+	bool traced;					// Whether the request was received in a traced wakeup of the loop
+	struct http_deferred_t *next;	// Next completed response in the loop's queue
+};
 
 // --------------------------------------------------------------------------------
 
 struct client_t {
 	socket_t socket;
 	struct sockaddr_in addr;
-	char *ip_address;
-	time_t timeout;
+	char ip_address[INET_ADDRSTRLEN];
+	struct http_timer_t timer;		// Closes the connection when the current phase takes too long
+	enum http_client_phase_t phase;
 	bool terminate;
-	struct client_t *next;
+	char *input;					// Received data which hasn't been processed yet. Pooled unless larger than HTTP_INPUT_BUFFER_SIZE
+	size_t input_len;
+	size_t input_size;
+	struct http_parser_t *parser;	// State of the request currently being received, pooled
+	struct http_route_state_t *route; // Route of the current request, NULL if it didn't match one
+	// Idle connections hold neither the input buffer nor the parser.
+	struct http_output_t *output;	// Queue of response data which couldn't be sent yet
+	bool waiting_writable;			// Whether the socket is polled for write-readiness
+	struct http_deferred_t *deferred; // Deferred response to the current request, which stays in the input buffer until completed
+	uint64_t request_start;			// Time the processing of the current request started, in nanoseconds. 0 once its response has been started
+	uint64_t write_start;			// Time the oldest response which hasn't been passed to the kernel was started. 0 if there is none
+	struct http_loop_t *loop;
+	bool closed;					// Whether the connection has been closed, and the client is waiting to be freed
+	struct client_t *next;			// Next active connection, or next closed client waiting to be freed
+	struct client_t *previous;
 };
 
 // --------------------------------------------------------------------------------
@@ -24,29 +149,169 @@ struct file_dir_entry_t {
 	char *path;
 	char *directory;
 	size_t path_len;
+	uint32_t index;					// Number of the directory in the loops' file indexes
 	struct file_dir_entry_t *next;
 };
 
 // --------------------------------------------------------------------------------
 
+// An independent event loop with its own host socket, connections and buffers.
+// Each loop is run by a single thread, so nothing in here needs to be synchronized.
+struct http_loop_t {
+	socket_t host_socket;
+	struct http_poll_t poll_set;
+	bool poll_created;
+	struct client_t *first_connection;
+	struct client_t *closed_connections; // Closed clients, freed once the events of the wakeup have been handled
+	struct http_timer_wheel_t timers;	// Timeouts of the connections
+	uint64_t now;					// Time of the latest wakeup from the event backend, in milliseconds
+	struct http_cache_t cache;
+	struct http_index_t index;		// Files in the static directories
+	bool index_created;
+	unsigned int boundary_counter;
+
+	struct http_pool_t clients;		// Connections
+	struct http_pool_t parsers;		// Request parsers of the connections which are receiving a request
+	struct http_pool_t buffers;		// Input buffers and copies of response data
+	struct http_pool_t outputs;		// Output queue segments which don't carry any data
+	struct http_pool_t chunks;		// Output queue segments with a buffer for generated content
+
+	struct http_poll_wakeup_t wakeup; // Signalled when a deferred response has been completed
+	bool wakeup_created;
+	struct http_deferred_t *completed; // Completed deferred responses, newest first. Pushed to by any thread
+
+	struct http_metrics_t *metrics;	// Counters of the loop. Only updated by the loop, read by any thread
+	bool timing;					// Whether the requests are timed, i.e. the latency histograms are served or the access log is written
+
+	struct http_trace_t trace;		// Latest traced phases of the loop, when tracing is enabled
+	bool trace_created;
+	bool tracing;					// Whether the current wakeup is traced
+	unsigned int wakeups;			// Number of wakeups, the traced ones are sampled from
+
+#ifdef HTTP_ACCESS_LOG
+	struct http_log_ring_t *access_log; // Ring the loop logs its requests to, NULL if the access log is disabled
+#endif
+
+#ifdef HTTP_WORKER_THREADS
+	pthread_t thread;
+	bool thread_started;
+#endif
+};
+
+// --------------------------------------------------------------------------------
+
 static struct server_settings_t settings;
 
 static bool initialized = false;
-static socket_t host_socket = -1;
-static struct client_t *first_connection;
 static struct file_dir_entry_t *first_dir;
+static struct http_router_t router;
 
-static char message[1000000];
-static char file_buffer[1000000];
+static struct http_loop_t *loops;
+static size_t loops_len;
+static bool running = false;		// Read by the worker threads, which are woken up when it's cleared
+static int trace_requested = 0;		// Set by the signal handler, the trace is written by a loop
+static int stop_requested = 0;		// Set by http_server_stop, cleared when http_server_run returns
+
+#ifdef HTTP_HANDLER_THREADS
+static struct http_task_pool_t handlers;
+static bool handlers_started = false;
+#endif
+
+#ifdef HTTP_ACCESS_LOG
+static struct http_log_t access_log;
+static bool access_log_started = false;
+#endif
 
 // --------------------------------------------------------------------------------
 
+static bool http_server_create_loop(struct http_loop_t *loop, bool reuse_port);
+static void http_server_destroy_loop(struct http_loop_t *loop);
+static void http_server_listen_loop(struct http_loop_t *loop, uint32_t timeout);
+static uint32_t http_server_get_wait_timeout(struct http_loop_t *loop);
 static void http_server_add_static_directory(const char *path, const char *directory);
-static void http_server_process(void);
+static void http_server_process(struct http_loop_t *loop);
+static void http_server_accept(struct http_loop_t *loop, socket_t sock);
+static void http_server_add_client(struct http_loop_t *loop, socket_t sock, const struct sockaddr_in *addr);
 static void http_server_process_client(struct client_t *client);
+static void http_server_update_timeout(struct client_t *client);
+static void http_server_process_completed(struct http_loop_t *loop);
+static void http_server_complete_request(struct client_t *client, struct http_deferred_t *deferred);
+static char *http_server_copy_string(char **buffer, const char *string);
+static bool http_server_receive(struct client_t *client);
+static bool http_server_reserve_input(struct client_t *client);
+static void http_server_append_input(struct client_t *client, const char *data, size_t length);
+static void http_server_release_input(struct client_t *client);
+static void http_server_free_input_buffer(struct client_t *client);
+static size_t http_server_get_max_input_size(const struct client_t *client);
+static void http_server_process_requests(struct client_t *client);
+static void http_server_begin_request(struct client_t *client);
+static size_t http_server_get_max_body_size(const struct http_route_t *route);
+static bool http_server_stream_body(struct client_t *client);
+static void http_server_handle_request(struct client_t *client);
+static void http_server_prepare_request(const struct client_t *client, struct http_request_t *request);
+static bool http_server_should_compress(const struct client_t *client, struct http_response_t *response);
+static void http_server_send_error(struct client_t *client, enum http_message_t message);
+static void http_server_start_response(struct client_t *client, enum http_message_t message, size_t content_length);
+static void http_server_close_client(struct client_t *client);
+static void http_server_free_closed_clients(struct http_loop_t *loop);
 static void http_server_send_response(struct client_t *client, const struct http_response_t *response, bool is_static_file);
-static bool http_server_handle_static_file(struct client_t *client, const struct http_request_t *request);
+static bool http_server_send_header(struct client_t *client, const struct http_response_t *response, size_t content_length, bool is_static_file, const char *extra_headers);
+static size_t http_server_format_full_header(const struct client_t *client, char *buffer, size_t size, const struct http_response_t *response, size_t content_length, bool is_static_file, const char *extra_headers);
+static bool http_server_send_data(struct client_t *client, const char *header, size_t header_len, const char *data, size_t data_len, bool more);
+static bool http_server_send_content(struct client_t *client, const char *header, size_t header_len, const struct http_response_t *response, size_t content_length);
+static bool http_server_send_generated(struct client_t *client, const char *header, size_t header_len, const struct http_response_t *response);
+static ssize_t http_server_write_now(struct client_t *client, const char *header, size_t header_len, const char *data, size_t data_len, bool more);
+static size_t http_server_format_header(char *buffer, size_t size, const struct http_response_t *response, size_t content_length, bool is_static_file, const char *extra_headers);
+static const char *http_server_get_header_end(const struct client_t *client);
+static bool http_server_flush(struct client_t *client);
+static void http_server_queue_output(struct client_t *client, int file, const char *data, off_t offset, size_t length, struct http_cache_entry_t *entry);
+static void http_server_queue_copy(struct client_t *client, const char *data, size_t length);
+static bool http_server_queue_copies(struct client_t *client, const char *first, size_t first_len, const char *second, size_t second_len);
+static void http_server_append_output(struct client_t *client, struct http_output_t *output);
+static void http_server_free_output(struct http_output_t *output);
+static void http_server_generate_chunk(struct http_output_t *output);
+static void http_server_wait_writable(struct client_t *client, bool writable);
+static void http_server_drop_client(struct client_t *client);
+static bool http_server_create_route_state(struct client_t *client, const struct http_route_t *route,
+	const struct http_router_param_t *matches, size_t matches_len);
+static void http_server_end_route(struct client_t *client, bool aborted);
+static void http_server_call_handler(struct client_t *client, handle_request_t handler, struct http_request_t *request, void *context);
+static void http_server_send_handler_response(struct client_t *client, struct http_response_t response);
+static bool http_server_handle_static_file(struct client_t *client, const struct http_request_t *request, const struct file_dir_entry_t *dir);
+static bool http_server_send_static_variant(struct client_t *client, const struct file_dir_entry_t *dir, const char *req_path,
+	const char *relative, const char *content_type, const char *encoding, uint32_t variants, time_t now);
+static void http_server_send_static_file(struct client_t *client, const char *key, const char *path,
+	int file, const struct stat *info, const char *content_type, const char *encoding, time_t now);
+static void http_server_send_cached_entry(struct client_t *client, struct http_cache_entry_t *entry);
+static int http_server_open_file(const char *path, struct stat *info);
+static char *http_server_read_file(int file, size_t size);
+static struct http_cache_entry_t *http_server_cache_data(struct http_cache_t *cache, const char *key, const char *path,
+	char *data, size_t size, const struct stat *info, const char *content_type, const char *encoding, time_t now);
+static void http_server_send_cached_file(struct client_t *client, struct http_cache_entry_t *entry);
+static bool http_server_send_ranges(struct client_t *client, const struct http_response_t *response, int file, struct http_cache_entry_t *entry, off_t size);
+static int http_server_parse_ranges(const char *value, off_t size, struct http_range_t *ranges, int max_ranges);
+static void http_server_queue_range(struct client_t *client, int file, struct http_cache_entry_t *entry, const struct http_range_t *range);
+static void http_server_format_etag(time_t modified, off_t size, const char *encoding, char *buffer, size_t buffer_len);
+static bool http_server_is_not_modified(const struct client_t *client, const char *etag, time_t last_modified);
+static void http_server_send_not_modified(struct client_t *client, const struct http_response_t *response);
+static const char *http_server_get_file_content_type(const char *file_name);
+static const char *http_server_get_content_type(const char *ext);
 static const char *http_server_get_message_text(enum http_message_t message);
+static struct http_response_t http_server_handle_metrics(struct http_request_t *request, void *context);
+static void http_server_request_trace(int signum);
+
+#ifdef HTTP_ACCESS_LOG
+static void http_server_log_request(const struct client_t *client, enum http_message_t message, size_t content_length, uint64_t now);
+#endif
+
+#ifdef HTTP_WORKER_THREADS
+static void *http_server_worker_thread(void *arg);
+#endif
+
+#ifdef HTTP_HANDLER_THREADS
+static bool http_server_dispatch_handler(struct client_t *client, handle_request_t handler, struct http_request_t *request, void *context);
+static void http_server_run_handler(void *task, size_t thread);
+#endif
 
 // --------------------------------------------------------------------------------
 
@@ -57,70 +322,102 @@ bool http_server_initialize(struct server_settings_t configuration)
 	}
 
 	settings = configuration;
-	host_socket = -1;
 
 	// Initialize sockets. On Windows this initializes WinSock.
 	http_socket_initialize();
 
-	// Get address info for the host.
-	struct addrinfo hints, *res, *p;
+	// Each worker thread runs its own event loop. The first loop is always run by the thread calling http_server_listen.
+	loops_len = 1;
 
-	memset(&hints, 0, sizeof(hints));
-	hints.ai_family = AF_INET;
-	hints.ai_socktype = SOCK_STREAM;
-	hints.ai_flags = AI_PASSIVE;
+#ifdef HTTP_WORKER_THREADS
+	if (settings.worker_threads > 1) {
+		loops_len = settings.worker_threads;
+	}
+#endif
 
-	char service[8];
-	snprintf(service, sizeof(service), "%u", settings.port);
+	loops = calloc(loops_len, sizeof(*loops));
 
-	if (getaddrinfo(NULL, service, &hints, &res) != 0) {
-		http_server_shutdown();
+	if (loops == NULL) {
+		http_socket_shutdown();
 		return false;
 	}
 
-	// Create a socket for the host and bind it to the address.
-	for (p = res; p != NULL; p = p->ai_next) {
-		host_socket = socket(p->ai_family, p->ai_socktype, 0);
+	for (size_t i = 0; i < loops_len; ++i) {
+		loops[i].host_socket = -1;
+	}
 
-		if (host_socket < 0) {
-			continue;
-		}
+	// Ignore broken pipe signals, so they can be handled in client processing.
+	signal(SIGPIPE, SIG_IGN);
 
-		// Force the socket to reuse the address even if it's still in use.
-		int opt = true;
-		setsockopt(host_socket, SOL_SOCKET, SO_REUSEADDR, (const char *)&opt, sizeof(opt));
+#ifdef SIGUSR2
+	// Write the trace when asked to. The signal only sets a flag, the file is written by a loop.
+	if (settings.trace_sampling != 0 && settings.trace_path != NULL) {
+		signal(SIGUSR2, http_server_request_trace);
+	}
+#endif
 
-		if (bind(host_socket, p->ai_addr, (int)p->ai_addrlen) == 0) {
-			break;
-		}
+	// Add static file locations.
+	for (size_t i = 0; i < settings.directories_len; ++i) {
+		http_server_add_static_directory(settings.directories[i].path, settings.directories[i].directory);
 	}
 
-	// Could not create a socket or bind failed!
-	if (p == NULL || host_socket < 0) {
+	initialized = true;
+	running = true;
+
+	// The metrics are served like any other route. The route is added before the loops, which count the requests of each route.
+	if (settings.metrics_path != NULL && !http_server_add_route("GET", settings.metrics_path, http_server_handle_metrics, NULL)) {
 		http_server_shutdown();
 		return false;
 	}
 
-	freeaddrinfo(res);
+#ifdef HTTP_ACCESS_LOG
+	// Start the access log before the loops, each of which gets a ring of its own to log to.
+	if (settings.access_log != NULL) {
 
-	// Start listening for incoming connections.
-	if (listen(host_socket, settings.max_connections) != 0) {
-		http_server_shutdown();
-		return false;
+		if (!http_log_start(&access_log, settings.access_log, loops_len)) {
+			http_server_shutdown();
+			return false;
+		}
+
+		access_log_started = true;
 	}
+#endif
 
-	int opt = 3;
-	setsockopt(host_socket, SOL_SOCKET, SO_RCVLOWAT, (const char *)&opt, sizeof(opt));
+	// Create a listening socket for each loop. When there are several of them, they are all bound
+	// to the same port and the kernel balances incoming connections between them.
+	for (size_t i = 0; i < loops_len; ++i) {
 
-	// Add static file locations.
-	for (size_t i = 0; i < settings.directories_len; ++i) {
-		http_server_add_static_directory(settings.directories[i].path, settings.directories[i].directory);
+		if (!http_server_create_loop(&loops[i], loops_len > 1)) {
+			http_server_shutdown();
+			return false;
+		}
 	}
 
-	// Ignore broken pipe signals, so they can be handled in client processing.
-	signal(SIGPIPE, SIG_IGN);
+#ifdef HTTP_HANDLER_THREADS
+	// Start the handler threads before the loops start passing requests to them. Each loop has a queue of its own.
+	if (settings.handler_threads > 0) {
 
-	initialized = true;
+		if (!http_task_pool_start(&handlers, settings.handler_threads, loops_len, HTTP_HANDLER_QUEUE_SIZE, http_server_run_handler)) {
+			http_server_shutdown();
+			return false;
+		}
+
+		handlers_started = true;
+	}
+#endif
+
+#ifdef HTTP_WORKER_THREADS
+	// Start the worker threads for the rest of the loops.
+	for (size_t i = 1; i < loops_len; ++i) {
+
+		if (pthread_create(&loops[i].thread, NULL, http_server_worker_thread, &loops[i]) != 0) {
+			http_server_shutdown();
+			return false;
+		}
+
+		loops[i].thread_started = true;
+	}
+#endif
 
 	return true;
 }
@@ -131,28 +428,44 @@ void http_server_shutdown(void)
 		return;
 	}
 
-	if (host_socket != -1) {
-		shutdown(host_socket, SHUT_RDWR);
-		close(host_socket);
+	__atomic_store_n(&running, false, __ATOMIC_RELEASE);
+
+#ifdef HTTP_WORKER_THREADS
+	// Wake the worker threads up and wait for them to notice the server is shutting down.
+	for (size_t i = 1; i < loops_len; ++i) {
 
-		host_socket = -1;
+		if (loops[i].thread_started) {
+			http_poll_wakeup_signal(&loops[i].wakeup);
+			pthread_join(loops[i].thread, NULL);
+			loops[i].thread_started = false;
+		}
 	}
+#endif
 
-	// Terminate all active connections.
-	for (struct client_t *client = first_connection, *tmp;
-		client != NULL;
-		client = tmp)
-	{
-		tmp = client->next;
+#ifdef HTTP_HANDLER_THREADS
+	// Let the handler threads finish the requests they were given. The loops discard the responses below.
+	if (handlers_started) {
+		http_task_pool_stop(&handlers);
+		handlers_started = false;
+	}
+#endif
 
-		if (client->socket >= 0) {
-			shutdown(client->socket, SHUT_RDWR);
-			close(client->socket);
-		}
+	// Close all sockets and terminate all active connections.
+	for (size_t i = 0; i < loops_len; ++i) {
+		http_server_destroy_loop(&loops[i]);
+	}
+
+	free(loops);
+	loops = NULL;
+	loops_len = 0;
 
-		free(client->ip_address);
-		free(client);
+#ifdef HTTP_ACCESS_LOG
+	// The loops are gone, so the rest of the records can be written out.
+	if (access_log_started) {
+		http_log_stop(&access_log);
+		access_log_started = false;
 	}
+#endif
 
 	http_socket_shutdown();
 
@@ -168,421 +481,2881 @@ void http_server_shutdown(void)
 
 	first_dir = NULL;
 
+	// Remove the routes and the directories from the routing tree.
+	http_router_destroy(&router);
+
+#ifdef SIGUSR2
+	if (settings.trace_sampling != 0 && settings.trace_path != NULL) {
+		signal(SIGUSR2, SIG_DFL);
+	}
+#endif
+
 	initialized = false;
 }
 
-void http_server_listen(void)
+bool http_server_add_route(const char *method, const char *pattern, handle_request_t handler, void *context)
 {
-	if (!initialized) {
-		return;
+	return http_router_add_route(&router, method, pattern, handler, NULL, context);
+}
+
+bool http_server_add_stream_route(const char *method, const char *pattern, handle_body_t body_handler, handle_request_t handler, void *context)
+{
+	if (body_handler == NULL) {
+		return false;
 	}
 
-	time_t now = time(NULL);
+	return http_router_add_route(&router, method, pattern, handler, body_handler, context);
+}
 
-	// Create a set for the collection of sockets to listen to.
-	fd_set set;
-	FD_ZERO(&set);
-	FD_SET(host_socket, &set);
+struct http_deferred_t *http_server_defer(struct http_request_t *request)
+{
+	struct client_t *client = request->connection;
 
-	// Add the active client sockets to the set and find the highest socket descriptor value.
-	// While doing this, terminate all timed out connections.
-	socket_t highest = host_socket;
+	if (client == NULL || client->deferred != NULL) {
+		return NULL;
+	}
 
-	for (struct client_t *client = first_connection, *previous = NULL, *tmp;
-		 client != NULL;
-		 client = tmp) {
+	struct http_deferred_t *deferred = calloc(1, sizeof(*deferred));
 
-		tmp = client->next;
+	if (deferred == NULL) {
+		return NULL;
+	}
 
-		// If the client times out or wants to disconnects itself, terminate it.
-		if (client->timeout < now ||
-			client->terminate) {
+	deferred->client = client;
+	deferred->loop = client->loop;
 
-			// Update the list.
-			if (client == first_connection) {
-				first_connection = client->next;
-			}
-			else if (previous != NULL) {
-				previous->next = client->next;
-			}
-			
-			// Close the connection.
-			if (client->socket >= 0) {
-				shutdown(client->socket, SHUT_RDWR);
-				close(client->socket);
-			}
+	client->deferred = deferred;
+	return deferred;
+}
 
-			// Free data.
-			free(client->ip_address);
-			free(client);
+bool http_server_complete(struct http_deferred_t *deferred, const struct http_response_t *response)
+{
+	// Copy the strings and the content the response refers to, the caller's buffers may be gone by the time
+	// the loop sends the response. Content with a release callback or a generator belongs to the response.
+	bool copy_content = (response->content != NULL && response->generator == NULL && response->release == NULL);
 
-			continue;
-		}
-		else {
-			previous = client;
-		}
+	size_t content_length = response->content_length;
 
-		// Client is not terminated, add the socket to the set.
-		FD_SET(client->socket, &set);
+	if (copy_content && content_length == 0) {
+		content_length = strlen(response->content);
+	}
 
-		if (client->socket > highest) {
-			highest = client->socket;
-		}
+	size_t size = (copy_content ? content_length + 1 : 0) + response->headers_len * sizeof(struct http_header_t);
+
+	#define STRING_SIZE(string) ((string) != NULL ? strlen(string) + 1 : 0)
+
+	size += STRING_SIZE(response->content_type) + STRING_SIZE(response->content_encoding) + STRING_SIZE(response->etag);
+
+	for (size_t i = 0; i < response->headers_len; ++i) {
+		size += STRING_SIZE(response->headers[i].name) + STRING_SIZE(response->headers[i].value);
 	}
 
-	struct timeval timeout;
-	timeout.tv_sec = 0;
-	timeout.tv_usec = 1000L * (long)settings.timeout;
+	#undef STRING_SIZE
+
+	char *copy = malloc(size != 0 ? size : 1);
+	bool copied = (copy != NULL);
 
-	// Process all active sockets for incoming connections and/or requests.
-	if (select((int)(highest + 1), &set, NULL, NULL, &timeout) > 0) {
-		
-		// Listen to the server socket for new incoming connections.
-		if (FD_ISSET(host_socket, &set)) {
-			http_server_process();
+	if (copied) {
+
+		// The header list goes first, so it's aligned.
+		struct http_header_t *headers = (struct http_header_t *)copy;
+		char *buffer = copy + response->headers_len * sizeof(struct http_header_t);
+
+		deferred->response = *response;
+		deferred->response.headers = (response->headers_len != 0 ? headers : NULL);
+		deferred->response.content_type = http_server_copy_string(&buffer, response->content_type);
+		deferred->response.content_encoding = http_server_copy_string(&buffer, response->content_encoding);
+		deferred->response.etag = http_server_copy_string(&buffer, response->etag);
+
+		for (size_t i = 0; i < response->headers_len; ++i) {
+			headers[i].name = http_server_copy_string(&buffer, response->headers[i].name);
+			headers[i].value = http_server_copy_string(&buffer, response->headers[i].value);
 		}
-		
-		// Process all active client connections.
-		for (struct client_t *client = first_connection;
-			client != NULL;
-			client = client->next)
-		{
-			if (FD_ISSET(client->socket, &set)) {
-				http_server_process_client(client);
-			}
+
+		if (copy_content) {
+
+			memcpy(buffer, response->content, content_length);
+			buffer[content_length] = 0;
+
+			deferred->response.content = buffer;
+			deferred->response.content_length = content_length;
 		}
 	}
-}
+	else {
+		// Without memory for the copy the client is at least told the request failed.
+		memset(&deferred->response, 0, sizeof(deferred->response));
+		deferred->response.message = HTTP_500_INTERNAL_SERVER_ERROR;
 
-static void http_server_add_static_directory(const char *path, const char *directory)
-{
-	if (path == NULL || directory == NULL) {
-		return;
+		if (response->release != NULL) {
+			response->release(response->content_context);
+		}
 	}
 
-	// Allocate a new static content folder entry and duplicate the path names to it.
-	struct file_dir_entry_t *dir = malloc(sizeof(*dir));
+	deferred->copy = copy;
 
-	size_t path_len = strlen(path);
-	char *path_copy = (char *)malloc(path_len + 1);
-	char *directory_copy = (char *)malloc(strlen(directory) + 1);
+	// Add the response to the loop's queue and wake the loop up to send it.
+	struct http_loop_t *loop = deferred->loop;
+	struct http_deferred_t *first = __atomic_load_n(&loop->completed, __ATOMIC_RELAXED);
 
-	if (dir == NULL || path_copy == NULL || directory_copy == NULL) {
-		return;
-	}
+	do {
+		deferred->next = first;
+	} while (!__atomic_compare_exchange_n(&loop->completed, &first, deferred, true, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
 
-	strcpy(path_copy, path);
-	strcpy(directory_copy, directory);
+	http_poll_wakeup_signal(&loop->wakeup);
+	return copied;
+}
 
-	dir->path = path_copy;
-	dir->directory = directory_copy;
-	dir->path_len = path_len;
-	dir->next = NULL;
+const char *http_server_get_header(const struct http_request_t *request, const char *name)
+{
+	return http_parser_find_header(request->headers, request->headers_len, name);
+}
 
-	// Add the entry to the list of directories to serve static content from.
-	if (first_dir != NULL) {
-		dir->next = first_dir;
+const char *http_server_get_param(const struct http_request_t *request, const char *name)
+{
+	for (size_t i = 0; i < request->params_len; ++i) {
+
+		if (strcmp(request->params[i].name, name) == 0) {
+			return request->params[i].value;
+		}
 	}
 
-	first_dir = dir;
+	return NULL;
 }
 
-static void http_server_process(void)
+bool http_server_write_trace(const char *path)
 {
-	struct client_t *client = malloc(sizeof(*client));
-	memset(client, 0, sizeof(*client));
-	
-	// Accept a new connection.
-	socklen_t addr_len = sizeof(client->addr);
-	client->socket = accept(host_socket, (struct sockaddr *)&client->addr, &addr_len);
-	
-	if (client < 0) {
-
-		// Connection could not be made. Discard the client data.
-		free(client);
-		client = NULL;
+	if (!initialized || path == NULL || !loops[0].trace_created) {
+		return false;
 	}
-	else {
-		// Make the client socket non-blocking.
-		http_socket_set_non_blocking(client->socket);
 
-		// Set a default timeout value. We're assuming HTTP/1.1 protocol where clients want to keep the connection open.
-		client->timeout = time(NULL) + settings.connection_timeout;
+	struct http_trace_t **traces = malloc(loops_len * sizeof(*traces));
+
+	if (traces == NULL) {
+		return false;
+	}
 
-		// Store the client's IP address.
-		char ip[INET_ADDRSTRLEN];
-		inet_ntop(AF_INET, &client->addr.sin_addr, ip, sizeof(ip));
+	for (size_t i = 0; i < loops_len; ++i) {
+		traces[i] = &loops[i].trace;
+	}
 
-		client->ip_address = malloc(strlen(ip) + 1);
-		strcpy(client->ip_address, ip);
+	size_t handler_threads = 0;
 
-		// Add the client to the list of active connections.
-		client->next = first_connection;
-		first_connection = client;
+#ifdef HTTP_HANDLER_THREADS
+	if (handlers_started) {
+		handler_threads = settings.handler_threads;
 	}
+#endif
+
+	bool written = http_trace_write(traces, loops_len, handler_threads, path);
+
+	free(traces);
+	return written;
 }
 
-static void http_server_process_client(struct client_t *client)
+void http_server_listen(void)
 {
-	int received = recv(client->socket, message, sizeof(message) - 1, 0);
-	
-	// Receiving the request from the client failed.
-	if (received < 0) {
-		client->terminate = true;
+	if (!initialized) {
 		return;
 	}
 
-	// Client connection was terminated unexpectedly.
-	if (received == 0) {
-		client->terminate = true;
+	http_server_listen_loop(&loops[0], settings.timeout);
+}
+
+void http_server_run(void)
+{
+	if (!initialized) {
 		return;
 	}
 
-	message[received] = 0;
-
-	// Parse the request and respond to it.
-	struct http_request_t request;
-
-	request.method = strtok(message, " \t\n");
-	request.requester = client->ip_address;
-
-	// The library only serves GET and POST request.
-	if (strncmp(request.method, "GET\0", 4) == 0 ||
-		strncmp(request.method, "POST\0", 5) == 0 ||
-		strncmp(request.method, "PUT\0", 4) == 0 ||
-		strncmp(request.method, "DELETE\0", 7) == 0) {
-
-		// Parse the requested resource and the used protocol.
-		request.request = strtok(NULL, " \t");
-		char *protocol = strtok(NULL, " \t\n\r");
-
-		// The rest of the request message is a list of headers and the request body.
-		// Read all the headers and find out whether the client wants to keep the connection alive.
-		char *header_line = &protocol[strlen(protocol) + 1], *header, *value;
-		bool keep_alive = false;
-		
-		do {
-			// Empty line ending in a CRLF indicates the end of headers and the start of request body.
-			if (strncmp(header_line, "\r\n", 2) == 0) {
-				break;
-			}
+	// Block until there are events or a connection times out. Nothing else needs the loop to wake up.
+	while (__atomic_load_n(&stop_requested, __ATOMIC_ACQUIRE) == 0) {
+		http_server_listen_loop(&loops[0], http_server_get_wait_timeout(&loops[0]));
+	}
 
-			// Parse the header line and split it into the header and value strings.
-			header_line = string_parse_header_text(header_line, &header, &value);
+	__atomic_store_n(&stop_requested, 0, __ATOMIC_RELAXED);
+}
 
-			// If the name of the header is Connection, check its value.
-			if (strcmp(header, "Connection:") == 0) {
-				keep_alive = (strcmp(value, "keep-alive") == 0);
-			}
-		}
-		while (header_line != NULL);
+void http_server_stop(void)
+{
+	if (!initialized) {
+		return;
+	}
 
-		// The rest of the data is the request body preceeded by CRLF.
-		request.content = &header_line[2];
+	__atomic_store_n(&stop_requested, 1, __ATOMIC_RELEASE);
+	http_poll_wakeup_signal(&loops[0].wakeup);
+}
 
-		// If the client didn't specify a keep-alive header, terminate the connection after serving the request.
-		client->terminate = !keep_alive;
+int http_server_get_poll_fd(void)
+{
+	if (!initialized) {
+		return -1;
+	}
 
-		// Only HTTP 1.1 is supported right now.
-		if (strncmp(protocol, "HTTP/1.1", 8) != 0) {
+	return http_poll_get_fd(&loops[0].poll_set);
+}
 
-			struct http_response_t failure;
-			failure.message = HTTP_400_BAD_REQUEST;
-			failure.content = NULL;
-			failure.content_type = NULL;
+void http_server_process_ready(void)
+{
+	if (!initialized) {
+		return;
+	}
 
-			http_server_send_response(client, &failure, false);
-		}
+	http_server_listen_loop(&loops[0], 0);
 
-		else if (!http_server_handle_static_file(client, &request)) {
+	// Nobody waits in the event backend, so whatever the loop queued has to be submitted before returning.
+	http_poll_submit(&loops[0].poll_set);
+}
 
-			// If the request was not requesting anything from a static content path,
-			// let the user of this library handle the request as they see fit.
-			if (settings.handler != NULL) {
-				struct http_response_t response = settings.handler(&request, settings.context);
-				http_server_send_response(client, &response, false);
-			}
-		}
+int http_server_get_timeout(void)
+{
+	if (!initialized) {
+		return -1;
 	}
 
-	// Extend the timeout value.
-	client->timeout = time(NULL) + settings.connection_timeout;
+	uint32_t timeout = http_server_get_wait_timeout(&loops[0]);
+	return (timeout != HTTP_POLL_INFINITE ? (int)timeout : -1);
 }
 
-#define WRITE_VALIDATED(sock, buf, buflen)\
-	if (write((sock), (buf), (buflen)) < 0) {\
-		client->terminate = true;\
-		return;\
-	}
-
-static void http_server_send_response(struct client_t *client, const struct http_response_t *response, bool is_static_file)
+static bool http_server_create_loop(struct http_loop_t *loop, bool reuse_port)
 {
-	// Write the header.
-	const char *origin = "Access-Control-Allow-Origin: *\n";
-
-	char buffer[1024];
-	int len = snprintf(buffer, sizeof(buffer), "HTTP/1.1 %s\n", http_server_get_message_text(response->message));
+	// Get address info for the host.
+	struct addrinfo hints, *res, *p;
 
-	WRITE_VALIDATED(client->socket, buffer, len);
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_INET;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_flags = AI_PASSIVE;
 
-	// Tell the client not to cache dynamically generated responses.
-	if (!is_static_file) {
+	char service[8];
+	snprintf(service, sizeof(service), "%u", settings.port);
 
-		len = snprintf(buffer, sizeof(buffer), "Cache-Control: max-age=0, no-cache, must-revalidate, proxy-revalidate\n");
-		WRITE_VALIDATED(client->socket, buffer, len);
-	}
-	else {
-		len = snprintf(buffer, sizeof(buffer), "Cache-Control: max-age=2592000, public\n");
-		WRITE_VALIDATED(client->socket, buffer, len);
+	if (getaddrinfo(NULL, service, &hints, &res) != 0) {
+		return false;
 	}
 
-	// Keep the connection alive unless the client wants to terminate it.
-	if (!client->terminate) {
-
-		len = snprintf(buffer, sizeof(buffer), "Connection: keep-alive\n");
-		WRITE_VALIDATED(client->socket, buffer, len);
-	}
+	// Create a socket for the host and bind it to the address.
+	for (p = res; p != NULL; p = p->ai_next) {
+		loop->host_socket = socket(p->ai_family, p->ai_socktype, 0);
 
-	// Write the content if there is any.
-	if (response->content != NULL && response->content_type != NULL) {
+		if (loop->host_socket < 0) {
+			continue;
+		}
 
-		size_t content_length = response->content_length;
+		// Force the socket to reuse the address even if it's still in use.
+		int opt = true;
+		setsockopt(loop->host_socket, SOL_SOCKET, SO_REUSEADDR, (const char *)&opt, sizeof(opt));
 
-		// If response length is not set, assume it is plain text and use strlen to calculate its length.
-		if (content_length == 0) {
-			content_length = strlen(response->content);
+#ifdef HTTP_WORKER_THREADS
+		// Allow each loop to bind its own socket to the same port.
+		if (reuse_port) {
+			setsockopt(loop->host_socket, SOL_SOCKET, SO_REUSEPORT, (const char *)&opt, sizeof(opt));
 		}
+#endif
 
-		len = snprintf(buffer, sizeof(buffer), "Content-Length: %u\n", (uint32_t)content_length);
-		WRITE_VALIDATED(client->socket, buffer, len);
+		if (bind(loop->host_socket, p->ai_addr, (int)p->ai_addrlen) == 0) {
+			break;
+		}
 
-		len = snprintf(buffer, sizeof(buffer), "Content-Type: %s\n", response->content_type);
-		WRITE_VALIDATED(client->socket, buffer, len);
+		close(loop->host_socket);
+		loop->host_socket = -1;
+	}
 
-		len = snprintf(buffer, sizeof(buffer), "%s\n", origin);
-		WRITE_VALIDATED(client->socket, buffer, len);
+	freeaddrinfo(res);
 
-		// Send the response content. The data may be fragmented, so use a special method which
-		// keeps sending data until all of it has been written.
-		if (http_socket_write_all(client->socket, response->content, (int)content_length) < 0) {
-			client->terminate = true;
-			return;
-		}
-	}
-	else {
-		WRITE_VALIDATED(client->socket, origin, strlen(origin));
+	// Could not create a socket or bind failed!
+	if (p == NULL || loop->host_socket < 0) {
+		return false;
 	}
-}
 
-static bool http_server_handle_static_file(struct client_t *client, const struct http_request_t *request)
-{
-	const char *req_path = request->request;
-	
-	// No directories to serve static data from.
-	if (first_dir == NULL) {
+	// Start listening for incoming connections.
+	if (listen(loop->host_socket, settings.max_connections) != 0) {
 		return false;
 	}
 
-	// Static data directories have been added, is the requested file inside one of them?
-	struct file_dir_entry_t *dir = NULL;
+	// Register the host socket to the event backend. Incoming connections are accepted until the
+	// socket would block, so the socket has to be non-blocking.
+	http_socket_set_non_blocking(loop->host_socket);
 
-	for (struct file_dir_entry_t *tmp = first_dir; tmp != NULL; tmp = tmp->next) {
+	// With io_uring the event backend accepts the connections and receives the requests itself.
+	bool ring = (settings.io_uring && http_poll_create_ring(&loop->poll_set));
 
-		// If the client's request starts with the assigned path for a static file directory, use the directory.
-		if (strncmp(tmp->path, req_path, tmp->path_len) == 0) {
-			dir = tmp;
-			break;
-		}
+	if (!ring && !http_poll_create(&loop->poll_set)) {
+		return false;
 	}
 
-	// Client did not request a file from a valid directory.
-	if (dir == NULL) {
+	loop->poll_created = true;
+
+	if (!http_poll_add(&loop->poll_set, loop->host_socket, ring ? HTTP_POLL_ACCEPT : HTTP_POLL_READ, NULL)) {
 		return false;
 	}
 
-	const char *file_name = &req_path[dir->path_len];
+	// Other threads wake the loop up when they complete deferred responses.
+	if (!http_poll_wakeup_create(&loop->wakeup)) {
+		return false;
+	}
 
-	// Ignore requests which attempt to access a parent folder for safety reasons.
-	//if (strstr(file_name, "..") != NULL) {
-	//	return false;
-	//}
+	loop->wakeup_created = true;
 
-	char ext[8];
-	string_get_file_extension(file_name, ext, sizeof(ext));
+	if (!http_poll_add(&loop->poll_set, loop->wakeup.read_fd, HTTP_POLL_READ, &loop->wakeup)) {
+		return false;
+	}
+
+	loop->now = http_timer_get_time();
+	http_timer_wheel_initialize(&loop->timers, loop->now);
+
+	// Each loop counts its own requests, so the counters are never shared between threads which update them.
+	loop->metrics = http_metrics_create(router.routes_len);
+
+	if (loop->metrics == NULL) {
+		return false;
+	}
+
+	// Nothing reads the latency histograms unless they're served, so the requests aren't timed for them otherwise.
+	loop->timing = (settings.metrics_path != NULL);
+
+#ifdef HTTP_ACCESS_LOG
+	if (access_log_started) {
+		loop->access_log = &access_log.rings[loop - loops];
+		loop->timing = true;
+	}
+#endif
+
+	if (settings.trace_sampling != 0) {
+
+		if (!http_trace_create(&loop->trace, (uint32_t)(loop - loops))) {
+			return false;
+		}
+
+		loop->trace_created = true;
+	}
+
+	// Create a cache for the static files served by this loop.
+	if (settings.cache_size != 0 && !http_cache_create(&loop->cache, settings.cache_size)) {
+		return false;
+	}
+
+	// Index the static directories, so requests for files which don't exist don't have to look for them.
+	if (!http_index_create(&loop->index)) {
+		return false;
+	}
+
+	loop->index_created = true;
+
+	for (const struct file_dir_entry_t *dir = first_dir; dir != NULL; dir = dir->next) {
+		http_index_add_directory(&loop->index, dir->index, dir->directory);
+	}
+
+	if (http_index_get_fd(&loop->index) >= 0 &&
+		!http_poll_add(&loop->poll_set, http_index_get_fd(&loop->index), HTTP_POLL_READ, &loop->index)) {
+		return false;
+	}
+
+	// Preallocate the loop's share of the connections. The buffers are only needed by the connections
+	// which are receiving a request, so those pools start small and grow on demand.
+	size_t connections = (settings.max_connections + loops_len - 1) / loops_len;
+
+	if (!http_pool_create(&loop->clients, sizeof(struct client_t), connections, HTTP_POOL_SLAB_LENGTH) ||
+		!http_pool_create(&loop->parsers, sizeof(struct http_parser_t), 0, HTTP_POOL_SLAB_LENGTH) ||
+		!http_pool_create(&loop->buffers, HTTP_INPUT_BUFFER_SIZE, 0, HTTP_POOL_SLAB_LENGTH) ||
+		!http_pool_create(&loop->outputs, sizeof(struct http_output_t), 0, HTTP_POOL_SLAB_LENGTH) ||
+		!http_pool_create(&loop->chunks, sizeof(struct http_output_t) + HTTP_CHUNK_BUFFER_SIZE, 0, HTTP_CHUNK_SLAB_LENGTH)) {
+
+		return false;
+	}
+
+	// Submit the registrations right away, in case the loop is watched through its descriptor instead of waiting itself.
+	http_poll_submit(&loop->poll_set);
+
+	return true;
+}
+
+static void http_server_destroy_loop(struct http_loop_t *loop)
+{
+	if (loop->host_socket != -1) {
+		shutdown(loop->host_socket, SHUT_RDWR);
+		close(loop->host_socket);
+
+		loop->host_socket = -1;
+	}
+
+	// Terminate all active connections.
+	while (loop->first_connection != NULL) {
+		http_server_close_client(loop->first_connection);
+	}
+
+	// Discard the deferred responses which were completed after the last time the loop ran.
+	if (loop->wakeup_created) {
+
+		http_server_process_completed(loop);
+		http_poll_wakeup_destroy(&loop->wakeup);
+
+		loop->wakeup_created = false;
+	}
+
+	http_server_free_closed_clients(loop);
+
+	if (loop->poll_created) {
+		http_poll_destroy(&loop->poll_set);
+		loop->poll_created = false;
+	}
+
+	http_cache_destroy(&loop->cache);
+
+	if (loop->index_created) {
+		http_index_destroy(&loop->index);
+		loop->index_created = false;
+	}
+
+	http_pool_destroy(&loop->clients);
+	http_pool_destroy(&loop->parsers);
+	http_pool_destroy(&loop->buffers);
+	http_pool_destroy(&loop->outputs);
+	http_pool_destroy(&loop->chunks);
+
+	http_metrics_destroy(loop->metrics);
+	loop->metrics = NULL;
+
+	if (loop->trace_created) {
+		http_trace_destroy(&loop->trace);
+		loop->trace_created = false;
+	}
+}
+
+#ifdef HTTP_WORKER_THREADS
+
+static void *http_server_worker_thread(void *arg)
+{
+	struct http_loop_t *loop = arg;
+
+	// Worker threads block in the event backend until there's something to do. The shutdown wakes them up.
+	while (__atomic_load_n(&running, __ATOMIC_ACQUIRE)) {
+		http_server_listen_loop(loop, http_server_get_wait_timeout(loop));
+	}
+
+	return NULL;
+}
+
+#endif
+
+static void http_server_listen_loop(struct http_loop_t *loop, uint32_t timeout)
+{
+	// Trace a sample of the wakeups. Everything the loop does in a traced wakeup is timed, along with the wait before it.
+	loop->tracing = (loop->trace_created && ++loop->wakeups % settings.trace_sampling == 0);
+	uint64_t wait_start = (loop->tracing ? http_trace_get_time() : 0);
+
+	// Wait for the event backend to report sockets which have incoming connections and/or requests.
+	struct http_poll_event_t events[64];
+	int count = http_poll_wait(&loop->poll_set, events, sizeof(events) / sizeof(events[0]), timeout);
+
+	if (loop->tracing) {
+		http_trace_add(&loop->trace, HTTP_TRACE_WAIT, wait_start, (uint64_t)(count > 0 ? count : 0));
+	}
+
+	// Read the clock once per wakeup. Every timeout scheduled while processing the events is relative to this.
+	loop->now = http_timer_get_time();
+
+	bool completed = false;
+
+	for (int i = 0; i < count; ++i) {
+
+		struct client_t *client = events[i].data;
+
+		// The host socket is registered without user data.
+		if (client == NULL) {
+
+			if (events[i].events & HTTP_POLL_ACCEPT) {
+				http_server_accept(loop, events[i].socket);
+			}
+			else {
+				http_server_process(loop);
+			}
+
+			continue;
+		}
+
+		// Deferred responses are sent after the other events, as sending them may close their connections.
+		if (events[i].data == &loop->wakeup) {
+			completed = true;
+			continue;
+		}
+
+		// Files have been added to or removed from the static directories.
+		if (events[i].data == &loop->index) {
+			http_index_update(&loop->index);
+			continue;
+		}
+
+		// With io_uring a connection may have several events in the same batch, and an earlier one may have closed it.
+		if (client->closed) {
+			continue;
+		}
+
+		// Data received by the event backend is only valid until the next wait, so it's taken right away.
+		if (events[i].events & HTTP_POLL_RECEIVED) {
+			http_server_append_input(client, events[i].buffer, events[i].length);
+		}
+
+		http_server_process_client(client);
+
+		// If the client disconnected or doesn't want to keep the connection alive, terminate it
+		// once the last response has been sent.
+		if (client->terminate && client->output == NULL && client->deferred == NULL) {
+			http_server_close_client(client);
+		}
+	}
+
+	if (completed) {
+		http_server_process_completed(loop);
+	}
+
+	// Terminate the connections whose current phase has timed out. Only the expired timers are visited.
+	for (struct http_timer_t *timer = http_timer_advance(&loop->timers, loop->now), *next;
+		 timer != NULL;
+		 timer = next) {
+
+		next = timer->next;
+
+		http_metrics_add(&loop->metrics->connections_timed_out, 1);
+		http_server_close_client(timer->data);
+	}
+
+	http_server_free_closed_clients(loop);
+
+	// Write the trace if the signal was received. Whichever loop notices it first writes the file.
+	if (__atomic_load_n(&trace_requested, __ATOMIC_RELAXED) != 0 &&
+		__atomic_exchange_n(&trace_requested, 0, __ATOMIC_RELAXED) != 0) {
+
+		http_server_write_trace(settings.trace_path);
+	}
+}
+
+static uint32_t http_server_get_wait_timeout(struct http_loop_t *loop)
+{
+	uint64_t next;
+
+	if (!http_timer_get_next(&loop->timers, &next)) {
+		return HTTP_POLL_INFINITE;
+	}
+
+	uint64_t now = http_timer_get_time();
+	return (next > now ? (uint32_t)(next - now) : 0);
+}
+
+static char *http_server_copy_string(char **buffer, const char *string)
+{
+	if (string == NULL) {
+		return NULL;
+	}
+
+	char *copy = *buffer;
+	size_t size = strlen(string) + 1;
+
+	memcpy(copy, string, size);
+	*buffer += size;
+
+	return copy;
+}
+
+static void http_server_add_static_directory(const char *path, const char *directory)
+{
+	if (path == NULL || directory == NULL) {
+		return;
+	}
+
+	// Allocate a new static content folder entry and duplicate the path names to it.
+	struct file_dir_entry_t *dir = malloc(sizeof(*dir));
+
+	size_t path_len = strlen(path);
+	char *path_copy = (char *)malloc(path_len + 1);
+	char *directory_copy = (char *)malloc(strlen(directory) + 1);
+
+	if (dir == NULL || path_copy == NULL || directory_copy == NULL) {
+		return;
+	}
+
+	strcpy(path_copy, path);
+	strcpy(directory_copy, directory);
+
+	dir->path = path_copy;
+	dir->directory = directory_copy;
+	dir->path_len = path_len;
+	dir->index = (first_dir != NULL ? first_dir->index + 1 : 0);
+	dir->next = NULL;
+
+	// Add the entry to the list of directories to serve static content from.
+	if (first_dir != NULL) {
+		dir->next = first_dir;
+	}
+
+	first_dir = dir;
+
+	// Requests are matched to the directories in the same tree as the routes.
+	http_router_add_directory(&router, path, dir);
+}
+
+static void http_server_process(struct http_loop_t *loop)
+{
+	// Accept all pending connections. The event backend only reports the host socket again
+	// once new connections arrive after it has been drained.
+	for (;;) {
+
+		struct sockaddr_in addr;
+		socklen_t addr_len = sizeof(addr);
+
+		socket_t sock = accept(loop->host_socket, (struct sockaddr *)&addr, &addr_len);
+
+		if (sock < 0) {
+
+			// Retry if interrupted, otherwise there are no more connections to accept.
+			if (errno == EINTR) {
+				continue;
+			}
+
+			break;
+		}
+
+		// Make the client socket non-blocking.
+		http_socket_set_non_blocking(sock);
+
+		http_server_add_client(loop, sock, &addr);
+	}
+}
+
+static void http_server_accept(struct http_loop_t *loop, socket_t sock)
+{
+	// The event backend has already accepted the connection and made the socket non-blocking, but not stored the address.
+	struct sockaddr_in addr;
+	socklen_t addr_len = sizeof(addr);
+
+	if (getpeername(sock, (struct sockaddr *)&addr, &addr_len) != 0) {
+		close(sock);
+		return;
+	}
+
+	http_server_add_client(loop, sock, &addr);
+}
+
+static void http_server_add_client(struct http_loop_t *loop, socket_t sock, const struct sockaddr_in *addr)
+{
+	struct client_t *client = http_pool_alloc(&loop->clients);
+
+	if (client == NULL) {
+		close(sock);
+		return;
+	}
+
+	memset(client, 0, sizeof(*client));
+
+	client->socket = sock;
+	client->addr = *addr;
+	client->loop = loop;
+
+	// Store the client's IP address.
+	inet_ntop(AF_INET, &client->addr.sin_addr, client->ip_address, sizeof(client->ip_address));
+
+	// Each response is written as a whole, so holding it back only delays it. Pipelined responses would otherwise
+	// wait for the client to acknowledge the previous one, which it may delay for tens of milliseconds.
+	http_socket_set_no_delay(client->socket);
+
+	// Register the client to the event backend. This is done only once per connection. With io_uring the requests
+	// are received by the backend instead, starting right away.
+	bool ring = http_poll_is_ring(&loop->poll_set);
+
+	if (!http_poll_add(&loop->poll_set, client->socket, ring ? 0 : HTTP_POLL_READ, client) ||
+		(ring && !http_poll_receive(&loop->poll_set, client->socket, HTTP_INPUT_BUFFER_SIZE - 1))) {
+
+		http_poll_remove(&loop->poll_set, client->socket);
+		close(client->socket);
+		http_pool_free(&loop->clients, client);
+		return;
+	}
+
+	// Add the client to the list of active connections.
+	client->next = loop->first_connection;
+	client->previous = NULL;
+
+	if (loop->first_connection != NULL) {
+		loop->first_connection->previous = client;
+	}
+
+	loop->first_connection = client;
+
+	// Set a default timeout value. We're assuming HTTP/1.1 protocol where clients want to keep the connection open.
+	client->timer.data = client;
+	client->phase = HTTP_PHASE_IDLE;
+
+	http_timer_set(&loop->timers, &client->timer, loop->now + 1000 * (uint64_t)settings.connection_timeout);
+
+	http_metrics_add(&loop->metrics->connections_accepted, 1);
+	http_metrics_add(&loop->metrics->connections_active, 1);
+}
+
+static void http_server_close_client(struct client_t *client)
+{
+	// Remove the client from the list of active connections.
+	if (client->previous != NULL) {
+		client->previous->next = client->next;
+	}
+	else {
+		client->loop->first_connection = client->next;
+	}
+
+	if (client->next != NULL) {
+		client->next->previous = client->previous;
+	}
+
+	http_timer_cancel(&client->loop->timers, &client->timer);
+	http_metrics_subtract(&client->loop->metrics->connections_active, 1);
+
+	// A request whose body was still being received won't be completed. A deferred response is discarded when it's completed.
+	http_server_end_route(client, client->deferred == NULL);
+
+	if (client->deferred != NULL) {
+		client->deferred->client = NULL;
+		client->deferred = NULL;
+	}
+
+	// Close the connection.
+	if (client->socket >= 0) {
+		http_poll_remove(&client->loop->poll_set, client->socket);
+
+		shutdown(client->socket, SHUT_RDWR);
+		close(client->socket);
+	}
+
+	// Free data.
+	http_server_drop_client(client);
+	http_server_release_input(client);
+
+	// The client itself is freed at the end of the wakeup, as the events which are still to be handled may refer to it.
+	// Until then the slot can't be reused by a new connection either.
+	client->closed = true;
+	client->next = client->loop->closed_connections;
+	client->loop->closed_connections = client;
+}
+
+static void http_server_free_closed_clients(struct http_loop_t *loop)
+{
+	for (struct client_t *client = loop->closed_connections, *next; client != NULL; client = next) {
+		next = client->next;
+		http_pool_free(&loop->clients, client);
+	}
+
+	loop->closed_connections = NULL;
+}
+
+static void http_server_process_client(struct client_t *client)
+{
+	// Finish sending the previous response first, so the responses are sent in the order of the requests.
+	if (!http_server_flush(client)) {
+		http_server_update_timeout(client);
+		return;
+	}
+
+	// Serve the pipelined requests which were waiting for the previous response to be sent.
+	http_server_process_requests(client);
+
+	// Keep reading until the socket would block, the event backend won't report data which was already pending.
+	// Every read may complete any number of requests, which are served in the order they were received.
+	// Nothing is read while waiting for a deferred response.
+	while (!client->terminate &&
+		   client->output == NULL &&
+		   client->deferred == NULL &&
+		   http_server_receive(client)) {
+
+		http_server_process_requests(client);
+	}
+
+	// Idle connections don't need to hold on to the buffers while waiting for the next request.
+	if (client->input_len == 0) {
+		http_server_release_input(client);
+	}
+
+	// Extend the timeout value.
+	http_server_update_timeout(client);
+}
+
+static void http_server_update_timeout(struct client_t *client)
+{
+	enum http_client_phase_t phase = HTTP_PHASE_IDLE;
+	uint32_t timeout = settings.connection_timeout;
+
+	// The application decides how long a deferred response may take.
+	if (client->deferred != NULL) {
+		http_timer_cancel(&client->loop->timers, &client->timer);
+		client->phase = HTTP_PHASE_DEFERRED;
+		return;
+	}
+
+	if (client->output != NULL) {
+		phase = HTTP_PHASE_WRITING;
+		timeout = settings.write_timeout;
+	}
+	else if (client->parser != NULL && client->parser->state != HTTP_PARSER_HEADERS) {
+		phase = HTTP_PHASE_BODY;
+		timeout = settings.body_timeout;
+	}
+	else if (client->input_len != 0) {
+		phase = HTTP_PHASE_HEADERS;
+		timeout = settings.header_timeout;
+	}
+
+	// Receiving a request has to finish within the timeout from the start of the phase, so a client can't keep
+	// the connection by trickling the request a byte at a time. Idle and writing connections are given more time
+	// whenever there is activity, and so are bodies passed to a body handler, which may be of any length.
+	bool streaming = (client->route != NULL && client->route->route->body_handler != NULL);
+
+	if (phase == client->phase && (phase == HTTP_PHASE_HEADERS || (phase == HTTP_PHASE_BODY && !streaming))) {
+		return;
+	}
+
+	if (timeout == 0) {
+		timeout = settings.connection_timeout;
+	}
+
+	client->phase = phase;
+	http_timer_set(&client->loop->timers, &client->timer, client->loop->now + 1000 * (uint64_t)timeout);
+}
+
+static void http_server_process_completed(struct http_loop_t *loop)
+{
+	// Reset the wakeup before taking the responses, a response completed after this wakes the loop up again.
+	http_poll_wakeup_clear(&loop->wakeup);
+
+	struct http_deferred_t *completed = __atomic_exchange_n(&loop->completed, NULL, __ATOMIC_ACQUIRE);
+	struct http_deferred_t *first = NULL;
+
+	// The responses were pushed newest first, reverse them to send them in the order they were completed.
+	while (completed != NULL) {
+
+		struct http_deferred_t *next = completed->next;
+
+		completed->next = first;
+		first = completed;
+
+		completed = next;
+	}
+
+	while (first != NULL) {
+
+		struct http_deferred_t *deferred = first;
+		first = deferred->next;
+
+		if (deferred->client != NULL) {
+			http_server_complete_request(deferred->client, deferred);
+		}
+
+		// Content which wasn't sent because the client is gone still has to be released.
+		else if (deferred->response.release != NULL) {
+			deferred->response.release(deferred->response.content_context);
+		}
+
+		free(deferred->copy);
+		free(deferred);
+	}
+}
+
+static void http_server_complete_request(struct client_t *client, struct http_deferred_t *deferred)
+{
+	struct http_parser_t *parser = client->parser;
+
+	client->deferred = NULL;
+
+	if (deferred->handler != NULL) {
+
+		if (client->loop->timing) {
+			http_metrics_observe(client->loop->metrics, HTTP_HISTOGRAM_HANDLER, deferred->handler_time);
+		}
+
+		if (deferred->traced) {
+			http_trace_add_span(&client->loop->trace, HTTP_TRACE_HANDLER, HTTP_TRACE_HANDLER_THREAD + deferred->handler_thread,
+				deferred->handler_start, deferred->handler_time, (uint64_t)client->socket);
+		}
+	}
+
+	// The request is still where it was in the input buffer, followed by whatever was received after it.
+	parser->content[parser->body_length] = deferred->content_next;
+
+	http_server_send_handler_response(client, deferred->response);
+	http_server_end_route(client, false);
+
+	size_t request_end = (size_t)(parser->base - client->input) + http_parser_get_request_length(parser);
+
+	client->input_len -= request_end;
+	memmove(client->input, &client->input[request_end], client->input_len);
+
+	http_parser_reset(parser);
+	client->phase = HTTP_PHASE_IDLE;
+
+	// Continue with the connection as if it had just become ready, which serves the pipelined requests.
+	http_server_process_client(client);
+
+	if (client->terminate && client->output == NULL && client->deferred == NULL) {
+		http_server_close_client(client);
+	}
+}
+
+static bool http_server_receive(struct client_t *client)
+{
+	struct http_poll_t *poll = &client->loop->poll_set;
+
+	if (!http_server_reserve_input(client)) {
+		return false;
+	}
+
+	// With io_uring the data arrives with an event. Ask for as much as a read from the socket would take and wait for it.
+	if (http_poll_is_ring(poll)) {
+
+		if (!http_poll_receive(poll, client->socket, client->input_size - client->input_len - 1)) {
+			client->terminate = true;
+		}
+
+		return false;
+	}
+
+	uint64_t start = (client->loop->tracing ? http_trace_get_time() : 0);
+	int received = recv(client->socket, &client->input[client->input_len], client->input_size - client->input_len - 1, 0);
+
+	if (client->loop->tracing) {
+		http_trace_add(&client->loop->trace, HTTP_TRACE_RECEIVE, start, (uint64_t)(received > 0 ? received : 0));
+	}
+	
+	// Receiving the request from the client failed.
+	if (received < 0) {
+
+		// There is no more data to read for now, wait for the next event.
+		if (errno == EAGAIN || errno == EWOULDBLOCK) {
+			return false;
+		}
+
+		// The call was interrupted by a signal, try again.
+		if (errno == EINTR) {
+			return true;
+		}
+
+		client->terminate = true;
+		return false;
+	}
+
+	// Client connection was terminated.
+	if (received == 0) {
+		client->terminate = true;
+		return false;
+	}
+
+	client->input_len += received;
+	http_metrics_add(&client->loop->metrics->bytes_received, (uint64_t)received);
+
+	return true;
+}
+
+static bool http_server_reserve_input(struct client_t *client)
+{
+	// Take a buffer and a parser for the request from the pools.
+	if (client->input == NULL) {
+
+		client->input = http_pool_alloc(&client->loop->buffers);
+		client->parser = http_pool_alloc(&client->loop->parsers);
+
+		if (client->input == NULL || client->parser == NULL) {
+			http_server_release_input(client);
+			client->terminate = true;
+			return false;
+		}
+
+		client->input_size = HTTP_INPUT_BUFFER_SIZE;
+		http_parser_reset(client->parser);
+	}
+
+	// Make sure there is room for more data and a null terminator in the input buffer.
+	if (client->input_len + 1 >= client->input_size) {
+
+		size_t limit = http_server_get_max_input_size(client);
+
+		// The request doesn't fit into the largest allowed buffer.
+		if (client->input_size >= limit) {
+			http_server_send_error(client, client->parser->state == HTTP_PARSER_HEADERS ? HTTP_400_BAD_REQUEST : HTTP_413_PAYLOAD_TOO_LARGE);
+			return false;
+		}
+
+		size_t size = (client->input_size <= limit / 2 ? 2 * client->input_size : limit);
+
+		char *input = malloc(size);
+
+		if (input == NULL) {
+			client->terminate = true;
+			return false;
+		}
+
+		// The parser may hold pointers to a partially received request, move them to the new buffer.
+		memcpy(input, client->input, client->input_len);
+		http_parser_relocate(client->parser, input);
+
+		http_server_free_input_buffer(client);
+
+		client->input = input;
+		client->input_size = size;
+	}
+
+	return true;
+}
+
+static void http_server_append_input(struct client_t *client, const char *data, size_t length)
+{
+	// Nothing was received because the connection was closed or failed.
+	if (length == 0) {
+		client->terminate = true;
+		return;
+	}
+
+	http_metrics_add(&client->loop->metrics->bytes_received, length);
+
+	// No more was asked for than what fits into the input buffer, which may have been released in between.
+	while (length > 0 && http_server_reserve_input(client)) {
+
+		size_t room = client->input_size - client->input_len - 1;
+		size_t copied = (length < room ? length : room);
+
+		memcpy(&client->input[client->input_len], data, copied);
+
+		client->input_len += copied;
+		data += copied;
+		length -= copied;
+	}
+}
+
+static void http_server_release_input(struct client_t *client)
+{
+	http_server_free_input_buffer(client);
+
+	client->input = NULL;
+	client->input_len = 0;
+	client->input_size = 0;
+
+	if (client->parser != NULL) {
+		http_pool_free(&client->loop->parsers, client->parser);
+		client->parser = NULL;
+	}
+}
+
+static void http_server_free_input_buffer(struct client_t *client)
+{
+	if (client->input == NULL) {
+		return;
+	}
+
+	// Buffers which have been grown past the pooled size are allocated separately.
+	if (client->input_size == HTTP_INPUT_BUFFER_SIZE) {
+		http_pool_free(&client->loop->buffers, client->input);
+	}
+	else {
+		free(client->input);
+	}
+}
+
+static size_t http_server_get_max_input_size(const struct client_t *client)
+{
+	const struct http_parser_t *parser = client->parser;
+
+	if (parser->state == HTTP_PARSER_HEADERS) {
+		return HTTP_MAX_HEADER_SIZE;
+	}
+
+	// The buffer has to hold the headers and a body which is kept in memory, with some room for the framing of the chunks
+	// and the beginning of the next request. A body passed to a body handler is removed from the buffer as it arrives.
+	const struct http_route_t *route = (client->route != NULL ? client->route->route : NULL);
+
+	size_t body = (route != NULL && route->body_handler != NULL ? 0 : http_server_get_max_body_size(route));
+	size_t limit = parser->header_length + HTTP_INPUT_BUFFER_SIZE;
+
+	return (body > SIZE_MAX - limit ? SIZE_MAX : limit + body);
+}
+
+static void http_server_process_requests(struct client_t *client)
+{
+	size_t offset = 0;
+
+	// Serve all complete requests in the input buffer. If a response couldn't be sent entirely,
+	// the rest of the requests have to wait until it has been.
+	while (!client->terminate && client->output == NULL && client->deferred == NULL && offset < client->input_len) {
+
+		struct http_parser_t *parser = client->parser;
+
+		char *data = &client->input[offset];
+		size_t length = client->input_len - offset;
+
+		if (client->loop->timing && client->request_start == 0) {
+			client->request_start = http_metrics_get_time();
+		}
+
+		uint64_t start = (client->loop->tracing ? http_trace_get_time() : 0);
+		enum http_parser_result_t result = http_parser_execute(parser, data, length);
+
+		if (client->loop->tracing) {
+			http_trace_add(&client->loop->trace, HTTP_TRACE_PARSE, start, length);
+		}
+
+		if (result == HTTP_PARSER_ERROR) {
+			http_server_send_error(client, HTTP_400_BAD_REQUEST);
+			break;
+		}
+
+		if (result == HTTP_PARSER_UNSUPPORTED) {
+			http_server_send_error(client, HTTP_501_NOT_IMPLEMENTED);
+			break;
+		}
+
+		// Decide whether to accept the request before any of the body is read.
+		if (result == HTTP_PARSER_HEADERS_COMPLETE) {
+			http_server_begin_request(client);
+			continue;
+		}
+
+		// The length of a chunked body isn't known beforehand, so it's checked as the body arrives.
+		const struct http_route_t *route = (client->route != NULL ? client->route->route : NULL);
+
+		if (parser->body_received > http_server_get_max_body_size(route)) {
+			http_server_send_error(client, HTTP_413_PAYLOAD_TOO_LARGE);
+			break;
+		}
+
+		// Pass the body received so far to the route's body handler and remove it from the input buffer.
+		if (route != NULL && route->body_handler != NULL) {
+
+			if (!http_server_stream_body(client)) {
+
+				// The rest of the body won't be read, so the connection can't be used for another request.
+				client->terminate = true;
+				http_server_send_error(client, HTTP_500_INTERNAL_SERVER_ERROR);
+				break;
+			}
+
+			client->input_len -= http_parser_discard_body(parser, length);
+		}
+
+		if (result == HTTP_PARSER_INCOMPLETE) {
+			break;
+		}
+
+		// Null terminate the request body for the handler. The next byte may belong to a pipelined request,
+		// so it's restored afterwards. There is always room for one more byte in the buffer.
+		size_t request_length = http_parser_get_request_length(parser);
+
+		char *content_end = &parser->content[parser->body_length];
+		char next = *content_end;
+		*content_end = 0;
+
+		if (client->loop->timing) {
+			http_metrics_observe(client->loop->metrics, HTTP_HISTOGRAM_PARSE, http_metrics_get_time() - client->request_start);
+		}
+
+		http_server_handle_request(client);
+
+		// The response has been deferred. The request stays in the buffer as it is until the response is completed,
+		// so a handler thread can use it.
+		if (client->deferred != NULL) {
+			client->deferred->content_next = next;
+			break;
+		}
+
+		*content_end = next;
+
+		http_server_end_route(client, false);
+
+		// Start sending the response. Whatever the socket can't take right now is sent when it becomes writable.
+		http_server_flush(client);
+
+		offset += request_length;
+		http_parser_reset(parser);
+
+		// The next request gets a timeout of its own.
+		client->phase = HTTP_PHASE_IDLE;
+	}
+
+	// Move a partially received request to the beginning of the buffer.
+	if (offset > 0 && client->deferred == NULL) {
+
+		client->input_len -= offset;
+		memmove(client->input, &client->input[offset], client->input_len);
+
+		http_parser_relocate(client->parser, client->input);
+	}
+}
+
+static void http_server_begin_request(struct client_t *client)
+{
+	const struct http_parser_t *parser = client->parser;
+
+	// Only HTTP 1.1 is supported right now.
+	if (strcmp(parser->protocol, "HTTP/1.1") != 0) {
+		http_server_send_error(client, HTTP_400_BAD_REQUEST);
+		return;
+	}
+
+	// The library only serves GET, POST, PUT and DELETE requests. Other methods are valid requests the server
+	// doesn't implement (RFC 9110, section 9.1).
+	if (strcmp(parser->method, "GET") != 0 &&
+		strcmp(parser->method, "POST") != 0 &&
+		strcmp(parser->method, "PUT") != 0 &&
+		strcmp(parser->method, "DELETE") != 0) {
+
+		http_server_send_error(client, HTTP_501_NOT_IMPLEMENTED);
+		return;
+	}
+
+	// Find a route which matches the requested path. The route decides whether the body is kept in memory.
+	struct http_router_param_t matches[HTTP_ROUTER_MAX_PARAMS];
+	size_t matches_len;
+
+	const struct http_route_t *route = http_router_find(&router, parser->method, parser->path, strlen(parser->path), matches, &matches_len);
+
+	if (!parser->chunked && parser->content_length > http_server_get_max_body_size(route)) {
+		http_server_send_error(client, HTTP_413_PAYLOAD_TOO_LARGE);
+		return;
+	}
+
+	if (route != NULL && !http_server_create_route_state(client, route, matches, matches_len)) {
+		client->terminate = true;
+		http_server_send_error(client, HTTP_500_INTERNAL_SERVER_ERROR);
+		return;
+	}
+
+	// A client which sent Expect: 100-continue may wait for the interim response before sending the body.
+	const char *expect = http_parser_get_header(parser, "Expect");
+
+	if (expect != NULL) {
+
+		if (strcasecmp(expect, "100-continue") != 0) {
+			http_server_send_error(client, HTTP_417_EXPECTATION_FAILED);
+			return;
+		}
+
+		if (parser->chunked || parser->content_length != 0) {
+
+			static const char message[] = "HTTP/1.1 100 Continue\r\n\r\n";
+			http_server_send_data(client, message, sizeof(message) - 1, NULL, 0, false);
+		}
+	}
+}
+
+static size_t http_server_get_max_body_size(const struct http_route_t *route)
+{
+	// Bodies passed on as they arrive don't take up memory, so they are limited separately.
+	if (route != NULL && route->body_handler != NULL) {
+		return (settings.max_streamed_body_size != 0 ? settings.max_streamed_body_size : SIZE_MAX);
+	}
+
+	return (settings.max_body_size != 0 ? settings.max_body_size : HTTP_DEFAULT_MAX_BODY_SIZE);
+}
+
+static bool http_server_stream_body(struct client_t *client)
+{
+	const struct http_parser_t *parser = client->parser;
+	struct http_route_state_t *state = client->route;
+
+	if (parser->body_length == 0) {
+		return true;
+	}
+
+	struct http_request_t request;
+	http_server_prepare_request(client, &request);
+
+	bool accepted = state->route->body_handler(&request, parser->content, parser->body_length, state->route->context);
+	state->user_data = request.user_data;
+
+	return accepted;
+}
+
+static void http_server_handle_request(struct client_t *client)
+{
+	const struct http_parser_t *parser = client->parser;
+
+	// If the client doesn't want to keep the connection alive, terminate the connection after serving the request.
+	client->terminate = !parser->keep_alive;
+
+	struct http_request_t request;
+	http_server_prepare_request(client, &request);
+
+	// The route was found when the headers arrived.
+	if (client->route != NULL) {
+
+		const struct http_route_t *route = client->route->route;
+
+		http_metrics_count_route(client->loop->metrics, route->index);
+		http_server_call_handler(client, route->handler, &request, route->context);
+
+		return;
+	}
+
+	// Is the requested file inside one of the static file directories?
+	struct file_dir_entry_t *dir = http_router_find_directory(&router, parser->path, strlen(parser->path));
+
+	if (dir != NULL) {
+
+		uint64_t start = (client->loop->tracing ? http_trace_get_time() : 0);
+		bool found = http_server_handle_static_file(client, &request, dir);
+
+		if (client->loop->tracing && found) {
+			http_trace_add(&client->loop->trace, HTTP_TRACE_STATIC_FILE, start, (uint64_t)client->socket);
+		}
+
+		if (found) {
+			http_metrics_count_static(client->loop->metrics);
+			return;
+		}
+	}
+
+	http_metrics_count_default(client->loop->metrics);
+
+	// If the request was not requesting anything from a static content path,
+	// let the user of this library handle the request as they see fit.
+	if (settings.handler != NULL) {
+		http_server_call_handler(client, settings.handler, &request, settings.context);
+	}
+	else {
+		http_server_send_error(client, HTTP_404_NOT_FOUND);
+	}
+}
+
+static void http_server_prepare_request(const struct client_t *client, struct http_request_t *request)
+{
+	const struct http_parser_t *parser = client->parser;
+
+	memset(request, 0, sizeof(*request));
+
+	request->requester = client->ip_address;
+	request->method = parser->method;
+	request->request = parser->path;
+	request->query = parser->query;
+	request->content = parser->content;
+	request->content_length = parser->body_length;
+	request->headers = parser->headers;
+	request->headers_len = parser->headers_len;
+
+	const struct http_route_state_t *state = client->route;
+
+	if (state != NULL) {
+
+		request->params = state->params;
+		request->params_len = state->params_len;
+		request->user_data = state->user_data;
+
+		// The body handler has already been given the body.
+		if (state->route->body_handler != NULL) {
+			request->content = NULL;
+			request->content_length = parser->body_received;
+		}
+	}
+}
+
+static bool http_server_create_route_state(struct client_t *client, const struct http_route_t *route,
+	const struct http_router_param_t *matches, size_t matches_len)
+{
+	// The captured values point to the path, copy them to null terminated strings after the state.
+	size_t size = sizeof(struct http_route_state_t);
+
+	for (size_t i = 0; i < matches_len; ++i) {
+		size += matches[i].length + 1;
+	}
+
+	struct http_route_state_t *state = (size <= HTTP_INPUT_BUFFER_SIZE ? http_pool_alloc(&client->loop->buffers) : malloc(size));
+
+	if (state == NULL) {
+		return false;
+	}
+
+	state->route = route;
+	state->params_len = matches_len;
+	state->user_data = NULL;
+	state->size = size;
+
+	char *value = (char *)(state + 1);
+
+	for (size_t i = 0; i < matches_len; ++i) {
+
+		memcpy(value, matches[i].value, matches[i].length);
+		value[matches[i].length] = 0;
+
+		state->params[i].name = matches[i].name;
+		state->params[i].value = value;
+
+		value += matches[i].length + 1;
+	}
+
+	client->route = state;
+	return true;
+}
+
+static void http_server_end_route(struct client_t *client, bool aborted)
+{
+	struct http_route_state_t *state = client->route;
+
+	if (state == NULL) {
+		return;
+	}
+
+	// Let the body handler release whatever it has attached to a request which won't be completed.
+	if (aborted && state->route->body_handler != NULL) {
+
+		struct http_request_t request;
+		http_server_prepare_request(client, &request);
+
+		state->route->body_handler(&request, NULL, 0, state->route->context);
+	}
+
+	client->route = NULL;
+
+	if (state->size <= HTTP_INPUT_BUFFER_SIZE) {
+		http_pool_free(&client->loop->buffers, state);
+	}
+	else {
+		free(state);
+	}
+}
+
+static void http_server_call_handler(struct client_t *client, handle_request_t handler, struct http_request_t *request, void *context)
+{
+	// Only the request handler may defer the response.
+	request->connection = client;
+
+#ifdef HTTP_HANDLER_THREADS
+	if (handlers_started && http_server_dispatch_handler(client, handler, request, context)) {
+		return;
+	}
+#endif
+
+	// The traces are timed with the same clock as the metrics.
+	struct http_loop_t *loop = client->loop;
+	bool timed = (loop->timing || loop->tracing);
+
+	uint64_t start = (timed ? http_metrics_get_time() : 0);
+	struct http_response_t response = handler(request, context);
+
+	if (timed) {
+
+		uint64_t duration = http_metrics_get_time() - start;
+
+		if (loop->timing) {
+			http_metrics_observe(loop->metrics, HTTP_HISTOGRAM_HANDLER, duration);
+		}
+
+		if (loop->tracing) {
+			http_trace_add_span(&loop->trace, HTTP_TRACE_HANDLER, loop->trace.thread, start, duration, (uint64_t)client->socket);
+		}
+	}
+
+	if (client->deferred == NULL) {
+		http_server_send_handler_response(client, response);
+	}
+}
+
+#ifdef HTTP_HANDLER_THREADS
+
+static bool http_server_dispatch_handler(struct client_t *client, handle_request_t handler, struct http_request_t *request, void *context)
+{
+	// The handler thread's response is completed like a deferred one.
+	struct http_deferred_t *deferred = http_server_defer(request);
+
+	if (deferred == NULL) {
+		return false;
+	}
+
+	deferred->handler = handler;
+	deferred->context = context;
+	deferred->request = *request;
+	deferred->request.connection = NULL;
+	deferred->traced = client->loop->tracing;
+
+	// If the handler threads are too far behind, the loop calls the handler itself.
+	if (!http_task_pool_push(&handlers, (size_t)(client->loop - loops), deferred)) {
+
+		client->deferred = NULL;
+		free(deferred);
+
+		return false;
+	}
+
+	return true;
+}
+
+static void http_server_run_handler(void *task, size_t thread)
+{
+	struct http_deferred_t *deferred = task;
+
+	// The time is recorded by the loop, which owns the counters and the trace.
+	bool timed = (deferred->loop->timing || deferred->traced);
+
+	deferred->handler_start = (timed ? http_metrics_get_time() : 0);
+	deferred->handler_thread = (uint32_t)thread;
+
+	struct http_response_t response = deferred->handler(&deferred->request, deferred->context);
+
+	deferred->handler_time = (timed ? http_metrics_get_time() - deferred->handler_start : 0);
+	http_server_complete(deferred, &response);
+}
+
+#endif
+
+static void http_server_send_handler_response(struct client_t *client, struct http_response_t response)
+{
+	// If the handler supplied validators which match the client's cached copy, the content doesn't need to be sent.
+	if (response.message == HTTP_200_OK &&
+		http_server_is_not_modified(client, response.etag, response.last_modified)) {
+
+		response.message = HTTP_304_NOT_MODIFIED;
+		response.content = NULL;
+		response.generator = NULL;
+	}
+
+	// Compress large enough responses if the client accepts it.
+	char *compressed = NULL;
+	size_t compressed_len;
+
+	if (http_server_should_compress(client, &response) &&
+		http_compress_gzip(response.content, response.content_length, &compressed, &compressed_len)) {
+
+		// The compressed copy is sent instead, so the original content is no longer needed.
+		if (response.release != NULL) {
+			response.release(response.content_context);
+			response.release = NULL;
+		}
+
+		response.content = compressed;
+		response.content_length = compressed_len;
+		response.content_encoding = "gzip";
+	}
+
+	// Content which isn't going to be sent can be released right away.
+	if (response.release != NULL && response.content == NULL && response.generator == NULL) {
+		response.release(response.content_context);
+		response.release = NULL;
+	}
+
+	http_server_send_response(client, &response, false);
+	free(compressed);
+}
+
+static bool http_server_should_compress(const struct client_t *client, struct http_response_t *response)
+{
+	if (settings.compression_threshold == 0 ||
+		response->content == NULL ||
+		response->generator != NULL ||
+		response->content_encoding != NULL ||
+		!http_compress_is_compressible(response->content_type)) {
+
+		return false;
+	}
+
+	// If response length is not set, assume it is plain text and use strlen to calculate its length.
+	if (response->content_length == 0) {
+		response->content_length = strlen(response->content);
+	}
+
+	if (response->content_length < settings.compression_threshold) {
+		return false;
+	}
+
+	const char *accept_encoding = http_parser_get_header(client->parser, "Accept-Encoding");
+	return (accept_encoding != NULL && string_accepts_encoding(accept_encoding, "gzip"));
+}
+
+static void http_server_send_error(struct client_t *client, enum http_message_t message)
+{
+	struct http_response_t failure;
+	memset(&failure, 0, sizeof(failure));
+
+	failure.message = message;
+
+	// Malformed requests can't be recovered from, the following data can't be trusted to start a new request.
+	// The same goes for refused requests, whose body is left unread.
+	if (message == HTTP_400_BAD_REQUEST ||
+		message == HTTP_413_PAYLOAD_TOO_LARGE ||
+		message == HTTP_417_EXPECTATION_FAILED ||
+		message == HTTP_501_NOT_IMPLEMENTED) {
+		client->terminate = true;
+	}
+
+	http_server_send_response(client, &failure, false);
+}
+
+static void http_server_start_response(struct client_t *client, enum http_message_t message, size_t content_length)
+{
+	http_metrics_count_response(client->loop->metrics, message);
+
+	uint64_t now = (client->loop->timing ? http_metrics_get_time() : 0);
+
+	// A response started while an earlier one is still being sent is timed with it.
+	if (client->write_start == 0) {
+		client->write_start = now;
+	}
+
+#ifdef HTTP_ACCESS_LOG
+	if (client->loop->access_log != NULL) {
+		http_server_log_request(client, message, content_length, now);
+	}
+#endif
+
+	// The next request in the buffer is timed from here.
+	client->request_start = 0;
+}
+
+#ifdef HTTP_ACCESS_LOG
+
+static void http_server_log_request(const struct client_t *client, enum http_message_t message, size_t content_length, uint64_t now)
+{
+	struct http_log_record_t *record = http_log_reserve(client->loop->access_log);
+
+	// The loop never waits for the log thread. If it has fallen behind, the request isn't logged.
+	if (record == NULL) {
+		http_metrics_add(&client->loop->metrics->access_log_dropped, 1);
+		return;
+	}
+
+	record->time = (int64_t)time(NULL);
+	record->duration = (client->request_start != 0 ? now - client->request_start : 0);
+	record->bytes = (content_length != SIZE_MAX ? (uint64_t)content_length : HTTP_LOG_UNKNOWN_LENGTH);
+	record->status = (uint16_t)message;
+
+	memcpy(record->address, client->ip_address, sizeof(record->address));
+
+	// The parser holds whatever was received of the request, even when the response is an error.
+	const struct http_parser_t *parser = client->parser;
+
+	if (parser != NULL) {
+		http_log_set_request(record, parser->method, parser->path, parser->query, parser->protocol,
+			http_parser_get_header(parser, "Referer"), http_parser_get_header(parser, "User-Agent"));
+	}
+	else {
+		http_log_set_request(record, NULL, NULL, NULL, NULL, NULL, NULL);
+	}
+
+	http_log_push(client->loop->access_log);
+}
+
+#endif
+
+static void http_server_send_response(struct client_t *client, const struct http_response_t *response, bool is_static_file)
+{
+	size_t content_length = 0;
+
+	if (response->content != NULL && response->content_type != NULL && response->generator == NULL) {
+
+		content_length = response->content_length;
+
+		// If response length is not set, assume it is plain text and use strlen to calculate its length.
+		if (content_length == 0) {
+			content_length = strlen(response->content);
+		}
+	}
+
+	char header[HTTP_HEADER_BUFFER_SIZE];
+	size_t header_len = http_server_format_full_header(client, header, sizeof(header), response, content_length, is_static_file, NULL);
+
+	// The handler added more headers than fit into a response.
+	if (header_len == 0) {
+
+		if (response->release != NULL) {
+			response->release(response->content_context);
+		}
+
+		http_server_send_error(client, HTTP_500_INTERNAL_SERVER_ERROR);
+		return;
+	}
+
+	// The length of generated content isn't known until all of it has been generated.
+	http_server_start_response(client, response->message, response->generator != NULL ? SIZE_MAX : content_length);
+
+	if (response->generator != NULL) {
+		http_server_send_generated(client, header, header_len, response);
+	}
+	else if (response->release != NULL) {
+		http_server_send_content(client, header, header_len, response, content_length);
+	}
+	else {
+		// Send the header and the content together. Whatever the socket can't take right now is copied
+		// to the output queue, so the handler's buffer is no longer needed after this.
+		http_server_send_data(client, header, header_len, response->content, content_length, false);
+	}
+}
+
+static bool http_server_send_header(struct client_t *client, const struct http_response_t *response, size_t content_length, bool is_static_file, const char *extra_headers)
+{
+	char buffer[HTTP_HEADER_BUFFER_SIZE];
+	size_t len = http_server_format_full_header(client, buffer, sizeof(buffer), response, content_length, is_static_file, extra_headers);
+
+	if (len == 0) {
+		http_server_drop_client(client);
+		return false;
+	}
+
+	http_server_start_response(client, response->message, content_length);
+
+	// Hold the header back if it's followed by the content, so they can be sent in the same packet.
+	return http_server_send_data(client, buffer, len, NULL, 0, content_length != 0);
+}
+
+static size_t http_server_format_full_header(const struct client_t *client, char *buffer, size_t size, const struct http_response_t *response, size_t content_length, bool is_static_file, const char *extra_headers)
+{
+	size_t len = http_server_format_header(buffer, size, response, content_length, is_static_file, extra_headers);
+
+	// Finish the header with the connection specific lines.
+	const char *end = http_server_get_header_end(client);
+	size_t end_len = strlen(end);
+
+	if (len + end_len > size) {
+		return 0;
+	}
+
+	memcpy(&buffer[len], end, end_len);
+	return len + end_len;
+}
+
+static bool http_server_send_data(struct client_t *client, const char *header, size_t header_len, const char *data, size_t data_len, bool more)
+{
+	ssize_t sent = http_server_write_now(client, header, header_len, data, data_len, more);
+
+	if (sent < 0) {
+		return false;
+	}
+
+	// Queue the rest to be sent when the socket becomes writable.
+	if ((size_t)sent < header_len + data_len) {
+
+		size_t header_sent = ((size_t)sent < header_len ? (size_t)sent : header_len);
+		size_t data_sent = (size_t)sent - header_sent;
+
+		if (!http_server_queue_copies(client, &header[header_sent], header_len - header_sent, &data[data_sent], data_len - data_sent)) {
+			return false;
+		}
+
+		http_server_wait_writable(client, true);
+	}
+
+	return true;
+}
+
+static bool http_server_send_content(struct client_t *client, const char *header, size_t header_len, const struct http_response_t *response, size_t content_length)
+{
+	ssize_t sent = http_server_write_now(client, header, header_len, response->content, content_length, false);
+
+	if (sent < 0) {
+		response->release(response->content_context);
+		return false;
+	}
+
+	// The content is owned by the response until it's released, so the unsent part of it is queued as is.
+	// Only the rest of the header has to be copied.
+	if ((size_t)sent < header_len) {
+
+		if (!http_server_queue_copies(client, &header[sent], header_len - (size_t)sent, NULL, 0)) {
+			response->release(response->content_context);
+			return false;
+		}
+
+		sent = (ssize_t)header_len;
+	}
+
+	size_t offset = (size_t)sent - header_len;
+
+	if (offset == content_length) {
+		response->release(response->content_context);
+		return true;
+	}
+
+	struct http_output_t *output = http_pool_alloc(&client->loop->outputs);
+
+	if (output == NULL) {
+		response->release(response->content_context);
+		http_server_drop_client(client);
+		return false;
+	}
+
+	memset(output, 0, sizeof(*output));
+
+	output->pool = &client->loop->outputs;
+	output->file = -1;
+	output->data = response->content;
+	output->offset = (off_t)offset;
+	output->length = content_length - offset;
+	output->release = response->release;
+	output->context = response->content_context;
+
+	http_server_append_output(client, output);
+	http_server_wait_writable(client, true);
+
+	return true;
+}
+
+static bool http_server_send_generated(struct client_t *client, const char *header, size_t header_len, const struct http_response_t *response)
+{
+	// The generator produces the content into a buffer which follows the queue entry, one chunk at a time.
+	// The first chunk is produced when the output queue is flushed, right after the header.
+	struct http_output_t *output = http_pool_alloc(&client->loop->chunks);
+
+	if (output == NULL) {
+
+		if (response->release != NULL) {
+			response->release(response->content_context);
+		}
+
+		http_server_drop_client(client);
+		return false;
+	}
+
+	memset(output, 0, sizeof(*output));
+
+	output->pool = &client->loop->chunks;
+	output->file = -1;
+	output->data = (const char *)(output + 1);
+	output->generator = response->generator;
+	output->release = response->release;
+	output->context = response->content_context;
+
+	// Hold the header back, so it's sent along with the first chunk.
+	if (!http_server_send_data(client, header, header_len, NULL, 0, true)) {
+		http_server_free_output(output);
+		return false;
+	}
+
+	http_server_append_output(client, output);
+	return true;
+}
+
+static ssize_t http_server_write_now(struct client_t *client, const char *header, size_t header_len, const char *data, size_t data_len, bool more)
+{
+	// Earlier data is still waiting to be sent, nothing can be sent before it.
+	if (client->output != NULL) {
+		return 0;
+	}
+
+	// Try sending the data right away with a single call.
+	struct iovec buffers[2] = {
+		{ (void *)header, header_len },
+		{ (void *)data, data_len },
+	};
+
+	struct msghdr message;
+	memset(&message, 0, sizeof(message));
+
+	message.msg_iov = buffers;
+	message.msg_iovlen = (data_len != 0 ? 2 : 1);
+
+	ssize_t count;
+	uint64_t start = (client->loop->tracing ? http_trace_get_time() : 0);
+
+	do {
+		count = sendmsg(client->socket, &message, (more ? MSG_MORE : 0));
+	} while (count < 0 && errno == EINTR);
+
+	if (client->loop->tracing) {
+		http_trace_add(&client->loop->trace, HTTP_TRACE_SEND, start, (uint64_t)(count > 0 ? count : 0));
+	}
+
+	if (count < 0) {
+
+		if (errno != EAGAIN && errno != EWOULDBLOCK) {
+			http_server_drop_client(client);
+			return -1;
+		}
+
+		count = 0;
+	}
+
+	http_metrics_add(&client->loop->metrics->bytes_sent, (uint64_t)count);
+	return count;
+}
+
+static size_t http_server_format_header(char *buffer, size_t size, const struct http_response_t *response, size_t content_length, bool is_static_file, const char *extra_headers)
+{
+	size_t len = 0;
+
+	#define FORMAT_HEADER(...)\
+		if (len < size) {\
+			int written = snprintf(&buffer[len], size - len, __VA_ARGS__);\
+			len += (written > 0 ? (size_t)written : 0);\
+		}
+
+	FORMAT_HEADER("HTTP/1.1 %s\r\n", http_server_get_message_text(response->message));
+
+	// Tell the client not to cache dynamically generated responses.
+	if (!is_static_file) {
+		FORMAT_HEADER("Cache-Control: max-age=0, no-cache, must-revalidate, proxy-revalidate\r\n");
+	}
+	else {
+		FORMAT_HEADER("Cache-Control: max-age=2592000, public\r\n");
+	}
+
+	// Validators which the client can use to revalidate its cached copy with a conditional request.
+	if (response->etag != NULL) {
+		FORMAT_HEADER("ETag: %s\r\n", response->etag);
+	}
+
+	if (response->last_modified != 0) {
+
+		char date[64];
+		string_format_http_date(response->last_modified, date, sizeof(date));
+
+		FORMAT_HEADER("Last-Modified: %s\r\n", date);
+	}
+
+	// The length is always sent, so the client knows where the response ends on a persistent connection.
+	// Generated content is sent in chunks, the last of which ends the response. Responses which never have a body need neither.
+	if (response->message != HTTP_204_NO_CONTENT &&
+		response->message != HTTP_304_NOT_MODIFIED) {
+
+		if (response->generator != NULL) {
+			FORMAT_HEADER("Transfer-Encoding: chunked\r\n");
+		}
+		else {
+			FORMAT_HEADER("Content-Length: %zu\r\n", content_length);
+		}
+	}
+
+	if ((content_length != 0 || response->generator != NULL) && response->content_type != NULL) {
+		FORMAT_HEADER("Content-Type: %s\r\n", response->content_type);
+	}
+
+	if (response->content_encoding != NULL) {
+		FORMAT_HEADER("Content-Encoding: %s\r\n", response->content_encoding);
+	}
+
+	// Content which may be sent compressed varies by the client's Accept-Encoding header.
+	if (response->content_encoding != NULL ||
+		((is_static_file || settings.compression_threshold != 0) && http_compress_is_compressible(response->content_type))) {
+
+		FORMAT_HEADER("Vary: Accept-Encoding\r\n");
+	}
+
+	// Static files can be requested in parts.
+	if (is_static_file) {
+		FORMAT_HEADER("Accept-Ranges: bytes\r\n");
+	}
+
+	if (extra_headers != NULL) {
+		FORMAT_HEADER("%s", extra_headers);
+	}
+
+	// Custom headers added by the handler. Line breaks would let the value inject headers of its own,
+	// so headers which contain them are left out.
+	for (size_t i = 0; i < response->headers_len; ++i) {
+
+		const struct http_header_t *header = &response->headers[i];
+
+		if (header->name == NULL || header->value == NULL ||
+			strpbrk(header->name, "\r\n: \t") != NULL || strpbrk(header->value, "\r\n") != NULL) {
+			continue;
+		}
+
+		FORMAT_HEADER("%s: %s\r\n", header->name, header->value);
+	}
+
+	FORMAT_HEADER("Access-Control-Allow-Origin: *\r\n");
+
+	#undef FORMAT_HEADER
+
+	// The header didn't fit into the buffer.
+	if (len >= size) {
+		return 0;
+	}
+
+	return len;
+}
+
+static const char *http_server_get_header_end(const struct client_t *client)
+{
+	// Keep the connection alive unless the client wants to terminate it. The header ends with an empty line.
+	return (client->terminate ? "\r\n" : "Connection: keep-alive\r\n\r\n");
+}
+
+static bool http_server_flush(struct client_t *client)
+{
+	while (client->output != NULL) {
+
+		struct http_output_t *output = client->output;
+
+		for (;;) {
+
+			// Generated content is produced a chunk at a time, once the previous chunk has been sent.
+			if (output->length == 0 && output->generator != NULL) {
+				http_server_generate_chunk(output);
+			}
+
+			if (output->length == 0) {
+				break;
+			}
+
+			ssize_t sent;
+			uint64_t start = (client->loop->tracing ? http_trace_get_time() : 0);
+
+			// Send files straight from the page cache to the socket, without copying them to userspace.
+			if (output->file >= 0) {
+				sent = http_socket_send_file(client->socket, output->file, &output->offset, output->length);
+			}
+			else {
+				sent = write(client->socket, &output->data[output->offset], output->length);
+
+				if (sent > 0) {
+					output->offset += sent;
+				}
+			}
+
+			if (client->loop->tracing) {
+				http_trace_add(&client->loop->trace, HTTP_TRACE_SEND, start, (uint64_t)(sent > 0 ? sent : 0));
+			}
+
+			if (sent < 0) {
+
+				// The socket buffer is full. Continue when the event backend reports the socket is writable again.
+				if (errno == EAGAIN || errno == EWOULDBLOCK) {
+					http_server_wait_writable(client, true);
+					return false;
+				}
+
+				if (errno == EINTR) {
+					continue;
+				}
+
+				http_server_drop_client(client);
+				return false;
+			}
+
+			// The file was truncated while it was being sent. The promised length can't be delivered anymore.
+			if (sent == 0) {
+				http_server_drop_client(client);
+				return false;
+			}
+
+			output->length -= (size_t)sent;
+			http_metrics_add(&client->loop->metrics->bytes_sent, (uint64_t)sent);
+		}
+
+		client->output = output->next;
+		http_server_free_output(output);
+	}
+
+	// Everything has been passed to the kernel, including the responses which were queued behind the oldest one.
+	if (client->write_start != 0) {
+		http_metrics_observe(client->loop->metrics, HTTP_HISTOGRAM_WRITE, http_metrics_get_time() - client->write_start);
+		client->write_start = 0;
+	}
+
+	http_server_wait_writable(client, false);
+	return true;
+}
+
+static void http_server_queue_output(struct client_t *client, int file, const char *data, off_t offset, size_t length, struct http_cache_entry_t *entry)
+{
+	struct http_output_t *output = http_pool_alloc(&client->loop->outputs);
+
+	if (output == NULL) {
+
+		if (file >= 0) {
+			close(file);
+		}
+
+		http_server_drop_client(client);
+		return;
+	}
+
+	output->pool = &client->loop->outputs;
+	output->generator = NULL;
+	output->release = NULL;
+	output->file = file;
+	output->data = data;
+	output->offset = offset;
+	output->length = length;
+	output->entry = entry;
+
+	// Keep the cached data alive until it has been sent.
+	if (entry != NULL) {
+		http_cache_acquire(entry);
+	}
+
+	http_server_append_output(client, output);
+}
+
+static void http_server_queue_copy(struct client_t *client, const char *data, size_t length)
+{
+	http_server_queue_copies(client, data, length, NULL, 0);
+}
+
+static bool http_server_queue_copies(struct client_t *client, const char *first, size_t first_len, const char *second, size_t second_len)
+{
+	// Store a copy of the data in the same allocation as the queue entry. Small copies fit into a pooled buffer.
+	size_t size = sizeof(struct http_output_t) + first_len + second_len;
+	struct http_pool_t *pool = (size <= HTTP_INPUT_BUFFER_SIZE ? &client->loop->buffers : NULL);
+
+	struct http_output_t *output = (pool != NULL ? http_pool_alloc(pool) : malloc(size));
+
+	if (output == NULL) {
+		http_server_drop_client(client);
+		return false;
+	}
+
+	output->pool = pool;
+	output->generator = NULL;
+	output->release = NULL;
+
+	char *data = (char *)(output + 1);
+
+	if (first_len != 0) {
+		memcpy(data, first, first_len);
+	}
+	if (second_len != 0) {
+		memcpy(&data[first_len], second, second_len);
+	}
+
+	output->file = -1;
+	output->data = data;
+	output->offset = 0;
+	output->length = first_len + second_len;
+	output->entry = NULL;
+
+	http_server_append_output(client, output);
+	return true;
+}
+
+static void http_server_append_output(struct client_t *client, struct http_output_t *output)
+{
+	output->next = NULL;
+
+	// Add the data to the end of the queue.
+	struct http_output_t **last = &client->output;
+
+	while (*last != NULL) {
+		last = &(*last)->next;
+	}
+
+	*last = output;
+}
+
+static void http_server_free_output(struct http_output_t *output)
+{
+	if (output->file >= 0) {
+		close(output->file);
+	}
+
+	if (output->entry != NULL) {
+		http_cache_release(output->entry);
+	}
+
+	if (output->release != NULL) {
+		output->release(output->context);
+	}
+
+	if (output->pool != NULL) {
+		http_pool_free(output->pool, output);
+	}
+	else {
+		free(output);
+	}
+}
+
+static void http_server_generate_chunk(struct http_output_t *output)
+{
+	// The size of the chunk is written in front of the data once the length is known, so the buffer starts with room for it.
+	char *buffer = (char *)(output + 1);
+	char *data = &buffer[HTTP_CHUNK_SIZE_LENGTH];
+
+	size_t size = HTTP_CHUNK_BUFFER_SIZE - HTTP_CHUNK_SIZE_LENGTH - 2;
+	size_t length = output->generator(data, size, output->context);
+
+	// An empty chunk ends the content.
+	if (length == 0) {
+
+		output->generator = NULL;
+		output->data = buffer;
+		output->offset = 0;
+		output->length = 5;
+
+		memcpy(buffer, "0\r\n\r\n", 5);
+		return;
+	}
+
+	if (length > size) {
+		length = size;
+	}
+
+	char chunk_size[HTTP_CHUNK_SIZE_LENGTH + 1];
+	int chunk_size_len = snprintf(chunk_size, sizeof(chunk_size), "%zx\r\n", length);
+
+	memcpy(data - chunk_size_len, chunk_size, (size_t)chunk_size_len);
+	memcpy(&data[length], "\r\n", 2);
+
+	output->data = buffer;
+	output->offset = HTTP_CHUNK_SIZE_LENGTH - chunk_size_len;
+	output->length = (size_t)chunk_size_len + length + 2;
+}
+
+static void http_server_wait_writable(struct client_t *client, bool writable)
+{
+	if (client->waiting_writable == writable) {
+		return;
+	}
+
+	// With io_uring the requests are received without polling the socket for reading.
+	uint32_t events = (http_poll_is_ring(&client->loop->poll_set) ? 0 : HTTP_POLL_READ) | (writable ? HTTP_POLL_WRITE : 0);
+
+	if (http_poll_modify(&client->loop->poll_set, client->socket, events, client)) {
+		client->waiting_writable = writable;
+	}
+}
+
+static void http_server_drop_client(struct client_t *client)
+{
+	// Discard the data which was still waiting to be sent and terminate the connection.
+	while (client->output != NULL) {
+
+		struct http_output_t *output = client->output;
+		client->output = output->next;
+
+		http_server_free_output(output);
+	}
+
+	client->terminate = true;
+}
+
+static bool http_server_handle_static_file(struct client_t *client, const struct http_request_t *request, const struct file_dir_entry_t *dir)
+{
+	const char *req_path = request->request;
+	const char *file_name = &req_path[dir->path_len];
+
+	// Requests which attempt to access a parent folder have already been refused by the parser.
+
+	char ext[8];
+	string_get_file_extension(file_name, ext, sizeof(ext));
+
+	char relative[512];
+
+	// Interpret a missing file extension as an index.html for the folder. Both are relative to the directory.
+	if (*ext == 0) {
+		snprintf(relative, sizeof(relative), "%s/index.html", file_name);
+		strcpy(ext, ".html");
+	}
+	else {
+		snprintf(relative, sizeof(relative), "%s", file_name);
+	}
+
+	// Requests for files which don't exist are refused without touching the filesystem, so they can fall
+	// through to the routes cheaply.
+	uint32_t variants = http_index_find(&client->loop->index, dir->index, relative);
+
+	if (variants == 0) {
+		return false;
+	}
+
+	const char *content_type = http_server_get_content_type(ext);
+
+	// Find out which compressed variants of the file could be sent, in the order of preference.
+	// The uncompressed file is the last option.
+	const char *encodings[3];
+	size_t encodings_len = 0;
+
+	const char *accept_encoding = http_parser_get_header(client->parser, "Accept-Encoding");
+
+	if (accept_encoding != NULL && http_compress_is_compressible(http_server_get_file_content_type(req_path))) {
+
+		if (string_accepts_encoding(accept_encoding, "br")) {
+			encodings[encodings_len++] = "br";
+		}
+		if (string_accepts_encoding(accept_encoding, "gzip")) {
+			encodings[encodings_len++] = "gzip";
+		}
+	}
+
+	encodings[encodings_len++] = NULL;
+
+	time_t now = time(NULL);
+
+	for (size_t i = 0; i < encodings_len; ++i) {
+
+		if (http_server_send_static_variant(client, dir, req_path, relative, content_type, encodings[i], variants, now)) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+static bool http_server_send_static_variant(struct client_t *client, const struct file_dir_entry_t *dir, const char *req_path,
+	const char *relative, const char *content_type, const char *encoding, uint32_t variants, time_t now)
+{
+	// Recently requested files are served from memory along with a prepared response header.
+	// Each variant of the file is cached separately.
+	struct http_cache_t *cache = &client->loop->cache;
+
+	char key[HTTP_CACHE_KEY_SIZE];
+	snprintf(key, sizeof(key), "%s:%s", (encoding != NULL ? encoding : ""), req_path);
+
+	struct http_cache_entry_t *entry = http_cache_find(cache, key, now);
+
+	if (entry != NULL) {
+		http_server_send_cached_entry(client, entry);
+		return true;
+	}
+
+	char path[512];
+	int path_len = snprintf(path, sizeof(path), "%s/%s", dir->directory, relative);
+
+	if (path_len < 0 || (size_t)path_len >= sizeof(path)) {
+		return false;
+	}
+
+	// Look for a precompressed variant of the file next to it (e.g. style.css.gz).
+	char variant[sizeof(path) + 4];
+
+	bool brotli = (encoding != NULL && strcmp(encoding, "br") == 0);
+
+	if (encoding != NULL) {
+		snprintf(variant, sizeof(variant), "%s.%s", path, (brotli ? "br" : "gz"));
+	}
+
+	// The index tells which of the variants exist, so only those are opened.
+	uint32_t required = (encoding == NULL ? HTTP_INDEX_PLAIN : (brotli ? HTTP_INDEX_BROTLI : HTTP_INDEX_GZIP));
+
+	struct stat info;
+	int file = ((variants & required) != 0 ? http_server_open_file(encoding != NULL ? variant : path, &info) : -1);
+
+	if (file >= 0) {
+		http_server_send_static_file(client, key, encoding != NULL ? variant : path, file, &info, content_type, encoding, now);
+		return true;
+	}
+
+	// Without a precompressed variant, gzip the file and keep the result in the cache
+	// so it only has to be compressed once.
+	if (encoding != NULL && !brotli && (variants & HTTP_INDEX_PLAIN) != 0 && cache->max_size != 0) {
+
+		file = http_server_open_file(path, &info);
+
+		if (file < 0) {
+			return false;
+		}
+
+		entry = NULL;
+
+		if ((size_t)info.st_size <= cache->max_size / HTTP_CACHE_MAX_FILE_FRACTION) {
 
-	char path[512];
+			char *data = http_server_read_file(file, (size_t)info.st_size);
+			char *compressed;
+			size_t compressed_len;
 
-	// Interpret a missing file extension as an index.html for the folder.
-	if (*ext == 0) {
-		snprintf(path, sizeof(path), "%s/%s/index.html", dir->directory, req_path);
-		strcpy(ext, ".html");
+			if (data != NULL && http_compress_gzip(data, (size_t)info.st_size, &compressed, &compressed_len)) {
+				entry = http_server_cache_data(cache, key, path, compressed, compressed_len, &info, content_type, encoding, now);
+			}
+
+			free(data);
+		}
+
+		// The file couldn't be compressed or it's too large for the cache, send it uncompressed instead.
+		if (entry == NULL) {
+			close(file);
+			return false;
+		}
+
+		close(file);
+		http_server_send_cached_entry(client, entry);
+		return true;
 	}
-	else {
-		snprintf(path, sizeof(path), "%s/%s", dir->directory, file_name);
+
+	return false;
+}
+
+static void http_server_send_static_file(struct client_t *client, const char *key, const char *path,
+	int file, const struct stat *info, const char *content_type, const char *encoding, time_t now)
+{
+	// Generate validators from the file's metadata, and don't send the file if the client already has it.
+	char etag[HTTP_ETAG_SIZE];
+	http_server_format_etag(info->st_mtime, info->st_size, encoding, etag, sizeof(etag));
+
+	// Create a response.
+	struct http_response_t response;
+	memset(&response, 0, sizeof(response));
+
+	response.message = HTTP_200_OK;
+	response.content_type = content_type;
+	response.content_encoding = encoding;
+	response.etag = etag;
+	response.last_modified = info->st_mtime;
+
+	if (http_server_is_not_modified(client, etag, info->st_mtime)) {
+		close(file);
+		http_server_send_not_modified(client, &response);
+		return;
+	}
+
+	// Send only the requested parts of the file if the client asked for a range.
+	if (http_server_send_ranges(client, &response, file, NULL, info->st_size)) {
+		close(file);
+		return;
+	}
+
+	// Small enough files are read into the cache and sent from there.
+	struct http_cache_t *cache = &client->loop->cache;
+
+	if (cache->max_size != 0 && (size_t)info->st_size <= cache->max_size / HTTP_CACHE_MAX_FILE_FRACTION) {
+
+		char *data = http_server_read_file(file, (size_t)info->st_size);
+		struct http_cache_entry_t *entry = NULL;
+
+		if (data != NULL) {
+			entry = http_server_cache_data(cache, key, path, data, (size_t)info->st_size, info, content_type, encoding, now);
+		}
+
+		if (entry != NULL) {
+			close(file);
+			http_server_send_cached_file(client, entry);
+			return;
+		}
+	}
+
+	if (!http_server_send_header(client, &response, (size_t)info->st_size, true, NULL)) {
+		close(file);
+		return;
+	}
+
+	// Queue the file to be sent after the header. The socket may not be able to take all of it at once,
+	// in which case the rest is sent when the socket becomes writable again.
+	http_server_queue_output(client, file, NULL, 0, (size_t)info->st_size, NULL);
+}
+
+static void http_server_send_cached_entry(struct client_t *client, struct http_cache_entry_t *entry)
+{
+	char etag[HTTP_ETAG_SIZE];
+	http_server_format_etag(entry->modified, entry->file_size, entry->content_encoding, etag, sizeof(etag));
+
+	struct http_response_t response;
+	memset(&response, 0, sizeof(response));
+
+	response.message = HTTP_200_OK;
+	response.content_type = entry->content_type;
+	response.content_encoding = entry->content_encoding;
+	response.etag = etag;
+	response.last_modified = entry->modified;
+
+	if (http_server_is_not_modified(client, etag, entry->modified)) {
+		http_server_send_not_modified(client, &response);
+	}
+	else if (!http_server_send_ranges(client, &response, -1, entry, (off_t)entry->size)) {
+		http_server_send_cached_file(client, entry);
 	}
+}
 
-	FILE *file = fopen(path, "rb");
+static int http_server_open_file(const char *path, struct stat *info)
+{
+	int file = open(path, O_RDONLY);
 
 	// Requested file does not exist or it can't be opened.
-	if (file == NULL) {
-		return false;
+	if (file < 0) {
+		return -1;
+	}
+
+	// Get the size of the file. Only regular files can be served.
+	if (fstat(file, info) != 0 || !S_ISREG(info->st_mode)) {
+		close(file);
+		return -1;
+	}
+
+	return file;
+}
+
+static char *http_server_read_file(int file, size_t size)
+{
+	char *data = malloc(size != 0 ? size : 1);
+
+	if (data == NULL) {
+		return NULL;
 	}
 
-	// Get the size of the file.
-	fseek(file, 0, SEEK_END);
-	long length = ftell(file);
-	fseek(file, 0, SEEK_SET);
+	// Read the contents of the file.
+	for (size_t offset = 0; offset < size; ) {
+
+		ssize_t count = pread(file, &data[offset], size - offset, (off_t)offset);
 
-	if (length >= sizeof(file_buffer)) {
-		length = sizeof(file_buffer) - 1;
+		if (count <= 0) {
+			free(data);
+			return NULL;
+		}
+
+		offset += (size_t)count;
 	}
 
-	// Create a response.
+	return data;
+}
+
+static struct http_cache_entry_t *http_server_cache_data(struct http_cache_t *cache, const char *key, const char *path,
+	char *data, size_t size, const struct stat *info, const char *content_type, const char *encoding, time_t now)
+{
+	char *header = malloc(HTTP_CACHE_HEADER_SIZE);
+
+	if (header == NULL) {
+		free(data);
+		return NULL;
+	}
+
+	char etag[HTTP_ETAG_SIZE];
+	http_server_format_etag(info->st_mtime, info->st_size, encoding, etag, sizeof(etag));
+
 	struct http_response_t response;
 	memset(&response, 0, sizeof(response));
 
 	response.message = HTTP_200_OK;
+	response.content_type = content_type;
+	response.content_encoding = encoding;
+	response.etag = etag;
+	response.last_modified = info->st_mtime;
+
+	// Prepare everything in the response header except for the connection specific lines.
+	size_t header_len = http_server_format_header(header, HTTP_CACHE_HEADER_SIZE, &response, size, true, NULL);
+
+	if (header_len == 0) {
+		free(header);
+		free(data);
+		return NULL;
+	}
+
+	struct http_cache_entry_t *entry = http_cache_insert(cache, key, path, header, header_len, data, size, info, now);
+
+	if (entry != NULL) {
+		entry->content_type = content_type;
+		entry->content_encoding = encoding;
+	}
+
+	return entry;
+}
+
+static void http_server_send_cached_file(struct client_t *client, struct http_cache_entry_t *entry)
+{
+	const char *end = http_server_get_header_end(client);
+
+	struct iovec buffers[3] = {
+		{ entry->header, entry->header_len },
+		{ (void *)end, strlen(end) },
+		{ entry->data, entry->size },
+	};
+
+	size_t header_len = buffers[0].iov_len + buffers[1].iov_len;
+
+	http_server_start_response(client, HTTP_200_OK, entry->size);
+
+	// Send the header and the file with a single call.
+	uint64_t start = (client->loop->tracing ? http_trace_get_time() : 0);
+	ssize_t sent = writev(client->socket, buffers, 3);
+
+	if (client->loop->tracing) {
+		http_trace_add(&client->loop->trace, HTTP_TRACE_SEND, start, (uint64_t)(sent > 0 ? sent : 0));
+	}
+
+	if (sent > 0) {
+		http_metrics_add(&client->loop->metrics->bytes_sent, (uint64_t)sent);
+	}
+
+	if (sent < 0) {
+
+		if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+			http_server_drop_client(client);
+			return;
+		}
+
+		sent = 0;
+	}
+
+	// The socket buffer didn't have room for the entire header. Queue the rest of it before the file.
+	if ((size_t)sent < header_len) {
+
+		char header[HTTP_CACHE_HEADER_SIZE + 32];
+
+		memcpy(header, entry->header, entry->header_len);
+		memcpy(&header[entry->header_len], end, buffers[1].iov_len);
+
+		http_server_queue_copy(client, &header[sent], header_len - (size_t)sent);
+		sent = (ssize_t)header_len;
+	}
+
+	// Queue the rest of the file to be sent when the socket becomes writable.
+	size_t offset = (size_t)sent - header_len;
+
+	if (offset < entry->size) {
+		http_server_queue_output(client, -1, entry->data, (off_t)offset, entry->size - offset, entry);
+	}
+}
+
+static bool http_server_send_ranges(struct client_t *client, const struct http_response_t *response, int file, struct http_cache_entry_t *entry, off_t size)
+{
+	const char *range = http_parser_get_header(client->parser, "Range");
+
+	if (range == NULL) {
+		return false;
+	}
+
+	// With If-Range the parts are only sent if the client's copy is still current, otherwise the entire file is sent.
+	const char *if_range = http_parser_get_header(client->parser, "If-Range");
+
+	if (if_range != NULL) {
+
+		time_t date;
+
+		if (*if_range == '"') {
+			if (response->etag == NULL || strcmp(if_range, response->etag) != 0) {
+				return false;
+			}
+		}
+		else if (!string_parse_http_date(if_range, &date) || date != response->last_modified) {
+			return false;
+		}
+	}
+
+	struct http_range_t ranges[HTTP_MAX_RANGES];
+	int count = http_server_parse_ranges(range, size, ranges, HTTP_MAX_RANGES);
+
+	// The header is invalid or not supported, ignore it and send the entire file.
+	if (count < 0) {
+		return false;
+	}
+
+	struct http_response_t partial = *response;
+	char extra[128];
+
+	// None of the ranges overlap with the file.
+	if (count == 0) {
+
+		partial.message = HTTP_416_RANGE_NOT_SATISFIABLE;
+		snprintf(extra, sizeof(extra), "Content-Range: bytes */%lld\r\n", (long long)size);
+
+		http_server_send_header(client, &partial, 0, true, extra);
+		return true;
+	}
+
+	partial.message = HTTP_206_PARTIAL_CONTENT;
+
+	if (count == 1) {
+
+		// A single range is sent as is, described by the Content-Range header.
+		snprintf(extra, sizeof(extra), "Content-Range: bytes %lld-%lld/%lld\r\n",
+			(long long)ranges[0].start, (long long)(ranges[0].start + ranges[0].length - 1), (long long)size);
+
+		if (!http_server_send_header(client, &partial, (size_t)ranges[0].length, true, extra)) {
+			return true;
+		}
 
+		http_server_queue_range(client, file, entry, &ranges[0]);
+	}
+	else {
+		// Several ranges are sent as a multipart message, each part with its own header.
+		char boundary[32], content_type[64], part[256], end[48];
+
+		snprintf(boundary, sizeof(boundary), "%08llx%08x",
+			(unsigned long long)time(NULL), ++client->loop->boundary_counter);
+		snprintf(content_type, sizeof(content_type), "multipart/byteranges; boundary=%s", boundary);
+
+		partial.content_type = content_type;
+
+		const char *part_format = "\r\n--%s\r\nContent-Type: %s\r\nContent-Range: bytes %lld-%lld/%lld\r\n\r\n";
+		int end_len = snprintf(end, sizeof(end), "\r\n--%s--\r\n", boundary);
+
+		// Calculate the length of the entire message.
+		size_t content_length = (size_t)end_len;
+
+		for (int i = 0; i < count; ++i) {
+
+			content_length += (size_t)snprintf(part, sizeof(part), part_format, boundary, response->content_type,
+				(long long)ranges[i].start, (long long)(ranges[i].start + ranges[i].length - 1), (long long)size);
+			content_length += (size_t)ranges[i].length;
+		}
+
+		if (!http_server_send_header(client, &partial, content_length, true, NULL)) {
+			return true;
+		}
+
+		for (int i = 0; i < count; ++i) {
+
+			int part_len = snprintf(part, sizeof(part), part_format, boundary, response->content_type,
+				(long long)ranges[i].start, (long long)(ranges[i].start + ranges[i].length - 1), (long long)size);
+
+			http_server_queue_copy(client, part, (size_t)part_len);
+			http_server_queue_range(client, file, entry, &ranges[i]);
+		}
+
+		http_server_queue_copy(client, end, (size_t)end_len);
+	}
+
+	return true;
+}
+
+static int http_server_parse_ranges(const char *value, off_t size, struct http_range_t *ranges, int max_ranges)
+{
+	// Only byte ranges are supported.
+	if (strncmp(value, "bytes=", 6) != 0) {
+		return -1;
+	}
+
+	const char *c = &value[6];
+	int count = 0;
+
+	for (;;) {
+
+		while (*c == ' ' || *c == '\t') {
+			++c;
+		}
+
+		long long first = -1, last = -1;
+		char *end;
+
+		// Parse the first byte position, which is missing from a suffix range (e.g. -500 for the last 500 bytes).
+		if (*c >= '0' && *c <= '9') {
+			first = strtoll(c, &end, 10);
+			c = end;
+		}
+
+		if (*c++ != '-') {
+			return -1;
+		}
+
+		if (*c >= '0' && *c <= '9') {
+			last = strtoll(c, &end, 10);
+			c = end;
+		}
+
+		// Either of the positions must be present, and they must be in order.
+		if ((first < 0 && last < 0) || (first >= 0 && last >= 0 && last < first)) {
+			return -1;
+		}
+
+		struct http_range_t range;
+
+		if (first < 0) {
+			range.length = (last < size ? last : size);
+			range.start = size - range.length;
+		}
+		else {
+			range.start = first;
+			range.length = (last < 0 || last >= size ? size - 1 : last) - first + 1;
+		}
+
+		// Ranges outside of the file are not satisfiable and are left out.
+		if (range.start < size && range.length > 0) {
+
+			// Too many ranges, let the caller send the entire file instead.
+			if (count >= max_ranges) {
+				return -1;
+			}
+
+			ranges[count++] = range;
+		}
+
+		while (*c == ' ' || *c == '\t') {
+			++c;
+		}
+
+		if (*c == 0) {
+			break;
+		}
+
+		if (*c++ != ',') {
+			return -1;
+		}
+	}
+
+	return count;
+}
+
+static void http_server_queue_range(struct client_t *client, int file, struct http_cache_entry_t *entry, const struct http_range_t *range)
+{
+	// Cached files are sent from memory, others straight from the file at the start of the range.
+	if (entry != NULL) {
+		http_server_queue_output(client, -1, entry->data, range->start, (size_t)range->length, entry);
+		return;
+	}
+
+	// Each queued part closes its file once sent, so each of them needs its own descriptor.
+	int copy = dup(file);
+
+	if (copy < 0) {
+		http_server_drop_client(client);
+		return;
+	}
+
+	http_server_queue_output(client, copy, NULL, range->start, (size_t)range->length, NULL);
+}
+
+static void http_server_format_etag(time_t modified, off_t size, const char *encoding, char *buffer, size_t buffer_len)
+{
+	// A strong entity tag made of the modification time and the size of the file.
+	// Each compressed variant is a different representation, so they need their own tags.
+	snprintf(buffer, buffer_len, "\"%llx-%llx%s%s\"", (unsigned long long)modified, (unsigned long long)size,
+		(encoding != NULL ? "-" : ""), (encoding != NULL ? encoding : ""));
+}
+
+static bool http_server_is_not_modified(const struct client_t *client, const char *etag, time_t last_modified)
+{
+	// Only a GET can be answered with 304 (RFC 9110, section 13.1.2). Other methods have already had their effect
+	// by the time the response is ready, so their response is sent as it is.
+	if (strcmp(client->parser->method, "GET") != 0) {
+		return false;
+	}
+
+	// If-None-Match takes precedence over If-Modified-Since when both are present.
+	const char *if_none_match = http_parser_get_header(client->parser, "If-None-Match");
+
+	if (if_none_match != NULL) {
+		return (etag != NULL && string_matches_etag(if_none_match, etag));
+	}
+
+	const char *if_modified_since = http_parser_get_header(client->parser, "If-Modified-Since");
+	time_t date;
+
+	if (if_modified_since != NULL && last_modified != 0 &&
+		string_parse_http_date(if_modified_since, &date)) {
+
+		return (last_modified <= date);
+	}
+
+	return false;
+}
+
+static void http_server_send_not_modified(struct client_t *client, const struct http_response_t *response)
+{
+	// A 304 response carries the same validators and metadata as the full response would, but no body.
+	struct http_response_t not_modified = *response;
+	not_modified.message = HTTP_304_NOT_MODIFIED;
+
+	http_server_send_header(client, &not_modified, 0, true, NULL);
+}
+
+static const char *http_server_get_file_content_type(const char *file_name)
+{
+	char ext[8];
+	string_get_file_extension(file_name, ext, sizeof(ext));
+
+	// A missing file extension is interpreted as an index.html for the folder.
+	return http_server_get_content_type(*ext != 0 ? ext : ".html");
+}
+
+static const char *http_server_get_content_type(const char *ext)
+{
 	// Set the correct MIME type for the requested file.
 	if (strcmp(ext, ".html") == 0) {
-		response.content_type = "text/html";
+		return "text/html";
 	}
 	else if (strcmp(ext, ".css") == 0) {
-		response.content_type = "text/css";
+		return "text/css";
 	}
 	else if (strcmp(ext, ".js") == 0) {
-		response.content_type = "application/javascript";
+		return "application/javascript";
 	}
 	else if (strcmp(ext, ".png") == 0) {
-		response.content_type = "image/png";
+		return "image/png";
 	}
 	else if (strcmp(ext, ".jpg") == 0) {
-		response.content_type = "image/jpeg";
+		return "image/jpeg";
 	}
 	else if (strcmp(ext, ".gif") == 0) {
-		response.content_type = "image/gif";
+		return "image/gif";
 	}
 	else if (strcmp(ext, ".svg") == 0) {
-		response.content_type = "image/svg+xml";
-	}
-	else {
-		response.content_type = "text/plain";
+		return "image/svg+xml";
 	}
 
-	// Read the contents of the file into a buffer which we can send to the requester.
-	size_t elements_read = fread(file_buffer, length, 1, file);
-	fclose(file);
-
-	response.content_length = elements_read * length;
-	response.content = file_buffer;
-
-	// Null terminate the content buffer.
-	file_buffer[response.content_length] = 0;
-	
-	// Send a response along with the requested file.
-	http_server_send_response(client, &response, true);
-
-	return true;
+	return "text/plain";
 }
 
 static const char *http_server_get_message_text(enum http_message_t message)
@@ -598,6 +3371,9 @@ static const char *http_server_get_message_text(enum http_message_t message)
 	case HTTP_204_NO_CONTENT:
 		return "204 No Content";
 
+	case HTTP_206_PARTIAL_CONTENT:
+		return "206 Partial Content";
+
 	case HTTP_304_NOT_MODIFIED:
 		return "304 Not Modified";
 
@@ -616,9 +3392,69 @@ static const char *http_server_get_message_text(enum http_message_t message)
 	case HTTP_409_CONFLICT:
 		return "409 Conflict";
 
+	case HTTP_413_PAYLOAD_TOO_LARGE:
+		return "413 Payload Too Large";
+
+	case HTTP_416_RANGE_NOT_SATISFIABLE:
+		return "416 Range Not Satisfiable";
+
+	case HTTP_417_EXPECTATION_FAILED:
+		return "417 Expectation Failed";
+
 	case HTTP_500_INTERNAL_SERVER_ERROR:
 		return "500 Internal Server Error";
+
+	case HTTP_501_NOT_IMPLEMENTED:
+		return "501 Not Implemented";
 	}
 
 	return NULL;
 }
+
+static struct http_response_t http_server_handle_metrics(struct http_request_t *request, void *context)
+{
+	struct http_response_t response;
+	memset(&response, 0, sizeof(response));
+
+	struct http_metrics_t **metrics = malloc(loops_len * sizeof(*metrics));
+	char *text = NULL;
+	size_t length = 0;
+
+	if (metrics != NULL) {
+
+		for (size_t i = 0; i < loops_len; ++i) {
+			metrics[i] = loops[i].metrics;
+		}
+
+		text = http_metrics_format(metrics, loops_len, router.routes, router.routes_len, &length);
+		free(metrics);
+	}
+
+	if (text == NULL) {
+		response.message = HTTP_500_INTERNAL_SERVER_ERROR;
+		return response;
+	}
+
+	response.message = HTTP_200_OK;
+	response.content = text;
+	response.content_length = length;
+	response.content_type = "text/plain; version=0.0.4";
+	response.release = free;
+	response.content_context = text;
+
+	return response;
+}
+
+static void http_server_request_trace(int signum)
+{
+	__atomic_store_n(&trace_requested, 1, __ATOMIC_RELAXED);
+
+	// The first loop may be blocked waiting for events. Writing to the wakeup descriptor is safe in a signal handler,
+	// as long as errno is left as it was.
+	if (loops != NULL && loops[0].wakeup_created) {
+
+		int error = errno;
+		http_poll_wakeup_signal(&loops[0].wakeup);
+		errno = error;
+	}
+}
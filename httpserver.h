@@ -5,6 +5,7 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include <stddef.h>
+#include <time.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -16,31 +17,87 @@ enum http_message_t {
 	HTTP_200_OK = 200,
 	HTTP_201_CREATED = 201,
 	HTTP_204_NO_CONTENT = 204,
+	HTTP_206_PARTIAL_CONTENT = 206,
 	HTTP_304_NOT_MODIFIED = 304,
 	HTTP_400_BAD_REQUEST = 400,
 	HTTP_401_UNAUTHORIZED = 401,
 	HTTP_403_FORBIDDEN = 403,
 	HTTP_404_NOT_FOUND = 404,
 	HTTP_409_CONFLICT = 409,
+	HTTP_413_PAYLOAD_TOO_LARGE = 413,
+	HTTP_416_RANGE_NOT_SATISFIABLE = 416,
+	HTTP_417_EXPECTATION_FAILED = 417,
 	HTTP_500_INTERNAL_SERVER_ERROR = 500,
+	HTTP_501_NOT_IMPLEMENTED = 501,
+};
+
+struct http_header_t {
+	const char *name;			// Name of the header without the colon (e.g. 'Location')
+	const char *value;			// Value of the header
+};
+
+struct http_param_t {
+	const char *name;			// Name of the parameter in the route's pattern (e.g. 'id' for /users/:id)
+	const char *value;			// Value of the parameter in the requested path
+};
+
+// A header of a request. The strings point to the received request and are null terminated.
+struct http_request_header_t {
+	const char *name;			// Name of the header as sent by the client
+	const char *value;			// Value of the header without the surrounding white space
+	size_t name_len;
+	size_t value_len;
 };
 
 struct http_request_t {
 	const char *requester;		// IP address of the client who performed the request
 	const char *method;			// The method used by the client. Currently 'GET', 'POST', 'PUT' and 'DELETE' are recognised
-	const char *request;		// Path to the resource requested by the client
-	const char *content;		// Request body, usually used in POST requests
+	const char *request;		// Path to the resource requested by the client, percent-decoded and without the query string
+	const char *query;			// Query string of the request without the question mark, NULL if there is none
+	const char *content;		// Request body, usually used in POST requests. Always null terminated. NULL if the body was passed to a body handler
+	size_t content_length;		// Length of the request body, in bytes
+	const struct http_param_t *params; // Parameters captured by the route which matched the request
+	size_t params_len;			// Number of captured parameters
+	const struct http_request_header_t *headers; // All headers of the request, in the order they were received
+	size_t headers_len;			// Number of headers
+	void *user_data;			// Data attached to the request by the route's body handler. Passed on to the following calls and the request handler
+	void *connection;			// Connection the request was received on, used by http_server_defer. NULL when the response can't be deferred
 };
 
+// Produces the next part of a response body into the buffer, at most size bytes. Returns the number of bytes written,
+// or 0 when the body is complete. The next part is requested once the client has received the previous ones.
+typedef size_t(*generate_content_t)(char *buffer, size_t size, void *context);
+
+// Releases the content or the state of a generator once the response no longer needs it.
+typedef void(*release_content_t)(void *context);
+
 struct http_response_t {
 	enum http_message_t message; // Request status code (see the enum above)
 	const char *content;		// Content to be delivered to the client
 	const char *content_type;	// MIME type of the content
 	size_t content_length;		// Length for the content to be delivered, in bytes
+	const char *content_encoding; // Optional content coding of the content when it's already compressed (e.g. "gzip"). Can be NULL
+	const char *etag;			// Optional entity tag of the content, including the quotes (e.g. "\"v42\""). Can be NULL
+	time_t last_modified;		// Optional modification time of the content. 0 if not used
+	const struct http_header_t *headers; // Optional custom headers added to the response. Like the content, must remain valid after the handler returns
+	size_t headers_len;			// Number of custom headers
+	generate_content_t generator; // Optional callback which produces the content a part at a time, sent with chunked transfer encoding. Used instead of content
+	release_content_t release;	// Optional callback called once the content or the generator is no longer needed. Content which is released is sent without copying it
+	void *content_context;		// Passed to the generator and release callbacks
 };
 
+// A request whose response is completed later with http_server_complete.
+struct http_deferred_t;
+
+// When the server runs several worker threads, the handler may be called from all of them simultaneously.
 typedef struct http_response_t(*handle_request_t)(struct http_request_t *request, void *context);
 
+// Receives the body of a request in parts as they arrive, before the request handler is called. The data is only valid during the call.
+// Returning false refuses the rest of the body, and the request is answered with 500 Internal Server Error. If the request ends before
+// the body is complete (refused, the client disconnects or the connection times out), the handler is called once more with NULL data,
+// so it can release whatever it has attached to the request. The request handler is not called in that case.
+typedef bool(*handle_body_t)(struct http_request_t *request, const char *data, size_t length, void *context);
+
 struct server_settings_t {
 	handle_request_t handler;		// Handler method for custom requests (such as dynamic data in JSON format)
 
@@ -48,6 +105,12 @@ struct server_settings_t {
 	uint16_t max_connections;		// Maximum connections this web server can handle simultaneously
 	uint32_t timeout;				// Socket polling timeout in milliseconds (can be left to zero)
 	uint32_t connection_timeout;	// Connection timeout in seconds for clients who want to keep the connection alive between requests. 60 seconds is a good value
+	uint32_t header_timeout;		// Time in seconds a client has to send the request line and headers once it has started a request. 0 uses connection_timeout
+	uint32_t body_timeout;			// Time in seconds a client has to send the request body after the headers. 0 uses connection_timeout
+	uint32_t write_timeout;			// Time in seconds a client may go without reading any of a pending response. 0 uses connection_timeout
+	uint16_t worker_threads;		// Number of independent event loops, each with its own socket bound with SO_REUSEPORT. 0 or 1 runs a single loop in the thread calling http_server_listen, N starts N - 1 additional threads
+	uint16_t handler_threads;		// Number of threads which run the route handlers and the default handler, so the event loops only do I/O. The handlers must then be thread safe. 0 runs the handlers in the event loops
+	bool io_uring;					// Use io_uring instead of epoll to accept connections and receive requests, which batches the system calls. Falls back to epoll if the kernel doesn't support it (Linux 5.19)
 
 	struct server_directory_t {		// List of directories containing static files
 		const char *path;				// The URL path which links to this directory entry
@@ -55,6 +118,14 @@ struct server_settings_t {
 	} *directories;
 	
 	size_t directories_len;			// Number of items on the list above
+	size_t compression_threshold;	// Handler responses of a compressible type at least this long are gzip compressed for clients which accept it. 0 disables compression
+	size_t cache_size;				// Maximum size of static files kept in memory by each event loop, in bytes. Files up to 1/8 of this are cached. 0 disables caching
+	size_t max_body_size;			// Maximum length of a request body kept in memory for the handler, in bytes. Longer requests are refused with 413 Payload Too Large. 0 uses 1 MB
+	size_t max_streamed_body_size;	// Maximum length of a request body passed to a body handler, in bytes. 0 doesn't limit the length
+	uint16_t trace_sampling;		// Trace every Nth wakeup of each event loop, timing every phase of what the loop does in it. 1 traces every wakeup, 0 disables tracing
+	const char *trace_path;			// File the trace is written to when the process receives SIGUSR2. NULL doesn't handle the signal
+	const char *metrics_path;		// Path on which the server's counters and latency histograms are served in the Prometheus text format (e.g. "/metrics"). NULL doesn't serve them
+	const char *access_log;			// File the requests are logged to in the Combined Log Format followed by the time taken in microseconds, "-" for the standard output. NULL disables the log
 
 	void *context;					// User specified context data. Can be NULL.
 };
@@ -63,8 +134,58 @@ struct server_settings_t {
 
 extern bool http_server_initialize(struct server_settings_t configuration);
 extern void http_server_shutdown(void);
+
+// Waits for events once, for at most the timeout in the settings, and processes them.
 extern void http_server_listen(void);
 
+// Serves requests until http_server_stop is called. Blocks while there's nothing to do instead of waking up periodically.
+extern void http_server_run(void);
+
+// Makes http_server_run return. Can be called from any thread, including the handlers.
+extern void http_server_stop(void);
+
+// Integration into an application's own event loop (epoll, libuv etc.) instead of calling http_server_run. Watch the descriptor
+// for readability (level-triggered) and call http_server_process_ready when it's readable, or when the number of milliseconds
+// returned by http_server_get_timeout has passed (-1 if there's no timeout). Check the timeout again after each call. Only the first
+// event loop is integrated, the worker threads run the rest as usual. The descriptor is -1 if the event backend has none (select).
+extern int http_server_get_poll_fd(void);
+extern void http_server_process_ready(void);
+extern int http_server_get_timeout(void);
+
+// Adds a handler for requests with the given method (NULL for any method) and path pattern. A segment starting
+// with a colon (/users/:id) matches any single path segment and a trailing segment starting with an asterisk
+// (/files/*path) matches the rest of the path. The matched values are passed to the handler as parameters.
+// Routes take precedence over static directories and the default handler in the settings.
+// Add the routes before calling http_server_initialize. They are removed by http_server_shutdown.
+extern bool http_server_add_route(const char *method, const char *pattern, handle_request_t handler, void *context);
+
+// Adds a route whose request body is passed to the body handler as it arrives instead of being kept in memory,
+// which allows uploads of any size. The request handler is called once the entire body has been received.
+extern bool http_server_add_stream_route(const char *method, const char *pattern, handle_body_t body_handler, handle_request_t handler, void *context);
+
+// Defers the response to a request. Called by a request handler, whose return value is then ignored. The connection waits
+// without a timeout until the response is given to http_server_complete, while the server keeps serving other connections.
+// The request is only valid during the handler call, so copy whatever is needed to complete it. Returns NULL if the response
+// can't be deferred (e.g. when called from a body handler or on a handler thread).
+extern struct http_deferred_t *http_server_defer(struct http_request_t *request);
+
+// Sends the response to a deferred request. Can be called from any thread, but only once per deferred request and before
+// http_server_shutdown, even if the client has disconnected. The response is copied, except for content with a release callback
+// or a generator, which are owned by the response until released. Returns false if the response couldn't be copied, in which
+// case the client is sent 500 Internal Server Error instead.
+extern bool http_server_complete(struct http_deferred_t *deferred, const struct http_response_t *response);
+
+// Returns the value of a request header (case insensitive), or NULL if the request has no such header.
+extern const char *http_server_get_header(const struct http_request_t *request, const char *name);
+
+// Returns the value of a parameter captured by the route, or NULL if the route has no such parameter.
+extern const char *http_server_get_param(const struct http_request_t *request, const char *name);
+
+// Writes the latest traced phases of the event loops and the handler threads to a file in the Chrome trace event format,
+// which can be opened in chrome://tracing or Perfetto. Can be called from any thread. Returns false if tracing is disabled
+// or the file couldn't be written.
+extern bool http_server_write_trace(const char *path);
+
 // --------------------------------------------------------------------------------
 
 #ifdef __cplusplus
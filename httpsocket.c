@@ -2,6 +2,10 @@
 #include <errno.h>
 #include <time.h>
 
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif
+
 #ifdef _WIN32
 
 void http_socket_initialize(void)
@@ -40,39 +44,36 @@ void http_socket_set_non_blocking(socket_t sock)
 
 #endif
 
-int http_socket_write_all(socket_t sock, const void *buffer, size_t length)
+void http_socket_set_no_delay(socket_t sock)
 {
-	const char *p = buffer;
-	ssize_t sent;
-
-	while (length > 0) {
+	int opt = 1;
+	setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, (const char *)&opt, sizeof(opt));
+}
 
-		sent = write(sock, p, length);
+ssize_t http_socket_send_file(socket_t sock, int file, off_t *offset, size_t length)
+{
+#ifdef __linux__
+	return sendfile(sock, file, offset, length);
+#else
+	// Copy the data through a buffer on platforms without sendfile().
+	char buffer[16384];
 
-		if (sent < 0) {
+	if (length > sizeof(buffer)) {
+		length = sizeof(buffer);
+	}
 
-			if (errno != EAGAIN) {
-				return -1;
-			}
+	ssize_t count = pread(file, buffer, length, *offset);
 
-			// send error, select and try again.
-			struct timeval tv = { .tv_sec = 1 };
+	if (count <= 0) {
+		return count;
+	}
 
-			fd_set fds;
-			FD_ZERO(&fds);
-			FD_SET(0, &fds);
+	ssize_t sent = send(sock, buffer, count, 0);
 
-			if (select(sock + 1, NULL, &fds, NULL, &tv)) {}
-		}
-		else if (sent == 0) {
-			return -1;
-		}
-		else {
-			// Successful send.
-			p += sent;
-			length -= sent;
-		}
+	if (sent > 0) {
+		*offset += sent;
 	}
 
-	return 0;
+	return sent;
+#endif
 }
@@ -18,8 +18,11 @@
 	#include <sys/types.h>
 	#include <sys/stat.h>
 	#include <sys/socket.h>
+	#include <sys/uio.h>
 	#include <sys/select.h>
 	#include <arpa/inet.h>
+	#include <netinet/in.h>
+	#include <netinet/tcp.h>
 	#include <netdb.h>
 	#include <fcntl.h>
 
@@ -29,6 +32,12 @@
 void http_socket_initialize(void);
 void http_socket_shutdown(void);
 void http_socket_set_non_blocking(socket_t sock);
-int http_socket_write_all(socket_t sock, const void *buffer, size_t length);
+
+// Disables Nagle's algorithm, so small writes are sent right away instead of waiting for the previous ones to be acknowledged.
+void http_socket_set_no_delay(socket_t sock);
+
+// Sends data from a file starting at the given offset, which is advanced by the amount sent. Uses sendfile()
+// when available so the data never enters userspace. Returns the number of bytes sent, or -1 on error.
+ssize_t http_socket_send_file(socket_t sock, int file, off_t *offset, size_t length);
 
 #endif
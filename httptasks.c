@@ -0,0 +1,242 @@
+#include "httptasks.h"
+#include <string.h>
+#include <stdlib.h>
+
+// --------------------------------------------------------------------------------
+
+struct http_task_thread_t {
+	pthread_t thread;
+	struct http_task_pool_t *pool;
+	size_t index;					// Position of the thread in the pool, which decides the deque it steals from first
+};
+
+// --------------------------------------------------------------------------------
+
+static void *http_task_pool_thread(void *arg);
+static void *http_task_pool_find(struct http_task_pool_t *pool, size_t first);
+static bool http_task_pool_has_tasks(struct http_task_pool_t *pool);
+
+// --------------------------------------------------------------------------------
+
+bool http_deque_create(struct http_deque_t *deque, size_t size)
+{
+	memset(deque, 0, sizeof(*deque));
+
+	// The indices are masked into the ring buffer, which requires a power of two.
+	size_t capacity = 1;
+
+	while (capacity < size) {
+		capacity <<= 1;
+	}
+
+	deque->tasks = calloc(capacity, sizeof(*deque->tasks));
+	deque->size = capacity;
+
+	return (deque->tasks != NULL);
+}
+
+void http_deque_destroy(struct http_deque_t *deque)
+{
+	free(deque->tasks);
+	memset(deque, 0, sizeof(*deque));
+}
+
+bool http_deque_push(struct http_deque_t *deque, void *task)
+{
+	int64_t bottom = __atomic_load_n(&deque->bottom, __ATOMIC_RELAXED);
+	int64_t top = __atomic_load_n(&deque->top, __ATOMIC_ACQUIRE);
+
+	if (bottom - top >= (int64_t)deque->size) {
+		return false;
+	}
+
+	// The task has to be in the buffer before a thief can see the new bottom.
+	__atomic_store_n(&deque->tasks[bottom & (int64_t)(deque->size - 1)], task, __ATOMIC_RELAXED);
+	__atomic_store_n(&deque->bottom, bottom + 1, __ATOMIC_RELEASE);
+
+	return true;
+}
+
+void *http_deque_steal(struct http_deque_t *deque)
+{
+	int64_t top = __atomic_load_n(&deque->top, __ATOMIC_ACQUIRE);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	int64_t bottom = __atomic_load_n(&deque->bottom, __ATOMIC_ACQUIRE);
+
+	if (top >= bottom) {
+		return NULL;
+	}
+
+	// The task is read before claiming it, as the owner may reuse the slot as soon as the top has moved past it.
+	void *task = __atomic_load_n(&deque->tasks[top & (int64_t)(deque->size - 1)], __ATOMIC_RELAXED);
+
+	if (!__atomic_compare_exchange_n(&deque->top, &top, top + 1, false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+		return NULL;
+	}
+
+	return task;
+}
+
+bool http_task_pool_start(struct http_task_pool_t *pool, size_t threads, size_t deques, size_t deque_size, http_task_run_t run)
+{
+	memset(pool, 0, sizeof(*pool));
+
+	pool->run = run;
+
+	pthread_mutex_init(&pool->lock, NULL);
+	pthread_cond_init(&pool->work, NULL);
+
+	pool->deques = calloc(deques, sizeof(*pool->deques));
+	pool->threads = calloc(threads, sizeof(*pool->threads));
+
+	if (pool->deques == NULL || pool->threads == NULL) {
+		http_task_pool_stop(pool);
+		return false;
+	}
+
+	for (size_t i = 0; i < deques; ++i) {
+
+		if (!http_deque_create(&pool->deques[i], deque_size)) {
+			http_task_pool_stop(pool);
+			return false;
+		}
+
+		pool->deques_len++;
+	}
+
+	for (size_t i = 0; i < threads; ++i) {
+
+		struct http_task_thread_t *thread = &pool->threads[i];
+
+		thread->pool = pool;
+		thread->index = i;
+
+		if (pthread_create(&thread->thread, NULL, http_task_pool_thread, thread) != 0) {
+			http_task_pool_stop(pool);
+			return false;
+		}
+
+		pool->threads_len++;
+	}
+
+	return true;
+}
+
+void http_task_pool_stop(struct http_task_pool_t *pool)
+{
+	pthread_mutex_lock(&pool->lock);
+
+	pool->stopping = true;
+	pthread_cond_broadcast(&pool->work);
+
+	pthread_mutex_unlock(&pool->lock);
+
+	// The threads run the remaining tasks before they exit.
+	for (size_t i = 0; i < pool->threads_len; ++i) {
+		pthread_join(pool->threads[i].thread, NULL);
+	}
+
+	if (pool->deques != NULL) {
+
+		for (size_t i = 0; i < pool->deques_len; ++i) {
+			http_deque_destroy(&pool->deques[i]);
+		}
+	}
+
+	free(pool->deques);
+	free(pool->threads);
+
+	pthread_cond_destroy(&pool->work);
+	pthread_mutex_destroy(&pool->lock);
+
+	memset(pool, 0, sizeof(*pool));
+}
+
+bool http_task_pool_push(struct http_task_pool_t *pool, size_t deque, void *task)
+{
+	if (!http_deque_push(&pool->deques[deque], task)) {
+		return false;
+	}
+
+	// A thread which is about to sleep either sees the new task or is counted as sleeping here, in which case
+	// it's woken up. The lock is only taken when some thread is actually sleeping.
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+	if (__atomic_load_n(&pool->sleeping, __ATOMIC_RELAXED) > 0) {
+
+		pthread_mutex_lock(&pool->lock);
+		pthread_cond_signal(&pool->work);
+		pthread_mutex_unlock(&pool->lock);
+	}
+
+	return true;
+}
+
+static void *http_task_pool_thread(void *arg)
+{
+	struct http_task_thread_t *thread = arg;
+	struct http_task_pool_t *pool = thread->pool;
+
+	for (;;) {
+
+		void *task = http_task_pool_find(pool, thread->index);
+
+		if (task != NULL) {
+			pool->run(task, thread->index);
+			continue;
+		}
+
+		// Out of work, sleep until a task is pushed. The thread is counted as sleeping before looking
+		// at the deques for the last time, so a task pushed after the check is always signalled.
+		pthread_mutex_lock(&pool->lock);
+
+		__atomic_add_fetch(&pool->sleeping, 1, __ATOMIC_SEQ_CST);
+		__atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+		while (!pool->stopping && !http_task_pool_has_tasks(pool)) {
+			pthread_cond_wait(&pool->work, &pool->lock);
+		}
+
+		__atomic_sub_fetch(&pool->sleeping, 1, __ATOMIC_SEQ_CST);
+
+		bool stop = (pool->stopping && !http_task_pool_has_tasks(pool));
+		pthread_mutex_unlock(&pool->lock);
+
+		if (stop) {
+			break;
+		}
+	}
+
+	return NULL;
+}
+
+static void *http_task_pool_find(struct http_task_pool_t *pool, size_t first)
+{
+	// A steal fails when another thread takes the same task, so keep looking for as long as there are tasks left.
+	do {
+		for (size_t i = 0; i < pool->deques_len; ++i) {
+
+			void *task = http_deque_steal(&pool->deques[(first + i) % pool->deques_len]);
+
+			if (task != NULL) {
+				return task;
+			}
+		}
+	} while (http_task_pool_has_tasks(pool));
+
+	return NULL;
+}
+
+static bool http_task_pool_has_tasks(struct http_task_pool_t *pool)
+{
+	for (size_t i = 0; i < pool->deques_len; ++i) {
+
+		struct http_deque_t *deque = &pool->deques[i];
+
+		if (__atomic_load_n(&deque->top, __ATOMIC_ACQUIRE) < __atomic_load_n(&deque->bottom, __ATOMIC_ACQUIRE)) {
+			return true;
+		}
+	}
+
+	return false;
+}
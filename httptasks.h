@@ -0,0 +1,67 @@
+#pragma once
+#ifndef __HTTPTASKS_H
+#define __HTTPTASKS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+#define HTTP_TASK_CACHE_LINE 64
+
+// --------------------------------------------------------------------------------
+
+typedef void(*http_task_run_t)(void *task, size_t thread);
+
+// A bounded Chase-Lev work-stealing deque. The owner pushes tasks to the bottom without taking a lock,
+// and any other thread can steal the oldest task from the top with a compare-and-swap. The top and the bottom
+// are on separate cache lines, so the owner adding tasks doesn't slow down the thieves taking them.
+struct http_deque_t {
+	int64_t top;					// Index of the oldest task, advanced by the thieves
+	char padding1[HTTP_TASK_CACHE_LINE - sizeof(int64_t)];
+	int64_t bottom;					// Index after the newest task, only written by the owner
+	char padding2[HTTP_TASK_CACHE_LINE - sizeof(int64_t)];
+	void **tasks;					// Ring buffer of tasks, the size is a power of two
+	size_t size;
+};
+
+// A pool of threads which run the tasks pushed to a set of deques. Each deque is owned by one producer thread,
+// and the pool's threads steal from all of them, starting with a different deque each so they spread out.
+// Threads which run out of work sleep until a producer pushes a new task.
+struct http_task_pool_t {
+	struct http_deque_t *deques;
+	size_t deques_len;
+	struct http_task_thread_t *threads;
+	size_t threads_len;				// Number of threads which have been started
+	http_task_run_t run;			// Called on one of the pool's threads for each task, with the index of the thread
+	pthread_mutex_t lock;			// Protects sleeping on the condition
+	pthread_cond_t work;			// Signalled when there's work for a sleeping thread
+	int sleeping;					// Number of threads sleeping on the condition
+	bool stopping;
+};
+
+// --------------------------------------------------------------------------------
+
+// Creates a deque with room for at least the given number of tasks.
+bool http_deque_create(struct http_deque_t *deque, size_t size);
+void http_deque_destroy(struct http_deque_t *deque);
+
+// Adds a task to the bottom of the deque. Only called by the owner. Returns false if the deque is full.
+bool http_deque_push(struct http_deque_t *deque, void *task);
+
+// Takes the oldest task from the top of the deque. Can be called by any thread. Returns NULL if the deque is empty
+// or another thread took the task first.
+void *http_deque_steal(struct http_deque_t *deque);
+
+// Starts the given number of threads to run the tasks pushed to the pool's deques, each of which holds
+// up to deque_size tasks.
+bool http_task_pool_start(struct http_task_pool_t *pool, size_t threads, size_t deques, size_t deque_size, http_task_run_t run);
+
+// Stops the threads once every task which has been pushed has been run, and destroys the pool.
+void http_task_pool_stop(struct http_task_pool_t *pool);
+
+// Pushes a task to one of the deques for the pool's threads to run. Only called by the owner of the deque.
+// Returns false if the deque is full, in which case the caller should run the task itself.
+bool http_task_pool_push(struct http_task_pool_t *pool, size_t deque, void *task);
+
+#endif
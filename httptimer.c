@@ -0,0 +1,201 @@
+#include "httptimer.h"
+#include <string.h>
+#include <time.h>
+
+#ifdef _WIN32
+#include <Windows.h>
+#endif
+
+// --------------------------------------------------------------------------------
+
+static void http_timer_insert(struct http_timer_wheel_t *wheel, struct http_timer_t *timer);
+static void http_timer_unlink(struct http_timer_t *timer);
+static void http_timer_cascade(struct http_timer_wheel_t *wheel, int level);
+
+// --------------------------------------------------------------------------------
+
+void http_timer_wheel_initialize(struct http_timer_wheel_t *wheel, uint64_t now)
+{
+	memset(wheel, 0, sizeof(*wheel));
+	wheel->current = now;
+}
+
+void http_timer_set(struct http_timer_wheel_t *wheel, struct http_timer_t *timer, uint64_t expires)
+{
+	if (timer->link != NULL) {
+		http_timer_unlink(timer);
+		wheel->timers_len--;
+	}
+
+	timer->expires = expires;
+
+	http_timer_insert(wheel, timer);
+	wheel->timers_len++;
+}
+
+void http_timer_cancel(struct http_timer_wheel_t *wheel, struct http_timer_t *timer)
+{
+	if (timer->link != NULL) {
+		http_timer_unlink(timer);
+		wheel->timers_len--;
+	}
+}
+
+struct http_timer_t *http_timer_advance(struct http_timer_wheel_t *wheel, uint64_t now)
+{
+	struct http_timer_t *expired = NULL;
+
+	// Nothing to expire, skip straight to the current time.
+	if (wheel->timers_len == 0) {
+
+		if (now > wheel->current) {
+			wheel->current = now;
+		}
+
+		return NULL;
+	}
+
+	while (wheel->current < now) {
+
+		wheel->current++;
+
+		// When the wheel reaches the start of a slot on a higher level, the timers of the slot are moved
+		// to the lower levels. Higher levels go first so their timers end up in the right lower slots.
+		for (int level = HTTP_TIMER_LEVELS - 1; level > 0; --level) {
+
+			uint64_t mask = ((uint64_t)1 << (HTTP_TIMER_SLOT_BITS * level)) - 1;
+
+			if ((wheel->current & mask) == 0) {
+				http_timer_cascade(wheel, level);
+			}
+		}
+
+		// Every timer in the current slot of the lowest level has expired.
+		struct http_timer_t **slot = &wheel->slots[0][wheel->current & (HTTP_TIMER_SLOTS - 1)];
+
+		while (*slot != NULL) {
+
+			struct http_timer_t *timer = *slot;
+			http_timer_unlink(timer);
+
+			timer->next = expired;
+			expired = timer;
+
+			wheel->timers_len--;
+		}
+
+		if (wheel->timers_len == 0) {
+			wheel->current = now;
+			break;
+		}
+	}
+
+	return expired;
+}
+
+bool http_timer_get_next(const struct http_timer_wheel_t *wheel, uint64_t *time)
+{
+	if (wheel->timers_len == 0) {
+		return false;
+	}
+
+	// The slots behind the wheel's position on each level are empty, so the first occupied slot ahead of it
+	// is the next one to be processed. Every slot on a level comes before the next slot of the level above.
+	for (int level = 0; level < HTTP_TIMER_LEVELS; ++level) {
+
+		uint64_t position = (wheel->current >> (HTTP_TIMER_SLOT_BITS * level));
+
+		for (uint64_t i = 1; i < HTTP_TIMER_SLOTS; ++i) {
+
+			if (wheel->slots[level][(position + i) & (HTTP_TIMER_SLOTS - 1)] != NULL) {
+				*time = ((position + i) << (HTTP_TIMER_SLOT_BITS * level));
+				return true;
+			}
+		}
+	}
+
+	return false;
+}
+
+uint64_t http_timer_get_time(void)
+{
+#ifdef _WIN32
+	return (uint64_t)GetTickCount64();
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+#endif
+}
+
+static void http_timer_insert(struct http_timer_wheel_t *wheel, struct http_timer_t *timer)
+{
+	// A timer which has already expired expires on the next tick.
+	uint64_t when = (timer->expires > wheel->current ? timer->expires : wheel->current + 1);
+	int level;
+
+	// Use the lowest level on which the expiry time is within the current revolution of the level above.
+	// The slot on that level is always ahead of the wheel's current position.
+	for (level = 0; level < HTTP_TIMER_LEVELS; ++level) {
+
+		int shift = HTTP_TIMER_SLOT_BITS * (level + 1);
+
+		if (level == HTTP_TIMER_LEVELS - 1 || (when >> shift) == (wheel->current >> shift)) {
+			break;
+		}
+	}
+
+	uint64_t position = (when >> (HTTP_TIMER_SLOT_BITS * level));
+
+	// The timer is further away than the wheel can represent. Put it into the last slot of the highest level,
+	// from where it is moved back up before it's due.
+	if (level == HTTP_TIMER_LEVELS - 1) {
+
+		uint64_t current = (wheel->current >> (HTTP_TIMER_SLOT_BITS * level));
+
+		if (position - current >= HTTP_TIMER_SLOTS) {
+			position = current + HTTP_TIMER_SLOTS - 1;
+		}
+	}
+
+	struct http_timer_t **slot = &wheel->slots[level][position & (HTTP_TIMER_SLOTS - 1)];
+
+	timer->next = *slot;
+	timer->link = slot;
+
+	if (*slot != NULL) {
+		(*slot)->link = &timer->next;
+	}
+
+	*slot = timer;
+}
+
+static void http_timer_unlink(struct http_timer_t *timer)
+{
+	*timer->link = timer->next;
+
+	if (timer->next != NULL) {
+		timer->next->link = timer->link;
+	}
+
+	timer->next = NULL;
+	timer->link = NULL;
+}
+
+static void http_timer_cascade(struct http_timer_wheel_t *wheel, int level)
+{
+	size_t index = (wheel->current >> (HTTP_TIMER_SLOT_BITS * level)) & (HTTP_TIMER_SLOTS - 1);
+
+	struct http_timer_t *timer = wheel->slots[level][index];
+	wheel->slots[level][index] = NULL;
+
+	// Reschedule the timers of the slot, which puts them on a lower level as they are now closer.
+	while (timer != NULL) {
+
+		struct http_timer_t *next = timer->next;
+		http_timer_insert(wheel, timer);
+
+		timer = next;
+	}
+}
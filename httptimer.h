@@ -0,0 +1,55 @@
+#pragma once
+#ifndef __HTTPTIMER_H
+#define __HTTPTIMER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#define HTTP_TIMER_LEVELS 4
+#define HTTP_TIMER_SLOT_BITS 6
+#define HTTP_TIMER_SLOTS (1 << HTTP_TIMER_SLOT_BITS)
+
+// --------------------------------------------------------------------------------
+
+// A timer which can be embedded into the object it belongs to. A timer is only in one wheel at a time.
+struct http_timer_t {
+	uint64_t expires;				// Time at which the timer expires, in milliseconds
+	void *data;						// User data, e.g. the object the timer belongs to
+	struct http_timer_t *next;
+	struct http_timer_t **link;		// Pointer which points to this timer, NULL if the timer isn't scheduled
+};
+
+// A hierarchical timing wheel with a resolution of one millisecond. Each level has 64 slots and each slot
+// of a level spans all of the slots of the level below. Scheduling and cancelling a timer takes constant time,
+// and advancing the wheel only touches the timers which expire or move to a lower level.
+// Timers further away than the wheel can represent (about 4.6 hours) are moved closer until they fit.
+// The wheel is not thread safe, each event loop has its own.
+struct http_timer_wheel_t {
+	uint64_t current;				// Time up to which the wheel has been advanced
+	size_t timers_len;				// Number of scheduled timers
+	struct http_timer_t *slots[HTTP_TIMER_LEVELS][HTTP_TIMER_SLOTS];
+};
+
+// --------------------------------------------------------------------------------
+
+void http_timer_wheel_initialize(struct http_timer_wheel_t *wheel, uint64_t now);
+
+// Schedules the timer to expire at the given time. A timer which was already scheduled is rescheduled.
+void http_timer_set(struct http_timer_wheel_t *wheel, struct http_timer_t *timer, uint64_t expires);
+
+// Unschedules the timer. Safe to call for a timer which isn't scheduled.
+void http_timer_cancel(struct http_timer_wheel_t *wheel, struct http_timer_t *timer);
+
+// Advances the wheel to the given time. Returns the timers which have expired as a list linked
+// through their next pointers. The returned timers are no longer scheduled.
+struct http_timer_t *http_timer_advance(struct http_timer_wheel_t *wheel, uint64_t now);
+
+// Finds the time at which the wheel next has to be advanced, either because a timer expires or because timers
+// on a higher level have to be moved closer. Returns false if no timers are scheduled.
+bool http_timer_get_next(const struct http_timer_wheel_t *wheel, uint64_t *time);
+
+// Current value of a monotonic clock in milliseconds.
+uint64_t http_timer_get_time(void);
+
+#endif
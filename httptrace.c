@@ -0,0 +1,157 @@
+#include "httptrace.h"
+#include "httpmetrics.h"
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+// --------------------------------------------------------------------------------
+
+static const struct {
+	const char *name;
+	const char *value;				// Name of the span's value in the trace
+} phases[HTTP_TRACE_PHASES] = {
+	{ "wait", "events" },
+	{ "receive", "bytes" },
+	{ "parse", "bytes" },
+	{ "handler", "connection" },
+	{ "static file", "connection" },
+	{ "send", "bytes" },
+};
+
+// --------------------------------------------------------------------------------
+
+static void http_trace_write_span(FILE *file, const struct http_trace_span_t *span);
+
+// --------------------------------------------------------------------------------
+
+bool http_trace_create(struct http_trace_t *trace, uint32_t thread)
+{
+	memset(trace, 0, sizeof(*trace));
+
+	trace->spans = calloc(HTTP_TRACE_SPANS, sizeof(*trace->spans));
+	trace->thread = thread;
+
+	return (trace->spans != NULL);
+}
+
+void http_trace_destroy(struct http_trace_t *trace)
+{
+	free(trace->spans);
+	memset(trace, 0, sizeof(*trace));
+}
+
+void http_trace_add(struct http_trace_t *trace, enum http_trace_phase_t phase, uint64_t start, uint64_t value)
+{
+	http_trace_add_span(trace, phase, trace->thread, start, http_trace_get_time() - start, value);
+}
+
+void http_trace_add_span(struct http_trace_t *trace, enum http_trace_phase_t phase, uint32_t thread, uint64_t start, uint64_t duration, uint64_t value)
+{
+	uint64_t head = trace->head;
+	struct http_trace_span_t *span = &trace->spans[head & (HTTP_TRACE_SPANS - 1)];
+
+	// Announce the slot is being overwritten before writing to it, like a sequence lock. A reader which copies
+	// the slot at the same time sees the announcement afterwards and discards its copy.
+	__atomic_store_n(&trace->reserved, head + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	__atomic_store_n(&span->start, start, __ATOMIC_RELAXED);
+	__atomic_store_n(&span->duration, duration, __ATOMIC_RELAXED);
+	__atomic_store_n(&span->value, value, __ATOMIC_RELAXED);
+	__atomic_store_n(&span->thread, thread, __ATOMIC_RELAXED);
+	__atomic_store_n(&span->phase, (uint32_t)phase, __ATOMIC_RELAXED);
+
+	__atomic_store_n(&trace->head, head + 1, __ATOMIC_RELEASE);
+}
+
+uint64_t http_trace_get_time(void)
+{
+	// The same clock as the latency histograms, so the two can be compared.
+	return http_metrics_get_time();
+}
+
+bool http_trace_write(struct http_trace_t *const *traces, size_t traces_len, size_t handler_threads, const char *path)
+{
+	struct http_trace_span_t *spans = malloc(HTTP_TRACE_SPANS * sizeof(*spans));
+	FILE *file = fopen(path, "w");
+
+	if (spans == NULL || file == NULL) {
+
+		if (file != NULL) {
+			fclose(file);
+		}
+
+		free(spans);
+		return false;
+	}
+
+	fprintf(file, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+
+	// Name the threads.
+	fprintf(file, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"httpserver\"}}");
+
+	for (size_t i = 0; i < traces_len; ++i) {
+		fprintf(file, ",{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"loop %u\"}}",
+			traces[i]->thread, traces[i]->thread);
+	}
+
+	for (size_t i = 0; i < handler_threads; ++i) {
+		fprintf(file, ",{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"handler thread %u\"}}",
+			HTTP_TRACE_HANDLER_THREAD + (unsigned int)i, (unsigned int)i);
+	}
+
+	for (size_t i = 0; i < traces_len; ++i) {
+
+		const struct http_trace_t *trace = traces[i];
+
+		// Copy the spans, then check which of them the loop may have overwritten in the meantime.
+		uint64_t head = __atomic_load_n(&trace->head, __ATOMIC_ACQUIRE);
+		uint64_t tail = (head > HTTP_TRACE_SPANS ? head - HTTP_TRACE_SPANS : 0);
+
+		for (uint64_t j = tail; j < head; ++j) {
+
+			const struct http_trace_span_t *span = &trace->spans[j & (HTTP_TRACE_SPANS - 1)];
+			struct http_trace_span_t *copy = &spans[j - tail];
+
+			copy->start = __atomic_load_n(&span->start, __ATOMIC_RELAXED);
+			copy->duration = __atomic_load_n(&span->duration, __ATOMIC_RELAXED);
+			copy->value = __atomic_load_n(&span->value, __ATOMIC_RELAXED);
+			copy->thread = __atomic_load_n(&span->thread, __ATOMIC_RELAXED);
+			copy->phase = __atomic_load_n(&span->phase, __ATOMIC_RELAXED);
+		}
+
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		uint64_t reserved = __atomic_load_n(&trace->reserved, __ATOMIC_RELAXED);
+
+		// Slot j is overwritten by span j + HTTP_TRACE_SPANS.
+		for (uint64_t j = tail; j < head; ++j) {
+
+			if (j + HTTP_TRACE_SPANS >= reserved) {
+				http_trace_write_span(file, &spans[j - tail]);
+			}
+		}
+	}
+
+	fprintf(file, "]}\n");
+
+	bool written = (ferror(file) == 0);
+
+	if (fclose(file) != 0) {
+		written = false;
+	}
+
+	free(spans);
+	return written;
+}
+
+static void http_trace_write_span(FILE *file, const struct http_trace_span_t *span)
+{
+	if (span->phase >= HTTP_TRACE_PHASES) {
+		return;
+	}
+
+	// Complete events, with the times in microseconds.
+	fprintf(file, ",{\"name\":\"%s\",\"cat\":\"http\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"%s\":%llu}}",
+		phases[span->phase].name, span->thread, (double)span->start / 1000, (double)span->duration / 1000,
+		phases[span->phase].value, (unsigned long long)span->value);
+}
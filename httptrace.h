@@ -0,0 +1,60 @@
+#pragma once
+#ifndef __HTTPTRACE_H
+#define __HTTPTRACE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#define HTTP_TRACE_SPANS 16384
+#define HTTP_TRACE_HANDLER_THREAD 1000
+
+// --------------------------------------------------------------------------------
+
+enum http_trace_phase_t {
+	HTTP_TRACE_WAIT,				// Waiting for events from the event backend
+	HTTP_TRACE_RECEIVE,				// Reading from a socket
+	HTTP_TRACE_PARSE,				// Parsing the received data of a connection
+	HTTP_TRACE_HANDLER,				// Running a route handler or the default handler
+	HTTP_TRACE_STATIC_FILE,			// Opening, reading, caching and sending a static file
+	HTTP_TRACE_SEND,				// Writing to a socket
+	HTTP_TRACE_PHASES
+};
+
+// A timed phase. The value depends on the phase, e.g. the number of bytes sent.
+struct http_trace_span_t {
+	uint64_t start;					// Time the phase started, in nanoseconds
+	uint64_t duration;
+	uint64_t value;
+	uint32_t thread;				// Loop the phase ran on, or HTTP_TRACE_HANDLER_THREAD plus the index of a handler thread
+	uint32_t phase;
+};
+
+// A ring buffer of the latest spans of an event loop. Only the loop adds spans, overwriting the oldest ones,
+// and any thread can copy them out at the same time. The spans which were overwritten while copying are dropped.
+struct http_trace_t {
+	struct http_trace_span_t *spans;
+	uint64_t head;					// Number of spans ever added
+	uint64_t reserved;				// Number of spans the loop has started to add, one more than the head while adding one
+	uint32_t thread;				// Index of the loop
+};
+
+// --------------------------------------------------------------------------------
+
+bool http_trace_create(struct http_trace_t *trace, uint32_t thread);
+void http_trace_destroy(struct http_trace_t *trace);
+
+// Adds a span which started at the given time and ends now. Only called by the loop which owns the trace.
+void http_trace_add(struct http_trace_t *trace, enum http_trace_phase_t phase, uint64_t start, uint64_t value);
+
+// Adds a span which has already ended, e.g. one which ran on another thread.
+void http_trace_add_span(struct http_trace_t *trace, enum http_trace_phase_t phase, uint32_t thread, uint64_t start, uint64_t duration, uint64_t value);
+
+// Current value of the monotonic clock the spans are timed with, in nanoseconds.
+uint64_t http_trace_get_time(void);
+
+// Writes the spans of all the traces to a file in the Chrome trace event format, which can be opened
+// in chrome://tracing or Perfetto. Returns false if the file couldn't be written.
+bool http_trace_write(struct http_trace_t *const *traces, size_t traces_len, size_t handler_threads, const char *path);
+
+#endif
@@ -1,9 +1,15 @@
+// strptime() and timegm() are GNU/XSI extensions.
+#define _GNU_SOURCE
+
 #include "httputils.h"
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
 #include <stdbool.h>
 #include <ctype.h>
+#include <strings.h>
+#include <time.h>
 
 void string_get_file_extension(const char *str, char* buffer, size_t buffer_len)
 {
@@ -39,103 +45,187 @@ void string_get_file_extension(const char *str, char* buffer, size_t buffer_len)
 	}
 }
 
-static char *string_remove_leading_white_space(char* str)
+bool string_contains_token(const char *list, const char *token)
 {
-	if (str == NULL) {
-		return NULL;
-	}
+	size_t token_len = strlen(token);
+
+	while (*list != 0) {
+
+		// Skip the separators and white space before the next item.
+		while (*list == ',' || *list == ' ' || *list == '\t') {
+			++list;
+		}
+
+		// Find the end of the item. Parameters after a semicolon are not part of the token.
+		const char *end = list;
 
-	for (;;) {
-		switch (*str) {
-		case ' ':
-		case '\n':
-		case '\r':
-		case '\t':
-			*str++ = '\0';
-			continue;
+		while (*end != 0 && *end != ',' && *end != ';' && *end != ' ' && *end != '\t') {
+			++end;
+		}
 
-		case '\0':
-			return NULL;
+		if ((size_t)(end - list) == token_len && strncasecmp(list, token, token_len) == 0) {
+			return true;
+		}
+
+		// Skip to the next item.
+		list = strchr(end, ',');
+
+		if (list == NULL) {
+			break;
 		}
-		break;
 	}
 
-	return str;
+	return false;
 }
 
-static char *string_skip_non_white_space(char *str, bool skip_until_new_line)
+size_t string_format_http_date(time_t date, char *buffer, size_t buffer_len)
 {
-	if (str == NULL) {
-		return NULL;
+	struct tm tm;
+
+	if (gmtime_r(&date, &tm) == NULL) {
+		*buffer = 0;
+		return 0;
 	}
 
-	for (;;) {
-		switch (*str) {
-		case ' ':
-		case '\t':
-			if (!skip_until_new_line) {
-				return str;
-			}
-			break;
+	return strftime(buffer, buffer_len, "%a, %d %b %Y %H:%M:%S GMT", &tm);
+}
 
-		case '\n':
-		case '\r':
-			return str;
+bool string_parse_http_date(const char *str, time_t *date)
+{
+	struct tm tm;
+	memset(&tm, 0, sizeof(tm));
 
-		case '\0':
-			return NULL;
-		}
+	// Only the IMF-fixdate format is accepted, the obsolete formats are not used by modern clients.
+	const char *end = strptime(str, "%a, %d %b %Y %H:%M:%S GMT", &tm);
 
-		++str;
+	if (end == NULL || *end != 0) {
+		return false;
 	}
 
-	return str;
+	*date = timegm(&tm);
+	return true;
 }
 
-static char *string_skip_past_line_break(char* str)
+bool string_matches_etag(const char *list, const char *etag)
 {
-	if (str == NULL) {
-		return NULL;
+	size_t etag_len = strlen(etag);
+
+	while (*list != 0) {
+
+		// Skip the separators and white space before the next tag.
+		while (*list == ',' || *list == ' ' || *list == '\t') {
+			++list;
+		}
+
+		// A wildcard matches any current representation.
+		if (*list == '*') {
+			return true;
+		}
+
+		// Conditional GET uses weak comparison, so the weakness indicator is ignored.
+		if (strncmp(list, "W/", 2) == 0) {
+			list += 2;
+		}
+
+		if (strncmp(list, etag, etag_len) == 0 &&
+			(list[etag_len] == 0 || list[etag_len] == ',' || list[etag_len] == ' ' || list[etag_len] == '\t')) {
+			return true;
+		}
+
+		list = strchr(list, ',');
+
+		if (list == NULL) {
+			break;
+		}
 	}
 
-	for (;;) {
-		switch (*str) {
-		case '\0':
-			return NULL;
+	return false;
+}
 
-		case '\r':
-		case '\n':
-			++str;
+bool string_accepts_encoding(const char *list, const char *coding)
+{
+	size_t coding_len = strlen(coding);
+	int wildcard = -1;
 
-			if (*str == '\n' || *str == '\r') {
-				++str;
-			}
+	while (*list != 0) {
+
+		// Skip the separators and white space before the next item.
+		while (*list == ',' || *list == ' ' || *list == '\t') {
+			++list;
+		}
+
+		const char *end = list;
+
+		while (*end != 0 && *end != ',' && *end != ';' && *end != ' ' && *end != '\t') {
+			++end;
+		}
+
+		size_t len = (size_t)(end - list);
+
+		// A quality value of zero means the coding is not acceptable.
+		bool acceptable = true;
+		const char *next = strchr(end, ',');
+		const char *quality = strstr(end, "q=");
+
+		if (quality != NULL && (next == NULL || quality < next)) {
+			acceptable = (strtod(&quality[2], NULL) > 0);
+		}
+
+		// An explicitly listed coding overrides the wildcard.
+		if (len == coding_len && strncasecmp(list, coding, coding_len) == 0) {
+			return acceptable;
+		}
 
-			return str;
+		if (len == 1 && *list == '*') {
+			wildcard = acceptable;
 		}
 
-		++str;
+		if (next == NULL) {
+			break;
+		}
+
+		list = next;
 	}
 
-	return str;
+	return (wildcard > 0);
 }
 
-char *string_parse_header_text(char *str, char **header, char **value)
+bool string_decode_url_path(char *path)
 {
-	// Remove all leading white space. The starting string is the header.
-	str = string_remove_leading_white_space(str);
+	char *out = path;
+
+	for (const char *c = path; *c != 0; ++c) {
+
+		// Percent-encoded bytes are decoded, malformed escapes are left as they are.
+		if (c[0] == '%' && isxdigit((unsigned char)c[1]) && isxdigit((unsigned char)c[2])) {
+
+			char hex[3] = { c[1], c[2], 0 };
+			char decoded = (char)strtol(hex, NULL, 16);
+
+			// A null byte would truncate the path.
+			if (decoded == 0) {
+				return false;
+			}
 
-	*header = str;
+			*out++ = decoded;
+			c += 2;
+		}
+		else {
+			*out++ = *c;
+		}
+	}
 
-	// Skip the header text and possible white space after it, which gets to the header value.
-	str = string_skip_non_white_space(str, false);
-	str = string_remove_leading_white_space(str);
+	*out = 0;
 
-	*value = str;
+	// Refuse paths which refer to a parent directory, encoded or not.
+	for (const char *segment = path; segment != NULL; segment = strchr(segment + 1, '/')) {
 
-	// Skip the header value and terminate the string.
-	str = string_skip_non_white_space(str, true);
-	str = string_skip_past_line_break(str);
+		const char *name = (*segment == '/' ? segment + 1 : segment);
+
+		if (name[0] == '.' && name[1] == '.' && (name[2] == '/' || name[2] == 0)) {
+			return false;
+		}
+	}
 
-	return str;
+	return true;
 }
@@ -3,8 +3,26 @@
 #define __HTTPUTILS_H
 
 #include <stddef.h>
+#include <stdbool.h>
+#include <time.h>
 
 void string_get_file_extension(const char *str, char* buffer, size_t buffer_len);
-char *string_parse_header_text(char *str, char **header, char **value);
+
+// Checks whether a comma separated header value (such as the value of Connection) contains the given token.
+bool string_contains_token(const char *list, const char *token);
+
+// Checks whether a content coding (e.g. gzip) is acceptable according to the value of Accept-Encoding.
+bool string_accepts_encoding(const char *list, const char *coding);
+
+// Formats and parses dates in the format used by HTTP headers (e.g. Sun, 06 Nov 1994 08:49:37 GMT).
+size_t string_format_http_date(time_t date, char *buffer, size_t buffer_len);
+bool string_parse_http_date(const char *str, time_t *date);
+
+// Checks whether an entity tag is on a list of tags, such as the value of If-None-Match.
+bool string_matches_etag(const char *list, const char *etag);
+
+// Decodes the percent-encoded characters of a URL path in place. Fails if the path contains an encoded null
+// byte or refers to a parent directory with a .. segment.
+bool string_decode_url_path(char *path);
 
 #endif
@@ -2,43 +2,52 @@
 #include <string.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <signal.h>
 
-static struct http_response_t handle_request(struct http_request_t *request, void *context)
+static struct http_response_t handle_test(struct http_request_t *request, void *context)
 {
 	struct http_response_t response;
 	memset(&response, 0, sizeof(response));
 
-	if (strcmp(request->request, "/test") == 0) {
-		response.message = HTTP_200_OK;
-		response.content = "<html><body><h1>:) Everything seems to work!</h1></body></html>\n";
-	}
-	else {
-		response.message = HTTP_404_NOT_FOUND;
-		response.content = "<html><body><h1>Whoops, 404!</h1></body></html>\n";
-	}
-
+	response.message = HTTP_200_OK;
+	response.content = "<html><body><h1>:) Everything seems to work!</h1></body></html>\n";
 	response.content_type = "text/html";
 	response.content_length = strlen(response.content);
 
-	printf("%s request: IP: %s, request: %s\n", request->method, request->requester, request->request);
+	return response;
+}
+
+static struct http_response_t handle_request(struct http_request_t *request, void *context)
+{
+	struct http_response_t response;
+	memset(&response, 0, sizeof(response));
+
+	response.message = HTTP_404_NOT_FOUND;
+	response.content = "<html><body><h1>Whoops, 404!</h1></body></html>\n";
+	response.content_type = "text/html";
+	response.content_length = strlen(response.content);
 
 	return response;
 }
 
+static void handle_signal(int signum)
+{
+	// Stopping the server only sets a flag and wakes it up, which is safe in a signal handler.
+	http_server_stop();
+}
+
 int main(int argc, char *argv[])
 {
 	uint16_t port = 80;
 	const char *static_directory = NULL;
 
-	for (int i = 0; i < argc; ++i) {
+	for (int i = 1; i < argc; ++i) {
 		if (strcmp(argv[i], "--port") == 0 && ++i < argc) {
 			port = (uint16_t)atoi(argv[i]);
-			break;
 		}
 
 		else if (strcmp(argv[i], "--path") == 0 && ++i < argc) {
 			static_directory = argv[i];
-			break;
 		}
 	}
 
@@ -55,10 +64,12 @@ int main(int argc, char *argv[])
 
 	settings.handler = handle_request;
 	settings.port = port;
-	settings.timeout = 10;
 	settings.max_connections = 10;
 	settings.connection_timeout = 60;
 
+	// Requests are logged to the standard output by a thread of the server's own, so the handlers don't have to.
+	settings.access_log = "-";
+
 	// Set a folder to serve static content from.
 	if (static_directory != NULL) {
 		directories[0].directory = static_directory;
@@ -67,6 +78,9 @@ int main(int argc, char *argv[])
 		settings.directories_len = 1;
 	}
 
+	// Requests which don't match a route or a static file are handled by the default handler.
+	http_server_add_route("GET", "/test", handle_test, NULL);
+
 	if (!http_server_initialize(settings)) {
 		printf("Failed to start the server!\n");
 		return 0;
@@ -74,9 +88,11 @@ int main(int argc, char *argv[])
 
 	printf("Started a HTTP server on port %u\n", port);
 
-	for (;;) {
-		http_server_listen();
-	}
+	signal(SIGINT, handle_signal);
+	signal(SIGTERM, handle_signal);
+
+	// Serve requests until interrupted. The server sleeps while there's nothing to do.
+	http_server_run();
 
 	http_server_shutdown();
 	return 0;